@@ -0,0 +1,337 @@
+// Headless.cpp : Entry point and platform layer for batch rendering without a window or display.
+//
+// The counterpart of Win32.cpp for servers with no display server (and possibly no GPU, where Mesa's llvmpipe does
+// the rendering): the GL context comes from EGL's surfaceless platform and every view is drawn into a render target.
+// A .prj set or a model is loaded once, then drawn through the same viewer as the window would use from each camera
+// pose in turn and saved as a PNG. It isn't part of the Windows project build; on Linux, from the repository root:
+//
+//   g++ -std=c++11 -O2 -ISrc Headless.cpp Src/*.cpp -lGLEW -lEGL -lGL -lfreeimage -lpthread -o SpecVizHeadless
+//
+// against the system GLEW, FreeImage and EGL libraries. Like the window it's run from the repository root, where the
+// shaders are found
+
+#include "SpecViz.h"
+#include "ShaderPermutations.h"
+#include "GLDebug.h"
+#include "GPUProfiler.h"
+#include "Profiler.h"
+#include "TextureCompress.h"
+
+// only the EGL API itself is needed, not any native window system types
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <time.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// size of the rendered views unless one is given on the command line ("-size 1920x1080")
+#define HEADLESS_DEFAULT_WIDTH 1024
+#define HEADLESS_DEFAULT_HEIGHT 1024
+
+// views rendered around the model by "-turntable" unless a count is given
+#define HEADLESS_DEFAULT_TURNTABLE 36
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLConfig eglConfig = NULL;
+static EGLContext glContext = EGL_NO_CONTEXT;		// OpenGL context
+static uint32_t targetWidth = HEADLESS_DEFAULT_WIDTH;
+static uint32_t targetHeight = HEADLESS_DEFAULT_HEIGHT;
+
+// creates a desktop OpenGL context on the display, sharing objects with the given context (if any). Returns
+// EGL_NO_CONTEXT on failure
+static EGLContext CreateContext(EGLContext share) {
+	const EGLint attributes[] = {
+#ifdef _DEBUG
+		// debug builds draw on a debug context, as they do in the window
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+		EGL_NONE
+	};
+	return eglCreateContext(eglDisplay, eglConfig, share, attributes);
+}
+
+// sets up EGL without any window system and makes a context current on it, with no surface (everything is drawn
+// into frame buffer objects). Returns false if there's no way to get a context
+static bool CreateHeadlessContext() {
+	// the surfaceless platform needs neither a display server nor a GPU. Older EGLs only have the default display
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) {
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (eglDisplay == EGL_NO_DISPLAY) {
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major = 0, minor = 0;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+		Log("Unable to initialize EGL (error 0x%x)", eglGetError());
+		return false;
+	}
+	Log("EGL %d.%d (%s)", major, minor, eglQueryString(eglDisplay, EGL_VENDOR));
+
+	// the viewers are written against desktop GL with its compatibility profile, not GLES
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		Log("EGL has no desktop OpenGL support");
+		return false;
+	}
+
+	// nothing is ever drawn to a surface, so no config is needed where EGL allows it. Otherwise any config will do, but
+	// the default search only covers window configs
+	const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	if (extensions && strstr(extensions, "EGL_KHR_no_config_context")) {
+		eglConfig = EGL_NO_CONFIG_KHR;
+	} else {
+		const EGLint configAttributes[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_NONE
+		};
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(eglDisplay, configAttributes, &eglConfig, 1, &numConfigs) || numConfigs == 0) {
+			Log("No EGL config supports OpenGL");
+			return false;
+		}
+	}
+
+	glContext = CreateContext(EGL_NO_CONTEXT);
+	if (glContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, glContext)) {
+		Log("Unable to create a surfaceless OpenGL context (error 0x%x)", eglGetError());
+		return false;
+	}
+
+	// GLEW builds for GLX go on to look for a GLX display after loading the GL entry points, and report an error when
+	// there isn't one. The context is still usable as long as the core functions were found
+	GLenum err = glewInit();
+	if (err != GLEW_OK) {
+		if (!GLEW_VERSION_3_2) {
+			Log("Unable to load OpenGL functions: %s", glewGetErrorString(err));
+			return false;
+		}
+		Log("GLEW reported '%s', continuing with the functions it loaded", glewGetErrorString(err));
+	}
+	Log("GL %s (%s)", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+	return true;
+}
+
+// destroys the main context and shuts down EGL
+static void DestroyHeadlessContext() {
+	if (eglDisplay == EGL_NO_DISPLAY) {
+		return;
+	}
+	eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (glContext != EGL_NO_CONTEXT) {
+		eglDestroyContext(eglDisplay, glContext);
+	}
+	eglTerminate(eglDisplay);
+}
+
+// reads camera poses, one per line as "yaw pitch roll [distance [centerX centerY centerZ]]" with the angles in
+// degrees and the distance a multiple of the default (see CameraPose). Blank lines and lines starting with # are
+// skipped. Returns false if the file can't be read or a line can't be parsed
+static bool ReadPoses(const char* filename, std::vector<CameraPose>& into) {
+	std::ifstream f(filename);
+	if (!f) {
+		Log("Unable to open pose file '%s'", filename);
+		return false;
+	}
+
+	std::string line;
+	for (uint32_t lineNumber = 1; std::getline(f, line); lineNumber++) {
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') {
+			continue;
+		}
+
+		std::istringstream values(line);
+		glm::vec3 degrees;
+		if (!(values >> degrees.x >> degrees.y >> degrees.z)) {
+			Log("Unable to parse pose on line %d of '%s'", lineNumber, filename);
+			return false;
+		}
+
+		CameraPose pose;
+		pose.rotation = degrees * (glm::pi<float>() / 180.0f);
+		if (values >> pose.distance) {
+			values >> pose.center.x >> pose.center.y >> pose.center.z;
+		}
+		into.push_back(pose);
+	}
+	return true;
+}
+
+// adds the given number of poses spaced evenly in yaw around the model
+static void AddTurntablePoses(uint32_t count, std::vector<CameraPose>& into) {
+	for (uint32_t i = 0; i < count; i++) {
+		CameraPose pose;
+		pose.rotation.x = glm::pi<float>() * 2.0f * i / count;
+		into.push_back(pose);
+	}
+}
+
+// returns true if the file name ends with the given extension (including the dot), ignoring case
+static bool HasExtension(const char* filename, const char* extension) {
+	size_t length = strlen(filename);
+	size_t extensionLength = strlen(extension);
+	return length >= extensionLength && !strcasecmp(filename + length - extensionLength, extension);
+}
+
+static void PrintUsage() {
+	Log("usage: SpecVizHeadless [options] <model.ply | projections.prj...>");
+	Log("  -size WxH          size of the rendered views (default %dx%d)", HEADLESS_DEFAULT_WIDTH,
+		HEADLESS_DEFAULT_HEIGHT);
+	Log("  -poses file        camera poses to render, one \"yaw pitch roll [distance [x y z]]\" per line");
+	Log("  -turntable [N]     render N views around the model (default %d)", HEADLESS_DEFAULT_TURNTABLE);
+	Log("  -out prefix        output file prefix, views are saved as prefix0000.png and on (default \"view\")");
+	Log("  -key name          key press passed to the viewer before rendering, as in the window (repeatable)");
+	Log("  -compress          BC3 compress projection textures");
+}
+
+int main(int argc, char** argv) {
+	std::vector<CameraPose> poses;
+	std::vector<const char*> projFiles;
+	std::vector<const char*> keys;
+	const char* modelFile = NULL;
+	const char* outPrefix = "view";
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(arg, "-size") && hasValue) {
+			if (sscanf(argv[++i], "%ux%u", &targetWidth, &targetHeight) != 2 || !targetWidth || !targetHeight) {
+				Log("Invalid size '%s'", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(arg, "-poses") && hasValue) {
+			if (!ReadPoses(argv[++i], poses)) {
+				return 1;
+			}
+		} else if (!strcmp(arg, "-turntable")) {
+			uint32_t count = HEADLESS_DEFAULT_TURNTABLE;
+			if (hasValue && argv[i + 1][0] != '-' && sscanf(argv[i + 1], "%u", &count) == 1) {
+				i++;
+			}
+			AddTurntablePoses(count, poses);
+		} else if (!strcmp(arg, "-out") && hasValue) {
+			outPrefix = argv[++i];
+		} else if (!strcmp(arg, "-key") && hasValue) {
+			keys.push_back(argv[++i]);
+		} else if (!strcmp(arg, "-compress")) {
+			// projection textures are BC3 compressed when asked for, as in the window
+			SetTextureCompression(true);
+		} else if (arg[0] == '-') {
+			Log("Unknown option '%s'", arg);
+			PrintUsage();
+			return 1;
+		} else if (HasExtension(arg, ".prj")) {
+			projFiles.push_back(arg);
+		} else {
+			modelFile = arg;
+		}
+	}
+
+	if (projFiles.empty() && !modelFile) {
+		PrintUsage();
+		return 1;
+	}
+	if (poses.empty()) {
+		poses.push_back(CameraPose());
+	}
+
+	if (!CreateHeadlessContext()) {
+		DestroyHeadlessContext();
+		return 1;
+	}
+
+#ifdef _DEBUG
+	InitDebugOutput(GL_DEBUG_SEVERITY_LOW, true);
+#else
+	InitDebugOutput(GL_DEBUG_SEVERITY_MEDIUM, false);
+#endif
+	GLState::Init();
+
+	// get the shader variants the viewers need building in the background straight away
+	PrecompileShaders();
+
+	// every view goes into the one target, which stands in for the window's frame buffer
+	GLenum colorFormat = GL_RGBA8;
+	RenderTarget* target = new RenderTarget(targetWidth, targetHeight, &colorFormat, 1);
+	target->Bind();
+
+	// the viewer (and with it the model, projections and programs) is created once and reused for every view
+	Viewer* viewer = projFiles.empty() ? CreateModelViewer(modelFile) : CreateMultiProjViewer(projFiles);
+	for (uint32_t i = 0; i < keys.size(); i++) {
+		viewer->NotifyKeyPress(keys[i]);
+	}
+	if (poses.size() > 1 && !viewer->SetCameraPose(poses[0])) {
+		Log("The viewer has no camera to pose, rendering a single view");
+		poses.resize(1);
+	}
+
+	// views are read back as BGR, which is the byte order SavePNG's FreeImage bitmaps use
+	std::vector<uint8_t> pixels(targetWidth * targetHeight * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	double startTime = GetTimeSeconds();
+	for (uint32_t i = 0; i < poses.size(); i++) {
+		PROFILE_SCOPE("view");
+		viewer->SetCameraPose(poses[i]);
+
+		GetGPUProfiler()->BeginFrame();
+		viewer->MainLoop(0.0f);
+		GetGPUProfiler()->EndFrame();
+		GLState::EndFrame();
+
+		glReadPixels(0, 0, targetWidth, targetHeight, GL_BGR, GL_UNSIGNED_BYTE, &pixels[0]);
+		GLCHECK();
+
+		char pngFile[512];
+		sprintf_s(pngFile, "%s%04d.png", outPrefix, i);
+		Texture::SavePNG(pngFile, targetWidth, targetHeight, &pixels[0]);
+	}
+	double totalTime = GetTimeSeconds() - startTime;
+	Log("Rendered %d views at %dx%d in %.2f s (%.1f ms per view)", (uint32_t) poses.size(), targetWidth, targetHeight,
+		totalTime, totalTime * 1000.0 / poses.size());
+
+	// viewers clear the frame buffer as they're destroyed, so the target stays bound until the viewer is gone
+	delete viewer;
+	target->Unbind();
+	delete target;
+	ReleasePrecompiledShaders();
+	DestroyHeadlessContext();
+	return 0;
+}
+
+float GetAspectRatio() {
+	return (float) targetWidth / (float) targetHeight;
+}
+
+void OutputDebug(const char* line) {
+	printf("%s\n", line);
+}
+
+double GetTimeSeconds() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec * 1.0E-9;
+}
+
+void* CreateSharedContext() {
+	// surfaceless contexts can be made current on any thread without a surface of their own
+	EGLContext context = CreateContext(glContext);
+	return context == EGL_NO_CONTEXT ? NULL : context;
+}
+
+bool MakeContextCurrent(void* context) {
+	if (!context) {
+		return eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) != EGL_FALSE;
+	}
+	return eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext) context) != EGL_FALSE;
+}
+
+void DestroySharedContext(void* context) {
+	eglDestroyContext(eglDisplay, (EGLContext) context);
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 150
+ 
+in  vec3 in_Position;
+
+// depth only passes are followed by passes testing for equal depth, so positions must come out exactly as in the
+// shaders that draw the same mesh with every attribute
+invariant gl_Position;
+
+void main(void)
+{
+	// same transform as the other vertex shaders, with nothing else to pass on
+	vec4 scenePos = objMatrix * vec4(in_Position, 1.0);
+	gl_Position = projMatrix * (viewMatrix * scenePos);
+}
\ No newline at end of file
@@ -10,11 +10,6 @@ out vec2 ex_UV;
 out vec3 ex_Normal;
 out vec3 ex_EyeDirection;
 
-uniform mat4 objMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
-uniform vec3 eyePosition;
- 
 void main(void)
 {
 	// determine scene position from data position and object matrix
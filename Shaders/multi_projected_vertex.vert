@@ -1,48 +1,92 @@
-#version 140
+#version 150
  
 in  vec3 in_Position;
 in  vec2 in_UV;
 in  vec4 in_Color;
 in  vec3 in_Normal;
 
+#ifdef STATIC_PROJECTION
+// projected UVs and facing amounts worked out once when the model loads (see BuildProjectedAttributes), four
+// projections per facing attribute and two per UV attribute
+in  vec4 in_ProjectedFacing[(NUM_SAMPLERS + 3) / 4];
+in  vec4 in_ProjectedUV[(NUM_SAMPLERS + 1) / 2];
+
+// must match PROJECTED_UV_MIN and PROJECTED_UV_MAX in ProjectedAttributes.h
+#define PROJECTED_UV_MIN -1.0
+#define PROJECTED_UV_MAX 2.0
+#endif
+
+// must match MAX_PROJECTIONS in Graphics.h
+#define MAX_PROJECTIONS 200
+
 out vec4 ex_Color;
+#ifdef FRAGMENT_PROJECTION
+// too many projections to interpolate, so the fragment shader projects the mesh position itself
+out vec3 ex_Position;
+out vec3 ex_MeshNormal;
+#else
 out vec3 ex_UV[NUM_SAMPLERS];
+#endif
 out vec3 ex_Normal;
 out vec3 ex_EyeDirection;
 
-uniform mat4 objMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
+// accumulation draws the mesh once for depth and again per batch of projections, testing for equal depth, so every
+// pass must produce exactly the same positions
+invariant gl_Position;
 
-uniform mat4 texMatrix[NUM_SAMPLERS];
+// matrices of every projection, and the part of its texture array layer each image covers, laid out to match
+// ProjectionBlock in Graphics.h
+layout(std140) uniform Projections {
+	mat4 texMatrix[MAX_PROJECTIONS];
+	vec4 uvScale[MAX_PROJECTIONS];
+};
 
-uniform vec3 eyePosition;
+// index of the projection this draw's first sampler uses, when projections are drawn in batches
+uniform int firstProjection;
  
 void main(void)
 {
 	// determine scene position from data position and object matrix
 	vec4 scenePos = objMatrix * vec4(in_Position, 1.0);
 
+#ifdef ATLAS_BAKE
+	// baking draws the mesh flattened out over its atlas UVs
+	gl_Position = vec4(in_UV * 2.0 - 1.0, 0.0, 1.0);
+#else
 	// viewport position is scene position multiplied by view and projection matrices
 	gl_Position = projMatrix * (viewMatrix * scenePos);
+#endif
 	ex_Color = in_Color;
 
 	// object normal is the vertex normal roated by object matrix to get normal in scene space
 	ex_Normal = (objMatrix * vec4(in_Normal, 0.0)).xyz;
 	
+#ifdef FRAGMENT_PROJECTION
+	ex_Position = in_Position;
+	ex_MeshNormal = in_Normal;
+#elif defined(STATIC_PROJECTION)
+	// the texMatrix work below was done up front, so only the stored values need unpacking
+	for (int i = 0; i < NUM_SAMPLERS; i++) {
+		vec4 uvPair = in_ProjectedUV[i / 2];
+		vec2 uv = (i % 2 == 0) ? uvPair.xy : uvPair.zw;
+		ex_UV[i].xy = uv * (PROJECTED_UV_MAX - PROJECTED_UV_MIN) + PROJECTED_UV_MIN;
+		ex_UV[i].z = in_ProjectedFacing[i / 4][i % 4];
+	}
+#else
 	vec4 uv;
 	
 	// UV is a deprojected vector based on the view projection matrix provided with the texture representing texture local mesh space
 	for (int i = 0; i < NUM_SAMPLERS; i++) {
-		uv = texMatrix[i] * vec4(in_Position, 1.0);
+		uv = texMatrix[firstProjection + i] * vec4(in_Position, 1.0);
 		uv.x = uv.x / uv.w;
 		uv.y /= uv.w;
-		ex_UV[i].xy = uv.xy * 0.5 + 0.5;
+		ex_UV[i].xy = (uv.xy * 0.5 + 0.5) * uvScale[firstProjection + i].xy;
 
 		// projected Z value is the face vector amount of the vertex normal in scene space towards the original projection point for that texture
-		vec4 texNormal = texMatrix[i] * vec4(in_Normal, 0.0);
+		vec4 texNormal = texMatrix[firstProjection + i] * vec4(in_Normal, 0.0);
 		ex_UV[i].z = abs(normalize(texNormal.xyz).z);
 	}
+#endif
 	
 	// eye direction determined by taking scene space position and finding normalized difference with eye position
 	ex_EyeDirection = normalize(eyePosition - scenePos.xyz / scenePos.w);
@@ -6,7 +6,6 @@ in  vec2 in_UV;
 out vec2 ex_UV;
 out vec3 ex_EyeDirection;
 
-uniform vec3 eyePosition;
 uniform vec2 scale;
  
 void main(void)
@@ -10,12 +10,7 @@ out vec2 ex_UV;
 out vec3 ex_Normal;
 out vec3 ex_EyeDirection;
 
-uniform mat4 objMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
 uniform mat4 texMatrix;
-
-uniform vec3 eyePosition;
  
 void main(void)
 {
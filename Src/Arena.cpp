@@ -0,0 +1,95 @@
+#include "Arena.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+MemoryArena::MemoryArena(size_t withBlockSize) : blocks(NULL), blockSize(withBlockSize), allocCount(0), blockCount(0), bytesUsed(0) {
+}
+
+MemoryArena::~MemoryArena() {
+	// release every block at once
+	while (blocks) {
+		Block* next = blocks->next;
+		free((void*) blocks);
+		blocks = next;
+	}
+}
+
+void MemoryArena::AddBlock(size_t minSize) {
+	// oversized requests get a block of their own
+	size_t size = minSize + sizeof(Block) + 16;
+	if (size < blockSize) {
+		size = blockSize;
+	}
+
+	Block* newBlock = (Block*) malloc(size);
+	assert(newBlock);
+	newBlock->next = blocks;
+	newBlock->size = size;
+	newBlock->used = sizeof(Block);
+	blocks = newBlock;
+	blockCount++;
+}
+
+void* MemoryArena::Alloc(size_t size, size_t align) {
+	assert((align & (align - 1)) == 0);
+
+	if (!blocks) {
+		AddBlock(size + align);
+	}
+
+	// align the current position within the block, moving to a new block if it doesn't fit
+	uintptr_t base = (uintptr_t) blocks;
+	uintptr_t cur = (base + blocks->used + align - 1) & ~(uintptr_t) (align - 1);
+	if (cur + size > base + blocks->size) {
+		AddBlock(size + align);
+		base = (uintptr_t) blocks;
+		cur = (base + blocks->used + align - 1) & ~(uintptr_t) (align - 1);
+	}
+
+	blocks->used = cur + size - base;
+	allocCount++;
+	bytesUsed += size;
+
+	return (void*) cur;
+}
+
+const char* MemoryArena::StrDup(const char* str) {
+	size_t length = strlen(str) + 1;
+	char* ret = (char*) Alloc(length, 1);
+	memcpy(ret, str, length);
+	return ret;
+}
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+
+// number of heap allocations seen by the CRT hook since it was installed
+static volatile long heapAllocCount = 0;
+static _CRT_ALLOC_HOOK previousHook = NULL;
+static bool hookInstalled = false;
+
+static int CountingAllocHook(int allocType, void* userData, size_t size, int blockType, long requestNumber,
+	const unsigned char* filename, int lineNumber) {
+	if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC) {
+		InterlockedIncrement(&heapAllocCount);
+	}
+	return previousHook ? previousHook(allocType, userData, size, blockType, requestNumber, filename, lineNumber) : TRUE;
+}
+
+int32_t GetHeapAllocationCount() {
+	// the hook is installed the first time a count is asked for and stays in place from then on
+	if (!hookInstalled) {
+		hookInstalled = true;
+		previousHook = _CrtSetAllocHook(CountingAllocHook);
+	}
+	return (int32_t) heapAllocCount;
+}
+
+#else
+
+int32_t GetHeapAllocationCount() {
+	return -1;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "SpecViz.h"
+#include <new>
+
+// monotonic memory arena. Allocations are carved sequentially out of large blocks and are never freed individually;
+// everything is released in one shot when the arena is destroyed. Used for short lived, allocation heavy work such as
+// parsing a model file
+class MemoryArena {
+protected:
+	// header placed at the start of each block of arena memory
+	struct Block {
+		Block* next;
+		size_t size;
+		size_t used;
+	};
+
+	Block* blocks;			// most recently allocated block (the one currently being carved from)
+	size_t blockSize;		// default size of newly allocated blocks
+
+	// statistics for reporting
+	uint32_t allocCount;
+	uint32_t blockCount;
+	size_t bytesUsed;
+
+	// adds a new block to the arena that can hold at least minSize bytes
+	void AddBlock(size_t minSize);
+
+public:
+	// creates an arena that allocates memory from the system in blocks of the given size
+	MemoryArena(size_t withBlockSize = 1 << 20);
+
+	// frees all memory allocated by the arena
+	virtual ~MemoryArena();
+
+	// allocates size bytes with the given alignment (must be a power of two)
+	void* Alloc(size_t size, size_t align = 16);
+
+	// copies the given string into arena memory
+	const char* StrDup(const char* str);
+
+	// constructs an object of type T in arena memory. The arena will not call its destructor
+	template<class T> T* New() {
+		return new (Alloc(sizeof(T), __alignof(T))) T;
+	}
+
+	// constructs an object of type T in arena memory with a single constructor argument
+	template<class T, class A> T* New(A arg) {
+		return new (Alloc(sizeof(T), __alignof(T))) T(arg);
+	}
+
+	// returns the number of allocations served by the arena
+	uint32_t GetAllocCount() const {
+		return allocCount;
+	}
+
+	// returns the number of blocks the arena requested from the system
+	uint32_t GetBlockCount() const {
+		return blockCount;
+	}
+
+	// returns the total number of bytes handed out by the arena
+	size_t GetBytesUsed() const {
+		return bytesUsed;
+	}
+};
+
+// STL allocator that takes its memory from a MemoryArena, so containers can be used for transient work without
+// touching the heap. Deallocation does nothing; the memory goes away with the arena
+template<class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<class U> struct rebind {
+		typedef ArenaAllocator<U> other;
+	};
+
+	MemoryArena* arena;
+
+	ArenaAllocator(MemoryArena* withArena) : arena(withArena) {
+	}
+
+	template<class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {
+	}
+
+	pointer allocate(size_type n, const void* hint = 0) {
+		return (pointer) arena->Alloc(n * sizeof(T), __alignof(T));
+	}
+
+	void deallocate(pointer p, size_type n) {
+	}
+
+	void construct(pointer p, const T& value) {
+		new ((void*) p) T(value);
+	}
+
+	void destroy(pointer p) {
+		p->~T();
+	}
+
+	size_type max_size() const {
+		return ((size_t) -1) / sizeof(T);
+	}
+
+	pointer address(reference r) const {
+		return &r;
+	}
+
+	const_pointer address(const_reference r) const {
+		return &r;
+	}
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena == b.arena;
+}
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena != b.arena;
+}
+
+// returns a running count of the heap allocations made by the process, or -1 when allocation counting isn't available
+// in this build (only MSVC debug builds can hook the CRT allocator)
+int32_t GetHeapAllocationCount();
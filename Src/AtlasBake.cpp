@@ -0,0 +1,262 @@
+#include "AtlasBake.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+// attempts at packing the charts, shrinking the texel density each time they don't fit
+#define ATLAS_PACK_ATTEMPTS 64
+
+// a group of connected triangles facing the same axis direction, flattened along that axis
+struct AtlasChart {
+	uint32_t axis;					// 0-5 for +X, -X, +Y, -Y, +Z, -Z
+	glm::vec2 boundMin;				// bounds of the flattened chart, in model units
+	glm::vec2 boundMax;
+	std::vector<uint32_t> triangles;
+
+	// placement in the atlas, in texels (including padding)
+	uint32_t x, y;
+	uint32_t width, height;
+	bool rotated;					// flattened x runs along the atlas v direction
+};
+
+// the flattened position of a mesh position along the given axis direction
+static glm::vec2 FlattenPosition(const glm::vec3& position, uint32_t axis) {
+	switch (axis / 2) {
+		case 0: return glm::vec2(position.y, position.z);
+		case 1: return glm::vec2(position.x, position.z);
+		default: return glm::vec2(position.x, position.y);
+	}
+}
+
+static uint32_t FindRoot(std::vector<uint32_t>& parents, uint32_t index) {
+	while (parents[index] != index) {
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+	return index;
+}
+
+// places every chart on shelves of decreasing height at the given texels per model unit, returning false if they
+// overflow the atlas
+static bool PackCharts(std::vector<AtlasChart>& charts, float scale, uint32_t atlasSize) {
+	for (uint32_t i = 0; i < charts.size(); i++) {
+		AtlasChart& chart = charts[i];
+		glm::vec2 size = (chart.boundMax - chart.boundMin) * scale;
+		chart.width = (uint32_t) ceilf(size.x) + 1 + ATLAS_CHART_PADDING * 2;
+		chart.height = (uint32_t) ceilf(size.y) + 1 + ATLAS_CHART_PADDING * 2;
+
+		// lying charts down flat makes for fewer, fuller shelves
+		chart.rotated = chart.height > chart.width;
+		if (chart.rotated) {
+			std::swap(chart.width, chart.height);
+		}
+		if (chart.width > atlasSize) {
+			return false;
+		}
+	}
+
+	std::vector<uint32_t> order(charts.size());
+	for (uint32_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return charts[a].height > charts[b].height;
+	});
+
+	uint32_t x = 0, y = 0, shelfHeight = 0;
+	for (uint32_t i = 0; i < order.size(); i++) {
+		AtlasChart& chart = charts[order[i]];
+		if (x + chart.width > atlasSize) {
+			y += shelfHeight;
+			x = 0;
+			shelfHeight = 0;
+		}
+		if (y + chart.height > atlasSize) {
+			return false;
+		}
+		chart.x = x;
+		chart.y = y;
+		x += chart.width;
+		shelfHeight = maxi(shelfHeight, chart.height);
+	}
+
+	return true;
+}
+
+bool BuildAtlasParameterization(const PlyModelData& model, uint32_t atlasSize, PlyModelData& into) {
+	PROFILE_SCOPE("BuildAtlasParameterization");
+
+	const std::vector<PlyVertex>& vertices = model.vertices;
+	const std::vector<uint32_t>& indices = model.indices;
+	uint32_t numTriangles = indices.size() / 3;
+
+	// each triangle goes to the axis direction its face normal is closest to
+	std::vector<uint8_t> triangleAxis(numTriangles);
+	ParallelFor(numTriangles, 16384, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t t = begin; t < end; t++) {
+			const glm::vec3& p0 = vertices[indices[t * 3]].position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			glm::vec3 amount = glm::abs(normal);
+			uint32_t major = amount.x >= amount.y && amount.x >= amount.z ? 0 : (amount.y >= amount.z ? 1 : 2);
+			triangleAxis[t] = (uint8_t) (major * 2 + (normal[major] < 0.0f ? 1 : 0));
+		}
+	});
+
+	// triangles sharing an edge and an axis direction join the same chart. Edges are found by sorting them so that
+	// matching edges end up next to each other
+	PROFILE_BEGIN(chartProfile, "find charts");
+	std::vector<std::pair<uint64_t, uint32_t> > edges(numTriangles * 3);
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t a = indices[t * 3 + k];
+			uint32_t b = indices[t * 3 + (k + 1) % 3];
+			edges[t * 3 + k] = std::make_pair(((uint64_t) mini(a, b) << 32) | (uint64_t) maxi(a, b), t);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<uint32_t> parents(numTriangles);
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		parents[t] = t;
+	}
+	for (uint32_t i = 1; i < edges.size(); i++) {
+		if (edges[i].first != edges[i - 1].first) {
+			continue;
+		}
+		uint32_t a = edges[i - 1].second;
+		uint32_t b = edges[i].second;
+		if (triangleAxis[a] == triangleAxis[b]) {
+			parents[FindRoot(parents, a)] = FindRoot(parents, b);
+		}
+	}
+
+	std::vector<AtlasChart> charts;
+	std::vector<uint32_t> rootChart(numTriangles, 0xFFFFFFFF);
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		uint32_t root = FindRoot(parents, t);
+		if (rootChart[root] == 0xFFFFFFFF) {
+			rootChart[root] = charts.size();
+			charts.push_back(AtlasChart());
+			charts.back().axis = triangleAxis[t];
+			charts.back().boundMin = glm::vec2(1.0E+30F);
+			charts.back().boundMax = glm::vec2(-1.0E+30F);
+		}
+
+		AtlasChart& chart = charts[rootChart[root]];
+		chart.triangles.push_back(t);
+		for (uint32_t k = 0; k < 3; k++) {
+			glm::vec2 flat = FlattenPosition(vertices[indices[t * 3 + k]].position, chart.axis);
+			chart.boundMin = glm::min(chart.boundMin, flat);
+			chart.boundMax = glm::max(chart.boundMax, flat);
+		}
+	}
+	PROFILE_END(chartProfile);
+
+	// start from the density that would fill most of the atlas if the charts packed perfectly
+	PROFILE_BEGIN(packProfile, "pack charts");
+	double chartArea = 0.0;
+	for (uint32_t i = 0; i < charts.size(); i++) {
+		glm::vec2 size = charts[i].boundMax - charts[i].boundMin;
+		chartArea += (double) size.x * size.y;
+	}
+	float scale = (float) sqrt((double) atlasSize * atlasSize * 0.8 / glm::max(chartArea, 1.0E-12));
+	bool packed = false;
+	for (uint32_t attempt = 0; attempt < ATLAS_PACK_ATTEMPTS && !packed; attempt++) {
+		packed = PackCharts(charts, scale, atlasSize);
+		if (!packed) {
+			scale *= 0.9f;
+		}
+	}
+	PROFILE_END(packProfile);
+
+	if (!packed) {
+		Log("Unable to pack %d charts into a %dx%d atlas", (uint32_t) charts.size(), atlasSize, atlasSize);
+		return false;
+	}
+
+	// give each chart its own copy of the vertices it uses, keeping the triangles in their original order
+	into.vertices.clear();
+	into.indices.resize(indices.size());
+	std::vector<uint32_t> vertexChart(vertices.size(), 0xFFFFFFFF);
+	std::vector<uint32_t> vertexCopy(vertices.size(), 0);
+	for (uint32_t c = 0; c < charts.size(); c++) {
+		const AtlasChart& chart = charts[c];
+		for (uint32_t i = 0; i < chart.triangles.size(); i++) {
+			uint32_t t = chart.triangles[i];
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t v = indices[t * 3 + k];
+				if (vertexChart[v] != c) {
+					glm::vec2 local = (FlattenPosition(vertices[v].position, chart.axis) - chart.boundMin) * scale;
+					if (chart.rotated) {
+						std::swap(local.x, local.y);
+					}
+
+					PlyVertex copy = vertices[v];
+					copy.uv = (glm::vec2(chart.x, chart.y) + (float) ATLAS_CHART_PADDING + local) / (float) atlasSize;
+					vertexChart[v] = c;
+					vertexCopy[v] = into.vertices.size();
+					into.vertices.push_back(copy);
+				}
+				into.indices[t * 3 + k] = vertexCopy[v];
+			}
+		}
+	}
+
+	into.boundMin = model.boundMin;
+	into.boundMax = model.boundMax;
+	into.centerOffset = model.centerOffset;
+
+	Log("Parameterized %d triangles as %d charts at %.2f texels per unit (%d vertices, from %d)", numTriangles,
+		(uint32_t) charts.size(), scale, (uint32_t) into.vertices.size(), (uint32_t) vertices.size());
+	return true;
+}
+
+void DilateAtlas(uint8_t* rgba, uint32_t width, uint32_t height, uint32_t passes) {
+	PROFILE_SCOPE("DilateAtlas");
+
+	std::vector<uint8_t> source(width * height * 4);
+	for (uint32_t pass = 0; pass < passes; pass++) {
+		memcpy(&source[0], rgba, source.size());
+
+		ParallelFor(height, 64, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t y = begin; y < end; y++) {
+				for (uint32_t x = 0; x < width; x++) {
+					uint8_t* texel = rgba + (y * width + x) * 4;
+					if (texel[3]) {
+						continue;
+					}
+
+					// average of the covered texels around this one
+					uint32_t sum[3] = { 0, 0, 0 };
+					uint32_t count = 0;
+					for (int32_t dy = -1; dy <= 1; dy++) {
+						for (int32_t dx = -1; dx <= 1; dx++) {
+							int32_t nx = (int32_t) x + dx;
+							int32_t ny = (int32_t) y + dy;
+							if (nx < 0 || ny < 0 || nx >= (int32_t) width || ny >= (int32_t) height) {
+								continue;
+							}
+							const uint8_t* neighbour = &source[(ny * width + nx) * 4];
+							if (neighbour[3]) {
+								sum[0] += neighbour[0];
+								sum[1] += neighbour[1];
+								sum[2] += neighbour[2];
+								count++;
+							}
+						}
+					}
+
+					if (count) {
+						texel[0] = (uint8_t) (sum[0] / count);
+						texel[1] = (uint8_t) (sum[1] / count);
+						texel[2] = (uint8_t) (sum[2] / count);
+						texel[3] = 255;
+					}
+				}
+			}
+		});
+	}
+}
\ No newline at end of file
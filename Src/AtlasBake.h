@@ -0,0 +1,19 @@
+#pragma once
+
+#include "PlyModel.h"
+
+// width and height of baked atlases in texels
+#define ATLAS_SIZE 4096
+
+// empty texels kept around each chart, which dilation fills so that filtering and mips don't bleed between charts
+#define ATLAS_CHART_PADDING 4
+
+// gives the mesh a UV parameterization over a square atlas of the given size. Triangles are grouped into charts of
+// connected triangles facing the same way along one of the six axis directions, each chart is projected flat along
+// its axis, and the charts are shelf packed at a uniform texel density (as large as will fit). Vertices on chart
+// borders are split, but triangles keep their order. Returns false if the charts can't be packed
+bool BuildAtlasParameterization(const PlyModelData& model, uint32_t atlasSize, PlyModelData& into);
+
+// fills the uncovered texels (zero alpha) of an RGBA8 atlas out from the covered texels around them, one texel per
+// pass, so seams and the padding between charts take on the color of the nearest chart
+void DilateAtlas(uint8_t* rgba, uint32_t width, uint32_t height, uint32_t passes);
@@ -0,0 +1,692 @@
+#include "BVH.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <emmintrin.h>
+
+// number of bins used when evaluating split candidates along each axis
+#define SAH_BINS 16
+
+// nodes with at most this many triangles may become leaves when splitting them doesn't pay off
+#define MAX_LEAF_SIZE 8
+
+// nodes with at least this many triangles have their children built on separate threads, and bin their triangles in
+// parallel
+#define PARALLEL_BUILD_SIZE 65536
+
+// entries in the fixed traversal stacks. Traversal never holds more than one node per level of the tree (plus the one
+// being popped), so the build stops splitting before leaves get any deeper than the stack allows
+#define TRAVERSAL_STACK_SIZE 64
+#define MAX_BUILD_DEPTH (TRAVERSAL_STACK_SIZE - 1)
+
+// bounding box helper used while building
+struct BuildBounds {
+	glm::vec3 boundMin;
+	glm::vec3 boundMax;
+
+	BuildBounds() : boundMin(1.0E+30F), boundMax(-1.0E+30F) {
+	}
+
+	void Grow(const glm::vec3& withMin, const glm::vec3& withMax) {
+		boundMin = glm::min(boundMin, withMin);
+		boundMax = glm::max(boundMax, withMax);
+	}
+
+	float Area() const {
+		glm::vec3 e = boundMax - boundMin;
+		if (e.x < 0.0f) {
+			return 0.0f;
+		}
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+};
+
+// a bin of triangles during SAH evaluation
+struct SAHBin {
+	BuildBounds bounds;
+	uint32_t count;
+
+	SAHBin() : count(0) {
+	}
+};
+
+struct BVH::BuildData {
+	std::vector<glm::vec3> centroids;
+	std::vector<glm::vec3> triMin;
+	std::vector<glm::vec3> triMax;
+	std::vector<uint32_t> order;		// triangle indices, partitioned in place as the tree is built
+	std::atomic<uint32_t> nodesUsed;
+	uint32_t parallelDepth;				// depth up to which child subtrees are built on their own threads
+};
+
+// bins the triangles order[first, first+count) along all three axes
+static void BinTriangles(const std::vector<uint32_t>& order, const std::vector<glm::vec3>& centroids,
+	const std::vector<glm::vec3>& triMin, const std::vector<glm::vec3>& triMax, uint32_t first, uint32_t count,
+	const glm::vec3& centroidMin, const glm::vec3& binScale, SAHBin (*bins)[SAH_BINS]) {
+	for (uint32_t i = first; i < first + count; i++) {
+		uint32_t tri = order[i];
+		for (uint32_t a = 0; a < 3; a++) {
+			int32_t b = (int32_t) ((centroids[tri][a] - centroidMin[a]) * binScale[a]);
+			b = mini(maxi(b, 0), SAH_BINS - 1);
+			bins[a][b].count++;
+			bins[a][b].bounds.Grow(triMin[tri], triMax[tri]);
+		}
+	}
+}
+
+void BVH::Subdivide(BuildData& build, uint32_t nodeIndex, uint32_t depth) {
+	Node& node = nodes[nodeIndex];
+	uint32_t first = node.first;
+	uint32_t count = node.count;
+	if (count <= 2 || depth >= MAX_BUILD_DEPTH) {
+		return;
+	}
+
+	// find the centroid bounds, which the bins are spread over
+	glm::vec3 centroidMin(1.0E+30F), centroidMax(-1.0E+30F);
+	for (uint32_t i = first; i < first + count; i++) {
+		centroidMin = glm::min(centroidMin, build.centroids[build.order[i]]);
+		centroidMax = glm::max(centroidMax, build.centroids[build.order[i]]);
+	}
+	glm::vec3 extent = centroidMax - centroidMin;
+	glm::vec3 binScale;
+	for (uint32_t a = 0; a < 3; a++) {
+		binScale[a] = extent[a] > 1.0E-12F ? SAH_BINS / extent[a] * 0.9999f : 0.0f;
+	}
+
+	// bin the triangles, splitting the work over all cores for large nodes
+	SAHBin bins[3][SAH_BINS];
+	if (count >= PARALLEL_BUILD_SIZE) {
+		uint32_t grain = PARALLEL_BUILD_SIZE / 4;
+		uint32_t numChunks = (count + grain - 1) / grain;
+		std::vector<SAHBin> chunkBins(numChunks * 3 * SAH_BINS);
+		ParallelFor(count, grain, [&](uint32_t begin, uint32_t end) {
+			SAHBin (*into)[SAH_BINS] = (SAHBin (*)[SAH_BINS]) &chunkBins[(begin / grain) * 3 * SAH_BINS];
+			BinTriangles(build.order, build.centroids, build.triMin, build.triMax, first + begin, end - begin, centroidMin, binScale, into);
+		});
+		for (uint32_t c = 0; c < numChunks; c++) {
+			for (uint32_t a = 0; a < 3; a++) {
+				for (uint32_t b = 0; b < SAH_BINS; b++) {
+					const SAHBin& from = chunkBins[(c * 3 + a) * SAH_BINS + b];
+					bins[a][b].count += from.count;
+					bins[a][b].bounds.Grow(from.bounds.boundMin, from.bounds.boundMax);
+				}
+			}
+		}
+	} else {
+		BinTriangles(build.order, build.centroids, build.triMin, build.triMax, first, count, centroidMin, binScale, bins);
+	}
+
+	// evaluate the SAH cost of splitting after each bin on each axis
+	float bestCost = 1.0E+30F;
+	int32_t bestAxis = -1;
+	uint32_t bestSplit = 0;
+	BuildBounds bestLeft, bestRight;
+	for (uint32_t a = 0; a < 3; a++) {
+		if (binScale[a] == 0.0f) {
+			continue;
+		}
+
+		BuildBounds leftBounds[SAH_BINS - 1], rightBounds[SAH_BINS - 1];
+		uint32_t leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+		BuildBounds left, right;
+		uint32_t lc = 0, rc = 0;
+		for (uint32_t b = 0; b < SAH_BINS - 1; b++) {
+			left.Grow(bins[a][b].bounds.boundMin, bins[a][b].bounds.boundMax);
+			lc += bins[a][b].count;
+			leftBounds[b] = left;
+			leftCount[b] = lc;
+
+			uint32_t rb = SAH_BINS - 1 - b;
+			right.Grow(bins[a][rb].bounds.boundMin, bins[a][rb].bounds.boundMax);
+			rc += bins[a][rb].count;
+			rightBounds[rb - 1] = right;
+			rightCount[rb - 1] = rc;
+		}
+
+		for (uint32_t b = 0; b < SAH_BINS - 1; b++) {
+			if (!leftCount[b] || !rightCount[b]) {
+				continue;
+			}
+			float cost = leftCount[b] * leftBounds[b].Area() + rightCount[b] * rightBounds[b].Area();
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = a;
+				bestSplit = b;
+				bestLeft = leftBounds[b];
+				bestRight = rightBounds[b];
+			}
+		}
+	}
+
+	// stay a leaf when splitting costs more than intersecting every triangle (as long as the leaf is small enough)
+	BuildBounds nodeBounds;
+	nodeBounds.Grow(node.boundMin, node.boundMax);
+	if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || bestCost >= count * nodeBounds.Area())) {
+		return;
+	}
+
+	uint32_t leftCount;
+	if (bestAxis >= 0) {
+		uint32_t* begin = &build.order[first];
+		uint32_t* split = std::partition(begin, begin + count, [&](uint32_t tri) {
+			int32_t b = (int32_t) ((build.centroids[tri][bestAxis] - centroidMin[bestAxis]) * binScale[bestAxis]);
+			return mini(maxi(b, 0), SAH_BINS - 1) <= (int32_t) bestSplit;
+		});
+		leftCount = split - begin;
+	} else {
+		// every centroid is in the same place, so just split the triangles in half
+		leftCount = count / 2;
+		for (uint32_t i = first; i < first + count; i++) {
+			uint32_t tri = build.order[i];
+			if (i < first + leftCount) {
+				bestLeft.Grow(build.triMin[tri], build.triMax[tri]);
+			} else {
+				bestRight.Grow(build.triMin[tri], build.triMax[tri]);
+			}
+		}
+	}
+
+	// create the two children and turn this node into an interior node
+	uint32_t leftIndex = build.nodesUsed.fetch_add(2);
+	Node& leftNode = nodes[leftIndex];
+	Node& rightNode = nodes[leftIndex + 1];
+	leftNode.boundMin = bestLeft.boundMin;
+	leftNode.boundMax = bestLeft.boundMax;
+	leftNode.first = first;
+	leftNode.count = leftCount;
+	rightNode.boundMin = bestRight.boundMin;
+	rightNode.boundMax = bestRight.boundMax;
+	rightNode.first = first + leftCount;
+	rightNode.count = count - leftCount;
+	node.first = leftIndex;
+	node.count = 0;
+
+	if (depth < build.parallelDepth && count >= PARALLEL_BUILD_SIZE) {
+		std::thread leftThread([&build, this, leftIndex, depth]() {
+			Subdivide(build, leftIndex, depth + 1);
+		});
+		Subdivide(build, leftIndex + 1, depth + 1);
+		leftThread.join();
+	} else {
+		Subdivide(build, leftIndex, depth + 1);
+		Subdivide(build, leftIndex + 1, depth + 1);
+	}
+}
+
+BVH::BVH(const std::vector<PlyVertex>& vertices, const std::vector<uint32_t>& indices) : nodeCount(0) {
+	PROFILE_SCOPE("build BVH");
+	double startTime = GetTimeSeconds();
+
+	uint32_t numTriangles = indices.size() / 3;
+	BuildData build;
+	build.centroids.resize(numTriangles);
+	build.triMin.resize(numTriangles);
+	build.triMax.resize(numTriangles);
+	build.order.resize(numTriangles);
+	build.nodesUsed = 1;
+
+	// allow enough levels of threads to cover every core
+	build.parallelDepth = 0;
+	while ((1u << build.parallelDepth) < GetWorkerCount()) {
+		build.parallelDepth++;
+	}
+
+	// per triangle bounds and centroids
+	ParallelFor(numTriangles, 16384, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			const glm::vec3& a = vertices[indices[i * 3]].position;
+			const glm::vec3& b = vertices[indices[i * 3 + 1]].position;
+			const glm::vec3& c = vertices[indices[i * 3 + 2]].position;
+			build.triMin[i] = glm::min(a, glm::min(b, c));
+			build.triMax[i] = glm::max(a, glm::max(b, c));
+			build.centroids[i] = (build.triMin[i] + build.triMax[i]) * 0.5f;
+			build.order[i] = i;
+		}
+	});
+
+	// a binary tree over N leaves of at least one triangle can't have more than 2N-1 nodes
+	nodes.resize(numTriangles ? numTriangles * 2 - 1 : 1);
+	Node& root = nodes[0];
+	BuildBounds rootBounds;
+	for (uint32_t i = 0; i < numTriangles; i++) {
+		rootBounds.Grow(build.triMin[i], build.triMax[i]);
+	}
+	root.boundMin = rootBounds.boundMin;
+	root.boundMax = rootBounds.boundMax;
+	root.first = 0;
+	root.count = numTriangles;
+
+	Subdivide(build, 0, 0);
+
+	nodeCount = build.nodesUsed;
+	nodes.resize(nodeCount);
+
+	// store the triangles in leaf order in the layout used for intersection
+	triangles.resize(numTriangles);
+	ParallelFor(numTriangles, 16384, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			uint32_t tri = build.order[i];
+			const glm::vec3& a = vertices[indices[tri * 3]].position;
+			const glm::vec3& b = vertices[indices[tri * 3 + 1]].position;
+			const glm::vec3& c = vertices[indices[tri * 3 + 2]].position;
+			triangles[i].v0 = a;
+			triangles[i].edge1 = b - a;
+			triangles[i].edge2 = c - a;
+			triangles[i].index = tri;
+		}
+	});
+
+	buildTime = (float) (GetTimeSeconds() - startTime);
+}
+
+// returns the distance the ray enters the node's bounds, or 1e30 if it misses them
+static inline float IntersectBounds(const glm::vec3& boundMin, const glm::vec3& boundMax, const glm::vec3& origin,
+	const glm::vec3& invDir, float tMin, float tMax) {
+	glm::vec3 t1 = (boundMin - origin) * invDir;
+	glm::vec3 t2 = (boundMax - origin) * invDir;
+	glm::vec3 tNear = glm::min(t1, t2);
+	glm::vec3 tFar = glm::max(t1, t2);
+	float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+	float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+	return enter <= exit ? enter : 1.0E+30F;
+}
+
+// avoids infinities (and the NaNs they cause) in the slab test for axis aligned rays
+static inline glm::vec3 SafeInverse(const glm::vec3& dir) {
+	glm::vec3 ret;
+	for (uint32_t a = 0; a < 3; a++) {
+		float d = fabs(dir[a]) > 1.0E-20F ? dir[a] : (dir[a] < 0.0f ? -1.0E-20F : 1.0E-20F);
+		ret[a] = 1.0f / d;
+	}
+	return ret;
+}
+
+bool BVH::Intersect(const Ray& ray, RayHit& hit) const {
+	if (triangles.empty()) {
+		return false;
+	}
+
+	glm::vec3 invDir = SafeInverse(ray.direction);
+	float tMax = ray.tMax;
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	uint32_t stackSize = 0;
+	uint32_t cur = 0;
+
+	if (IntersectBounds(nodes[0].boundMin, nodes[0].boundMax, ray.origin, invDir, ray.tMin, tMax) >= 1.0E+30F) {
+		return false;
+	}
+
+	while (true) {
+		const Node& node = nodes[cur];
+		if (node.count) {
+			// Moller-Trumbore against each triangle in the leaf
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				const Triangle& tri = triangles[i];
+				glm::vec3 p = glm::cross(ray.direction, tri.edge2);
+				float det = glm::dot(tri.edge1, p);
+				if (fabs(det) < 1.0E-20F) {
+					continue;
+				}
+				float invDet = 1.0f / det;
+				glm::vec3 s = ray.origin - tri.v0;
+				float u = glm::dot(s, p) * invDet;
+				if (u < 0.0f || u > 1.0f) {
+					continue;
+				}
+				glm::vec3 q = glm::cross(s, tri.edge1);
+				float v = glm::dot(ray.direction, q) * invDet;
+				if (v < 0.0f || u + v > 1.0f) {
+					continue;
+				}
+				float t = glm::dot(tri.edge2, q) * invDet;
+				if (t > ray.tMin && t < tMax) {
+					tMax = t;
+					hit.t = t;
+					hit.u = u;
+					hit.v = v;
+					hit.triangle = tri.index;
+				}
+			}
+		} else {
+			// visit the nearer child first, saving the other for later
+			uint32_t nearChild = node.first;
+			uint32_t farChild = node.first + 1;
+			float nearDist = IntersectBounds(nodes[nearChild].boundMin, nodes[nearChild].boundMax, ray.origin, invDir, ray.tMin, tMax);
+			float farDist = IntersectBounds(nodes[farChild].boundMin, nodes[farChild].boundMax, ray.origin, invDir, ray.tMin, tMax);
+			if (farDist < nearDist) {
+				std::swap(nearChild, farChild);
+				std::swap(nearDist, farDist);
+			}
+			if (nearDist < 1.0E+30F) {
+				if (farDist < 1.0E+30F) {
+					stack[stackSize++] = farChild;
+				}
+				cur = nearChild;
+				continue;
+			}
+		}
+
+		// pop the next node that is still closer than the closest hit
+		bool found = false;
+		while (stackSize) {
+			cur = stack[--stackSize];
+			if (IntersectBounds(nodes[cur].boundMin, nodes[cur].boundMax, ray.origin, invDir, ray.tMin, tMax) < 1.0E+30F) {
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			break;
+		}
+	}
+
+	return hit.triangle != RayHit::NO_HIT;
+}
+
+bool BVH::Occluded(const Ray& ray) const {
+	if (triangles.empty()) {
+		return false;
+	}
+
+	glm::vec3 invDir = SafeInverse(ray.direction);
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize) {
+		const Node& node = nodes[stack[--stackSize]];
+		if (IntersectBounds(node.boundMin, node.boundMax, ray.origin, invDir, ray.tMin, ray.tMax) >= 1.0E+30F) {
+			continue;
+		}
+
+		if (!node.count) {
+			stack[stackSize++] = node.first + 1;
+			stack[stackSize++] = node.first;
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++) {
+			const Triangle& tri = triangles[i];
+			glm::vec3 p = glm::cross(ray.direction, tri.edge2);
+			float det = glm::dot(tri.edge1, p);
+			if (fabs(det) < 1.0E-20F) {
+				continue;
+			}
+			float invDet = 1.0f / det;
+			glm::vec3 s = ray.origin - tri.v0;
+			float u = glm::dot(s, p) * invDet;
+			if (u < 0.0f || u > 1.0f) {
+				continue;
+			}
+			glm::vec3 q = glm::cross(s, tri.edge1);
+			float v = glm::dot(ray.direction, q) * invDet;
+			if (v < 0.0f || u + v > 1.0f) {
+				continue;
+			}
+			float t = glm::dot(tri.edge2, q) * invDet;
+			if (t > ray.tMin && t < ray.tMax) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void BVH::Intersect4(const Ray* rays, RayHit* hits) const {
+	for (uint32_t r = 0; r < 4; r++) {
+		hits[r] = RayHit();
+	}
+	if (triangles.empty()) {
+		return;
+	}
+
+	// load the packet as structure of arrays
+	__m128 ox = _mm_setr_ps(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x);
+	__m128 oy = _mm_setr_ps(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y);
+	__m128 oz = _mm_setr_ps(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z);
+	__m128 dx = _mm_setr_ps(rays[0].direction.x, rays[1].direction.x, rays[2].direction.x, rays[3].direction.x);
+	__m128 dy = _mm_setr_ps(rays[0].direction.y, rays[1].direction.y, rays[2].direction.y, rays[3].direction.y);
+	__m128 dz = _mm_setr_ps(rays[0].direction.z, rays[1].direction.z, rays[2].direction.z, rays[3].direction.z);
+	glm::vec3 inv[4];
+	for (uint32_t r = 0; r < 4; r++) {
+		inv[r] = SafeInverse(rays[r].direction);
+	}
+	__m128 ix = _mm_setr_ps(inv[0].x, inv[1].x, inv[2].x, inv[3].x);
+	__m128 iy = _mm_setr_ps(inv[0].y, inv[1].y, inv[2].y, inv[3].y);
+	__m128 iz = _mm_setr_ps(inv[0].z, inv[1].z, inv[2].z, inv[3].z);
+	__m128 tMin = _mm_setr_ps(rays[0].tMin, rays[1].tMin, rays[2].tMin, rays[3].tMin);
+	__m128 tMax = _mm_setr_ps(rays[0].tMax, rays[1].tMax, rays[2].tMax, rays[3].tMax);
+	__m128 hitU = _mm_setzero_ps();
+	__m128 hitV = _mm_setzero_ps();
+	__m128i hitTri = _mm_set1_epi32((int) RayHit::NO_HIT);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 epsilon = _mm_set1_ps(1.0E-20F);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize) {
+		const Node& node = nodes[stack[--stackSize]];
+
+		// slab test the node against all four rays, skipping it if none of them hit
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMin.x), ox), ix);
+		__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMax.x), ox), ix);
+		__m128 enter = _mm_max_ps(_mm_min_ps(t1, t2), tMin);
+		__m128 exit = _mm_min_ps(_mm_max_ps(t1, t2), tMax);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMin.y), oy), iy);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMax.y), oy), iy);
+		enter = _mm_max_ps(enter, _mm_min_ps(t1, t2));
+		exit = _mm_min_ps(exit, _mm_max_ps(t1, t2));
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMin.z), oz), iz);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMax.z), oz), iz);
+		enter = _mm_max_ps(enter, _mm_min_ps(t1, t2));
+		exit = _mm_min_ps(exit, _mm_max_ps(t1, t2));
+		if (!_mm_movemask_ps(_mm_cmple_ps(enter, exit))) {
+			continue;
+		}
+
+		if (!node.count) {
+			// push the child farther along the first ray's direction first so the nearer one is visited first
+			glm::vec3 leftCenter = nodes[node.first].boundMin + nodes[node.first].boundMax;
+			glm::vec3 rightCenter = nodes[node.first + 1].boundMin + nodes[node.first + 1].boundMax;
+			if (glm::dot(leftCenter - rightCenter, rays[0].direction) > 0.0f) {
+				stack[stackSize++] = node.first;
+				stack[stackSize++] = node.first + 1;
+			} else {
+				stack[stackSize++] = node.first + 1;
+				stack[stackSize++] = node.first;
+			}
+			continue;
+		}
+
+		// Moller-Trumbore for each triangle against all four rays
+		for (uint32_t i = node.first; i < node.first + node.count; i++) {
+			const Triangle& tri = triangles[i];
+			__m128 e1x = _mm_set1_ps(tri.edge1.x), e1y = _mm_set1_ps(tri.edge1.y), e1z = _mm_set1_ps(tri.edge1.z);
+			__m128 e2x = _mm_set1_ps(tri.edge2.x), e2y = _mm_set1_ps(tri.edge2.y), e2z = _mm_set1_ps(tri.edge2.z);
+
+			// p = dir x edge2
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 valid = _mm_cmpgt_ps(_mm_and_ps(det, absMask), epsilon);
+			__m128 invDet = _mm_div_ps(one, det);
+
+			// s = origin - v0
+			__m128 sx = _mm_sub_ps(ox, _mm_set1_ps(tri.v0.x));
+			__m128 sy = _mm_sub_ps(oy, _mm_set1_ps(tri.v0.y));
+			__m128 sz = _mm_sub_ps(oz, _mm_set1_ps(tri.v0.z));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+			// q = s x edge1
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+			valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, tMin));
+			valid = _mm_and_ps(valid, _mm_cmplt_ps(t, tMax));
+			if (!_mm_movemask_ps(valid)) {
+				continue;
+			}
+
+			// keep the closer hits
+			tMax = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, tMax));
+			hitU = _mm_or_ps(_mm_and_ps(valid, u), _mm_andnot_ps(valid, hitU));
+			hitV = _mm_or_ps(_mm_and_ps(valid, v), _mm_andnot_ps(valid, hitV));
+			__m128i validInt = _mm_castps_si128(valid);
+			hitTri = _mm_or_si128(_mm_and_si128(validInt, _mm_set1_epi32((int) tri.index)), _mm_andnot_si128(validInt, hitTri));
+		}
+	}
+
+	// write the results back out
+	float tOut[4], uOut[4], vOut[4];
+	uint32_t triOut[4];
+	_mm_storeu_ps(tOut, tMax);
+	_mm_storeu_ps(uOut, hitU);
+	_mm_storeu_ps(vOut, hitV);
+	_mm_storeu_si128((__m128i*) triOut, hitTri);
+	for (uint32_t r = 0; r < 4; r++) {
+		hits[r].triangle = triOut[r];
+		if (triOut[r] != RayHit::NO_HIT) {
+			hits[r].t = tOut[r];
+			hits[r].u = uOut[r];
+			hits[r].v = vOut[r];
+		}
+	}
+}
+
+Ray BVH::GetScreenRay(const glm::mat4& viewProj, float x, float y) {
+	// unproject a point on the near plane and one further in (the far plane may be at infinity)
+	glm::mat4 inv = glm::inverse(viewProj);
+	glm::vec4 nearPoint = inv * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inv * glm::vec4(x, y, 0.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 through = glm::vec3(farPoint) / farPoint.w;
+
+	return Ray(origin, glm::normalize(through - origin));
+}
+
+void BVH::RenderDepth(const glm::mat4& viewProj, uint32_t width, uint32_t height, float* depth) const {
+	glm::mat4 inv = glm::inverse(viewProj);
+
+	// each task renders rows of 2x2 pixel packets
+	uint32_t packetRows = (height + 1) / 2;
+	ParallelFor(packetRows, 4, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t py = begin; py < end; py++) {
+			for (uint32_t px = 0; px < width; px += 2) {
+				Ray rays[4];
+				RayHit hits[4];
+				for (uint32_t r = 0; r < 4; r++) {
+					uint32_t x = mini(px + (r & 1), width - 1);
+					uint32_t y = mini(py * 2 + (r >> 1), height - 1);
+					float ndcX = (x + 0.5f) / width * 2.0f - 1.0f;
+					float ndcY = (y + 0.5f) / height * 2.0f - 1.0f;
+					glm::vec4 nearPoint = inv * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+					glm::vec4 farPoint = inv * glm::vec4(ndcX, ndcY, 0.0f, 1.0f);
+					rays[r].origin = glm::vec3(nearPoint) / nearPoint.w;
+					rays[r].direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - rays[r].origin);
+				}
+				Intersect4(rays, hits);
+				for (uint32_t r = 0; r < 4; r++) {
+					uint32_t x = px + (r & 1);
+					uint32_t y = py * 2 + (r >> 1);
+					if (x < width && y < height) {
+						depth[y * width + x] = hits[r].triangle != RayHit::NO_HIT ? hits[r].t : -1.0f;
+					}
+				}
+			}
+		}
+	});
+}
+
+void BenchmarkBVH(const char* modelFile) {
+	PlyModelData data;
+	if (!PlyModel::Load(modelFile, data)) {
+		return;
+	}
+
+	BVH bvh(data.vertices, data.indices);
+	Log("BVH over %d triangles: %d nodes built in %.1f ms on %d threads", (uint32_t) (data.indices.size() / 3),
+		bvh.GetNodeCount(), bvh.GetBuildTime() * 1000.0f, GetWorkerCount());
+
+	// view the model the way the viewers do by default
+	const float fieldOfView = 30.0f;
+	glm::vec3 scale = data.boundMax - data.boundMin;
+	float cameraDistance = glm::length(scale) / 1.404f * 90.0f / fieldOfView;
+	glm::mat4 projMatrix = glm::infinitePerspective(fieldOfView * glm::pi<float>() / 180.0f, 1.0f, 0.01f);
+	glm::mat4 viewMatrix = glm::lookAt(glm::vec3(cameraDistance, 0.0f, 0.0f), glm::vec3(0,0,0), glm::vec3(0,1,0));
+	glm::mat4 viewProj = projMatrix * viewMatrix;
+
+	const uint32_t width = 1024;
+	const uint32_t height = 1024;
+	std::vector<float> depth(width * height);
+
+	// packet traversal
+	double startTime = GetTimeSeconds();
+	bvh.RenderDepth(viewProj, width, height, &depth[0]);
+	double packetTime = GetTimeSeconds() - startTime;
+
+	uint32_t numHits = 0;
+	for (uint32_t i = 0; i < width * height; i++) {
+		if (depth[i] >= 0.0f) {
+			numHits++;
+		}
+	}
+
+	// single ray traversal of the same rays
+	startTime = GetTimeSeconds();
+	ParallelFor(height, 4, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t y = begin; y < end; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				RayHit hit;
+				Ray ray = BVH::GetScreenRay(viewProj, (x + 0.5f) / width * 2.0f - 1.0f, (y + 0.5f) / height * 2.0f - 1.0f);
+				bvh.Intersect(ray, hit);
+			}
+		}
+	});
+	double singleTime = GetTimeSeconds() - startTime;
+
+	// shadow style occlusion rays from the hit points back to the camera
+	startTime = GetTimeSeconds();
+	std::atomic<uint32_t> numOccluded(0);
+	ParallelFor(height, 4, [&](uint32_t begin, uint32_t end) {
+		uint32_t occluded = 0;
+		for (uint32_t y = begin; y < end; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				float d = depth[y * width + x];
+				if (d < 0.0f) {
+					continue;
+				}
+				Ray ray = BVH::GetScreenRay(viewProj, (x + 0.5f) / width * 2.0f - 1.0f, (y + 0.5f) / height * 2.0f - 1.0f);
+				Ray back(ray.origin + ray.direction * d, -ray.direction);
+				back.tMin = d * 1.0E-4F;
+				back.tMax = d;
+				if (bvh.Occluded(back)) {
+					occluded++;
+				}
+			}
+		}
+		numOccluded += occluded;
+	});
+	double occludedTime = GetTimeSeconds() - startTime;
+
+	float numRays = (float) (width * height);
+	Log("BVH rays: %.2f M/s packets, %.2f M/s single, %.2f M/s occlusion (%d%% coverage, %d self occluded)",
+		numRays / packetTime / 1.0E+6, numRays / singleTime / 1.0E+6, numHits / occludedTime / 1.0E+6,
+		numHits * 100 / (width * height), (uint32_t) numOccluded);
+}
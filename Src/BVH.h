@@ -0,0 +1,98 @@
+#pragma once
+
+#include "PlyModel.h"
+
+// ray used for BVH queries. Hits are only reported between tMin and tMax along the direction
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float tMin;
+	float tMax;
+
+	Ray() : tMin(0.0f), tMax(1.0E+30F) {
+	}
+
+	Ray(const glm::vec3& withOrigin, const glm::vec3& withDirection) : origin(withOrigin), direction(withDirection), tMin(0.0f), tMax(1.0E+30F) {
+	}
+};
+
+// result of a ray query; triangle is the index of the hit triangle in the model (NO_HIT if nothing was hit) and u, v
+// are the barycentric coordinates of the hit point relative to its second and third vertices
+struct RayHit {
+	float t;
+	float u;
+	float v;
+	uint32_t triangle;
+
+	static const uint32_t NO_HIT = 0xFFFFFFFF;
+
+	RayHit() : t(1.0E+30F), u(0.0f), v(0.0f), triangle(NO_HIT) {
+	}
+};
+
+// bounding volume hierarchy over a model's triangles for answering ray queries on the CPU (picking, visibility and
+// depth rendering without a GL render and readback). Built with a binned surface area heuristic, in parallel
+class BVH {
+protected:
+	// 32 byte node. Interior nodes have count == 0 and their two children at first and first+1; leaves hold count
+	// triangles starting at first
+	struct Node {
+		glm::vec3 boundMin;
+		uint32_t first;
+		glm::vec3 boundMax;
+		uint32_t count;
+	};
+
+	// triangle stored as one vertex and two edges (what the intersection test needs), in leaf order
+	struct Triangle {
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+		uint32_t index;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	uint32_t nodeCount;
+	float buildTime;
+
+	// data only used while building
+	struct BuildData;
+
+	// splits the given node using the binned SAH, recursing into its children (in parallel near the top of the tree)
+	void Subdivide(BuildData& build, uint32_t nodeIndex, uint32_t depth);
+
+public:
+	// builds the BVH over the triangles of the given model data
+	BVH(const std::vector<PlyVertex>& vertices, const std::vector<uint32_t>& indices);
+
+	// finds the closest hit along the ray. Returns true if anything was hit
+	bool Intersect(const Ray& ray, RayHit& hit) const;
+
+	// returns true if anything is hit along the ray (stops at the first hit found)
+	bool Occluded(const Ray& ray) const;
+
+	// finds the closest hits for a packet of 4 rays at once using SSE. Works best for coherent rays, such as those
+	// through neighboring pixels
+	void Intersect4(const Ray* rays, RayHit* hits) const;
+
+	// renders a depth image (distance along each pixel's ray, or -1 where nothing was hit) of the model as seen through
+	// the given view projection matrix, using 2x2 pixel ray packets across all cores
+	void RenderDepth(const glm::mat4& viewProj, uint32_t width, uint32_t height, float* depth) const;
+
+	// returns the seconds it took to build the BVH
+	float GetBuildTime() const {
+		return buildTime;
+	}
+
+	// returns the number of nodes in the tree
+	uint32_t GetNodeCount() const {
+		return nodeCount;
+	}
+
+	// returns the ray through the given normalized device coordinates (-1 to 1) of the given view projection matrix
+	static Ray GetScreenRay(const glm::mat4& viewProj, float x, float y);
+};
+
+// builds a BVH for the given model file and logs its build time and ray query throughput
+void BenchmarkBVH(const char* modelFile);
@@ -2,7 +2,26 @@
 
 // Standard OpenGL Vertex and Index Buffer creation
 
+bool IsDirectStateAccessSupported() {
+	// buffers and textures are always given immutable storage on this path, which are extensions of their own
+	return GLEW_ARB_direct_state_access && GLEW_ARB_buffer_storage && GLEW_ARB_texture_storage;
+}
+
+// creates a buffer with immutable storage holding the given data (which may be NULL), that can still be updated
+static GLuint CreateBufferStorage(const void* data, uint32_t dataSize) {
+	GLuint buffer = 0;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, dataSize, data, GL_DYNAMIC_STORAGE_BIT);
+	GLCHECK();
+	return buffer;
+}
+
 VertexBuffer::VertexBuffer(void* data, uint32_t dataSize) {
+	if (IsDirectStateAccessSupported()) {
+		buffer = CreateBufferStorage(data, dataSize);
+		return;
+	}
+
 	glGenBuffers(1, &buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, buffer);
 	glBufferData(GL_ARRAY_BUFFER, dataSize, data, GL_STATIC_DRAW);
@@ -14,16 +33,144 @@ VertexBuffer::~VertexBuffer() {
 	buffer = 0;
 }
 
+void VertexBuffer::Update(uint32_t offset, const void* data, uint32_t dataSize) {
+	if (IsDirectStateAccessSupported()) {
+		glNamedBufferSubData(buffer, offset, dataSize, data);
+		return;
+	}
+
+	// the copy write target is used so that no VAO binding state is disturbed
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, dataSize, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
 IndexBuffer::IndexBuffer(void* data, uint32_t dataSize, GLenum drawType) : type(drawType) {
+	count = dataSize / sizeof(int);
+	if (IsDirectStateAccessSupported()) {
+		buffer = CreateBufferStorage(data, dataSize);
+		return;
+	}
+
+	// (this binds the buffer to whichever VAO is bound)
 	glGenBuffers(1, &buffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, dataSize, data, GL_STATIC_DRAW);
 	GLCHECK();
-
-	count = dataSize / sizeof(int);
 }
 
 IndexBuffer::~IndexBuffer() {
 	glDeleteBuffers(1, &buffer);
 	buffer = 0;
+}
+
+void IndexBuffer::Update(uint32_t offset, const void* data, uint32_t dataSize) {
+	if (IsDirectStateAccessSupported()) {
+		glNamedBufferSubData(buffer, offset, dataSize, data);
+		return;
+	}
+
+	// binding to GL_ELEMENT_ARRAY_BUFFER would change the bound VAO, so go through the copy write target instead
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, dataSize, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+UniformBuffer::UniformBuffer(uint32_t dataSize, GLuint binding) : size(dataSize) {
+	if (IsDirectStateAccessSupported()) {
+		buffer = CreateBufferStorage(NULL, dataSize);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+		GLCHECK();
+		return;
+	}
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, dataSize, NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+	GLCHECK();
+}
+
+UniformBuffer::~UniformBuffer() {
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+void UniformBuffer::Update(const void* data) {
+	if (IsDirectStateAccessSupported()) {
+		glNamedBufferSubData(buffer, 0, size, data);
+		return;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+}
+
+BufferTexture::BufferTexture(const void* data, uint32_t dataSize, GLenum withFormat) : format(withFormat),
+	size(dataSize) {
+	if (IsDirectStateAccessSupported()) {
+		buffer = CreateBufferStorage(data, dataSize);
+		glCreateTextures(GL_TEXTURE_BUFFER, 1, &texture);
+		glTextureBuffer(texture, format, buffer);
+		GLCHECK();
+		return;
+	}
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, dataSize, data, GL_STATIC_DRAW);
+
+	glGenTextures(1, &texture);
+	GLState::BindTexture(0, GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	GLState::BindTexture(0, GL_TEXTURE_BUFFER, 0);
+	GLCHECK();
+}
+
+BufferTexture::~BufferTexture() {
+	GLState::ForgetTexture(texture);
+	glDeleteTextures(1, &texture);
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+void BufferTexture::Update(const void* data, uint32_t dataSize) {
+	if (IsDirectStateAccessSupported()) {
+		if (dataSize == size) {
+			glNamedBufferSubData(buffer, 0, dataSize, data);
+			return;
+		}
+
+		// immutable storage can't change size, so the texture is pointed at a new buffer
+		GLuint oldBuffer = buffer;
+		buffer = CreateBufferStorage(data, dataSize);
+		glTextureBuffer(texture, format, buffer);
+		glDeleteBuffers(1, &oldBuffer);
+		size = dataSize;
+		GLCHECK();
+		return;
+	}
+	size = dataSize;
+
+	// the texture views whatever storage the buffer has, so it follows the new size on its own
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, dataSize, data, GL_STATIC_DRAW);
+}
+
+void BufferTexture::Bind(uint32_t samplerId) {
+	GLState::BindTexture(samplerId, GL_TEXTURE_BUFFER, texture);
+}
+
+void SetCameraBlock(const CameraBlock& camera) {
+	// one buffer serves every program for the life of the GL context
+	static UniformBuffer* cameraBuffer = NULL;
+	static CameraBlock lastCamera;
+	if (!cameraBuffer) {
+		cameraBuffer = new UniformBuffer(sizeof(CameraBlock), CAMERA_BLOCK_BINDING);
+	} else if (!memcmp(&lastCamera, &camera, sizeof(CameraBlock))) {
+		return;
+	}
+
+	cameraBuffer->Update(&camera);
+	lastCamera = camera;
 }
\ No newline at end of file
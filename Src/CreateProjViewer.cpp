@@ -1,5 +1,7 @@
 
 #include "SpecViz.h"
+#include "GPUProfiler.h"
+#include "Profiler.h"
 #include "PlyModel.h"
 
 #include <fstream>
@@ -51,6 +53,7 @@ public:
 
 	CreateProjected(const char* texture, const char* model);
 	void MainLoop(float deltaTime);
+	bool Poll();
 	void NotifyKeyPress(const char* name);
 	void NotifyMouseWheel(float amt, bool controlHeld);
 	void NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld);
@@ -59,6 +62,7 @@ public:
 };
 
 Viewer* CreateCreateProjViewer(const char* texture, const char* model) {
+	PROFILE_SCOPE("CreateCreateProjViewer");
 	CreateProjected* newViewer = new CreateProjected(texture, model);
 	return newViewer;
 }
@@ -91,11 +95,19 @@ CreateProjected::CreateProjected(const char* textureFile, const char* modelFile)
 	textureVShader = new VertexShader("Shaders/passthrough.vert");
 	textureProgram = new ShaderProgram(texturePShader, textureVShader);
 
+	// uniforms that never change are set once up front: the model is drawn half transparent, and the background
+	// image's colorMap points to sampler 0
+	modelProgram->Bind();
+	glUniform1f(modelProgram->GetUniform(UNIFORM_ALPHA), 0.5f);
+	textureProgram->Bind();
+	glUniform1i(textureProgram->GetUniform(UNIFORM_COLOR_MAP), 0);
+
 	// load up the texture from the given file name as full color
 	ontoTexture = Texture::CreateFromFile(textureFile, GL_RGBA8);
 
 	// load up the model to project onto from the given file name as a PLY model
 	model = new PlyModel(modelFile);
+	model->EnableHotReload();
 	
 	// this is currently hard coded and has to be adjusted based on the image source
 	// TODO : grab field of view from image file info itself when available
@@ -133,18 +145,25 @@ CreateProjected::CreateProjected(const char* textureFile, const char* modelFile)
 	modelName = _strdup(modelFile);
 }
 
+bool CreateProjected::Poll() {
+	// pick up any re-exported version of the model file
+	return model->PollReload();
+}
+
 void CreateProjected::MainLoop(float deltaTime) {
 	GLCHECK();
 
 	// set up z write/read
-	glDepthMask(GL_FALSE);
-	glDisable(GL_DEPTH_TEST);
+	GLState::DepthMask(false);
+	GLState::Disable(GL_DEPTH_TEST);
 	GLCHECK();
 
 	// clear frame buffer
+	GetGPUProfiler()->BeginPass("clear");
 	glClearColor(0,0,0,1);
 	glClearDepth(1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 
 	// render texture:
@@ -165,22 +184,23 @@ void CreateProjected::MainLoop(float deltaTime) {
 
 	GLCHECK();
 
-	// set the computed scale and point the colorMap to sampler 0
-	glUniform2fv(textureProgram->GetUniform("scale"), 1, &scale.x);
-	glUniform1i(textureProgram->GetUniform("colorMap"), 0);
+	// set the computed scale
+	glUniform2fv(textureProgram->GetUniform(UNIFORM_SCALE), 1, &scale.x);
 	GLCHECK();
 
 	// bind texture to sampler 0
 	ontoTexture->Bind(0);
 
 	// draw our quad
+	GetGPUProfiler()->BeginPass("background");
 	vao->Bind();
 	glDrawElements(iBuffer->GetType(), iBuffer->GetCount(), GL_UNSIGNED_INT, (void*) 0);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 	
 
 	// render model
-	glDepthMask(GL_TRUE);
+	GLState::DepthMask(true);
 	modelProgram->Bind();
 	GLCHECK();
 	
@@ -203,22 +223,19 @@ void CreateProjected::MainLoop(float deltaTime) {
 	lightDirection = glm::normalize(glm::vec3(cos(lightYaw) * pitchVar, sin(lightPitch), sin(lightYaw) * pitchVar));
 	
 	// we are rendering with alpha transparency so enable blending
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::Enable(GL_BLEND);
+	GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	GLCHECK();
 	
-	// set computed program matrices and alpha amount
-	glUniformMatrix4fv(modelProgram->GetUniform("objMatrix"), 1, GL_FALSE, &objMatrix[0][0]);
-	glUniformMatrix4fv(modelProgram->GetUniform("projMatrix"), 1, GL_FALSE, &projMatrix[0][0]);
-	glUniformMatrix4fv(modelProgram->GetUniform("viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-	glUniform3fv(modelProgram->GetUniform("lightDirection"), 1, &lightDirection.x);
-	glUniform3fv(modelProgram->GetUniform("eyePosition"), 1, &eyePosition.x);
-	glUniform1f(modelProgram->GetUniform("alpha"), 0.5f);
+	// set computed camera matrices
+	SetCameraBlock(CameraBlock(objMatrix, viewMatrix, projMatrix, eyePosition, lightDirection));
 	GLCHECK();
 
 	// draw our model
+	GetGPUProfiler()->BeginPass("model");
 	model->Render();
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 }
 
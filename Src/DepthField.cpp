@@ -1,10 +1,13 @@
 
 #include "SpecViz.h"
 #include "PlyModel.h"
+#include "Profiler.h"
 
 #include <fstream>
 
 void CreateDepthField(const char* projFile) {
+	PROFILE_SCOPE("CreateDepthField");
+
 	const uint32_t width = 1024;
 	const uint32_t height = 1024;
 	const uint32_t numPixels = width * height;
@@ -25,18 +28,20 @@ void CreateDepthField(const char* projFile) {
 
 	f.close();
 
-	PixelShader* modelPShader = new PixelShader("Shaders/solid_color.pix");
-	VertexShader* modelVShader = new VertexShader("Shaders/lit_vertex.vert");
+	// only depth is read back, so the model is drawn from its position stream
+	PixelShader* modelPShader = new PixelShader("Shaders/depth_only.pix");
+	VertexShader* modelVShader = new VertexShader("Shaders/depth_only.vert");
 	ShaderProgram* modelProgram = new ShaderProgram(modelPShader, modelVShader);
 
 	// texture is used just to get the destination width and height:
-	Texture* tex = Texture::CreateFromFile(textureFile, GL_RGBA8);
+	Texture* tex = Texture::CreateFromFile(textureFile, GL_RGBA8, TEXTURE_FILTER_NEAREST);
 	uint32_t destWidth = tex->GetWidth();
 	uint32_t destHeight = tex->GetHeight();
 	delete tex;
 
 	// load up the model for rendering the depths
 	PlyModel* model = new PlyModel(modelFile);
+	model->EnablePositionStream();
 
 	// create a frame buffer
 	GLuint saveBuffer = 0;
@@ -47,10 +52,9 @@ void CreateDepthField(const char* projFile) {
 	GLCHECK();
 
 	// create color texture and bind to frame buffer
-	glActiveTexture(GL_TEXTURE7);
 	GLuint colorTexture = 0;
 	glGenTextures(1, &colorTexture);
-	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	GLState::BindTexture(7, GL_TEXTURE_2D, colorTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 	GLCHECK();
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -63,7 +67,7 @@ void CreateDepthField(const char* projFile) {
 	// create depth texture using pixel buffer and bind to frame buffer
 	GLuint depthTexture = 0;
 	glGenTextures(1, &depthTexture);
-	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	GLState::BindTexture(7, GL_TEXTURE_2D, depthTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
 	GLCHECK();
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -71,7 +75,7 @@ void CreateDepthField(const char* projFile) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(7, GL_TEXTURE_2D, 0);
 	GLCHECK();
 
 	GLenum val = glCheckFramebufferStatus(GL_FRAMEBUFFER);
@@ -81,8 +85,9 @@ void CreateDepthField(const char* projFile) {
 	GLCHECK();
 
 	// set up z write/read
-	glDepthMask(GL_TRUE);
-	glEnable(GL_DEPTH_TEST);
+	PROFILE_BEGIN(renderScope, "render depth");
+	GLState::DepthMask(true);
+	GLState::Enable(GL_DEPTH_TEST);
 	GLCHECK();
 
 	// clear frame buffer
@@ -98,18 +103,14 @@ void CreateDepthField(const char* projFile) {
 	glm::mat4x4 objMatrix = glm::mat4x4();
 	glm::mat4x4 viewMatrix = glm::mat4x4();
 	
-	glDisable(GL_BLEND);
+	GLState::Disable(GL_BLEND);
 
 	GLCHECK();
-	glUniformMatrix4fv(modelProgram->GetUniform("objMatrix"), 1, GL_FALSE, &objMatrix[0][0]);
-	glUniformMatrix4fv(modelProgram->GetUniform("projMatrix"), 1, GL_FALSE, &projMatrix[0][0]);
-	glUniformMatrix4fv(modelProgram->GetUniform("viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-	//glUniform3fv(modelProgram->GetUniform("eyePosition"), 1, &eyePosition.x);
-	glUniform1f(modelProgram->GetUniform("alpha"), 1.0f);
+	SetCameraBlock(CameraBlock(objMatrix, viewMatrix, projMatrix, glm::vec3(0,0,0), glm::vec3(0,1,0)));
 	GLCHECK();
 
 	// draw our model
-	model->Render();
+	model->RenderPositions();
 	GLCHECK();
 
 	glFinish();
@@ -118,9 +119,12 @@ void CreateDepthField(const char* projFile) {
 	float* depth = new float[numPixels];
 	memset(depth, 0, sizeof(float) * numPixels);
 	glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, &depth[0]);
+	PROFILE_END(renderScope);
 
 	// clean up
  	glBindFramebuffer(GL_FRAMEBUFFER, saveBuffer);
+	GLState::ForgetTexture(colorTexture);
+	GLState::ForgetTexture(depthTexture);
 	glDeleteTextures(1, &colorTexture);
 	glDeleteTextures(1, &depthTexture);
 	glDeleteFramebuffers(1, &frameBuffer);
@@ -133,6 +137,7 @@ void CreateDepthField(const char* projFile) {
 	// transform depth values into something we can work with
 
 	// normalize infinite perspective matrix (infinite depth becomes -1)
+	PROFILE_BEGIN(normalizeScope, "normalize depth");
 	float maxDepth = 0.0f, minDepth = 1.0E+30F;
 	for (uint32_t i = 0; i < numPixels; i++) {
 		if (depth[i] == 1.0f) {
@@ -156,6 +161,7 @@ void CreateDepthField(const char* projFile) {
 			depth[i] = (depth[i]-minDepth) / (maxDepth - minDepth);
 		}
 	}
+	PROFILE_END(normalizeScope);
 
 	// TEST: create a png of the resulting depth values:
 	uint8_t* colors = new uint8_t[width*height*3];
@@ -172,6 +178,7 @@ void CreateDepthField(const char* projFile) {
 	Texture::SavePNG(pngFile, width, height, (uint8_t*) colors);
 
 	// make array of depth differences:
+	PROFILE_BEGIN(diffScope, "depth differences");
 	float* depthDiff = new float[width * height];
 	const float depthMagnification = 3.0f;
 	for (uint32_t i = 0; i < numPixels; i++) {
@@ -187,6 +194,7 @@ void CreateDepthField(const char* projFile) {
 		best *= depthMagnification;
 		depthDiff[i] = best > 1.0f ? 1.0f : best;
 	}
+	PROFILE_END(diffScope);
 	
 	// TEST: create a png of the resulting depth difference values:
 	for (uint32_t i = 0; i < numPixels; i++) {
@@ -201,6 +209,7 @@ void CreateDepthField(const char* projFile) {
 	Texture::SavePNG(pngFile, width, height, (uint8_t*) colors);
 
 	// fill in entire area outside of edge:
+	PROFILE_BEGIN(spreadScope, "spread edge distance");
 	for (uint32_t i = 0; i < numPixels; i++) {
 		if (depth[i] == 2.0f) {
 			depthDiff[i] = 1.0f;
@@ -231,6 +240,7 @@ void CreateDepthField(const char* projFile) {
 		// copy depth (now scratch) back into depthDiff now that pass is over
 		memcpy(depthDiff, depth, sizeof(float) * numPixels);
 	}
+	PROFILE_END(spreadScope);
 	
 	// TEST: create a png of the resulting depth difference values:
 	for (uint32_t i = 0; i < numPixels; i++) {
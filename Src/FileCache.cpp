@@ -0,0 +1,81 @@
+#include "FileCache.h"
+
+#ifndef _MSC_VER
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+uint64_t HashBytes(const void* data, uint32_t length, uint64_t hash) {
+	for (uint32_t i = 0; i < length; i++) {
+		hash = (hash ^ ((const uint8_t*) data)[i]) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+uint64_t HashString(const char* str, uint64_t hash) {
+	return str ? HashBytes(str, (uint32_t) strlen(str), hash) : hash;
+}
+
+void GetCacheFilePath(char* intoPath, uint32_t size, const char* dir, uint64_t key, const char* extension) {
+	sprintf_s(intoPath, size, "%s/%08x%08x.%s", dir, (uint32_t) (key >> 32), (uint32_t) key, extension);
+}
+
+void* LoadCacheFile(const char* path, uint32_t magic, uint32_t version, uint64_t key, void* intoInfo, uint32_t infoSize,
+	uint32_t& length) {
+	FILE* f = NULL;
+	fopen_s(&f, path, "rb");
+	if (!f) {
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long fileSize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	// the lengths are checked against the file before anything is allocated from them, so a truncated or corrupt file
+	// is just a cache miss
+	CacheFileHeader header;
+	void* data = NULL;
+	if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == magic && header.version == version &&
+		header.key == key && header.infoSize == infoSize && header.length > 0 &&
+		(uint64_t) fileSize == sizeof(header) + (uint64_t) infoSize + header.length &&
+		fread(intoInfo, 1, infoSize, f) == infoSize) {
+		data = malloc(header.length);
+		if (fread(data, 1, header.length, f) == header.length) {
+			length = header.length;
+		} else {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(f);
+
+	return data;
+}
+
+void SaveCacheFile(const char* dir, const char* path, uint32_t magic, uint32_t version, uint64_t key, const void* info,
+	uint32_t infoSize, const void* data, uint32_t length) {
+#ifdef _MSC_VER
+	CreateDirectoryA(dir, NULL);
+#else
+	mkdir(dir, 0755);
+#endif
+
+	FILE* f = NULL;
+	fopen_s(&f, path, "wb");
+	if (!f) {
+		Log("Unable to write cache file '%s'", path);
+		return;
+	}
+
+	CacheFileHeader header;
+	header.magic = magic;
+	header.version = version;
+	header.key = key;
+	header.infoSize = infoSize;
+	header.length = length;
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(info, 1, infoSize, f);
+	fwrite(data, 1, length, f);
+	fclose(f);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "SpecViz.h"
+
+// starting value of the FNV-1a hashes below
+#define HASH_SEED 0xCBF29CE484222325ULL
+
+// 64 bit FNV-1a hash of the given bytes, continuing from the given hash
+uint64_t HashBytes(const void* data, uint32_t length, uint64_t hash = HASH_SEED);
+
+// 64 bit FNV-1a hash of the characters of the given string (NULL hashes as empty), continuing from the given hash
+uint64_t HashString(const char* str, uint64_t hash = HASH_SEED);
+
+// header at the start of each cache file, followed by a block of info about the data that depends on the kind of cache,
+// then the cached data itself
+struct CacheFileHeader {
+	uint32_t magic;			// identifies the kind of cache
+	uint32_t version;		// layout version of the kind of cache (changing it invalidates every cached file)
+	uint64_t key;			// hash of everything the cached data was built from
+	uint32_t infoSize;
+	uint32_t length;
+};
+
+// writes the path of the cache file for the given key into the given buffer, as dir/key.extension
+void GetCacheFilePath(char* intoPath, uint32_t size, const char* dir, uint64_t key, const char* extension);
+
+// reads a cache file into the given info block, returning its data (allocated with malloc) and its length, or NULL if
+// it isn't cached, was written for a different magic, version or key, or isn't the size its header says it is
+void* LoadCacheFile(const char* path, uint32_t magic, uint32_t version, uint64_t key, void* intoInfo, uint32_t infoSize,
+	uint32_t& length);
+
+// writes a cache file, creating its directory if needed
+void SaveCacheFile(const char* dir, const char* path, uint32_t magic, uint32_t version, uint64_t key, const void* info,
+	uint32_t infoSize, const void* data, uint32_t length);
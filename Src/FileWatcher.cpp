@@ -0,0 +1,135 @@
+#include "FileWatcher.h"
+
+#ifndef _MSC_VER
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#endif
+
+// how long a file has to go unmodified before a change is reported
+#define QUIET_PERIOD_MS 500
+
+FileWatcher::FileWatcher(const char* path) : changePending(false), changeTime(0) {
+	strncpy(filePath, path, sizeof(filePath) - 1);
+	filePath[sizeof(filePath) - 1] = 0;
+
+	// split the file name from its directory, since the directory is what we actually watch (tools often replace
+	// the file rather than writing to it in place)
+	char dir[512];
+	strcpy(dir, filePath);
+	char* slash = strrchr(dir, '/');
+	char* backSlash = strrchr(dir, '\\');
+	if (backSlash > slash) {
+		slash = backSlash;
+	}
+	if (slash) {
+		*slash = 0;
+		fileName = filePath + (slash - dir) + 1;
+	} else {
+		strcpy(dir, ".");
+		fileName = filePath;
+	}
+
+#ifdef _MSC_VER
+	memset(&lastWrite, 0, sizeof(lastWrite));
+	WIN32_FILE_ATTRIBUTE_DATA attribs;
+	if (GetFileAttributesEx(filePath, GetFileExInfoStandard, &attribs)) {
+		lastWrite = attribs.ftLastWriteTime;
+	}
+
+	notifyHandle = FindFirstChangeNotification(dir, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (notifyHandle == INVALID_HANDLE_VALUE) {
+		Log("Unable to watch '%s' for changes", filePath);
+	}
+#else
+	watchFd = -1;
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd >= 0) {
+		watchFd = inotify_add_watch(inotifyFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	}
+	if (watchFd < 0) {
+		Log("Unable to watch '%s' for changes", filePath);
+	}
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef _MSC_VER
+	if (notifyHandle != INVALID_HANDLE_VALUE) {
+		FindCloseChangeNotification(notifyHandle);
+	}
+#else
+	if (inotifyFd >= 0) {
+		if (watchFd >= 0) {
+			inotify_rm_watch(inotifyFd, watchFd);
+		}
+		close(inotifyFd);
+	}
+#endif
+}
+
+uint32_t FileWatcher::GetTimeMs() {
+#ifdef _MSC_VER
+	return GetTickCount();
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+#endif
+}
+
+bool FileWatcher::PollPlatform() {
+	bool changed = false;
+
+#ifdef _MSC_VER
+	if (notifyHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	// the notification fires for any file in the directory, so compare write times to see if it was ours
+	while (WaitForSingleObject(notifyHandle, 0) == WAIT_OBJECT_0) {
+		WIN32_FILE_ATTRIBUTE_DATA attribs;
+		if (GetFileAttributesEx(filePath, GetFileExInfoStandard, &attribs) &&
+			CompareFileTime(&attribs.ftLastWriteTime, &lastWrite) != 0) {
+			lastWrite = attribs.ftLastWriteTime;
+			changed = true;
+		}
+		FindNextChangeNotification(notifyHandle);
+	}
+#else
+	if (watchFd < 0) {
+		return false;
+	}
+
+	// drain all pending events, looking for any that refer to our file
+	char buffer[4096];
+	ssize_t length;
+	while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+		for (char* cur = buffer; cur < buffer + length; ) {
+			inotify_event* e = (inotify_event*) cur;
+			if (e->len && !strcmp(e->name, fileName)) {
+				changed = true;
+			}
+			cur += sizeof(inotify_event) + e->len;
+		}
+	}
+#endif
+
+	return changed;
+}
+
+bool FileWatcher::HasChanged() {
+	if (PollPlatform()) {
+		changePending = true;
+		changeTime = GetTimeMs();
+	}
+
+	// only report once the file has stopped changing for the quiet period
+	if (changePending && GetTimeMs() - changeTime >= QUIET_PERIOD_MS) {
+		changePending = false;
+		return true;
+	}
+
+	return false;
+}
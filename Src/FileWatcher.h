@@ -0,0 +1,43 @@
+#pragma once
+
+#include "SpecViz.h"
+
+// watches a single file on disk for modifications. Changes are only reported once the file has been quiet for a short
+// period so that a tool still writing out the file isn't read from half way through
+class FileWatcher {
+protected:
+	char filePath[512];			// full path of the watched file
+	const char* fileName;		// file name portion of filePath (points into filePath)
+
+	bool changePending;			// a change was seen but the quiet period has not yet passed
+	uint32_t changeTime;		// time in milliseconds the last change was seen
+
+#ifdef _MSC_VER
+	HANDLE notifyHandle;		// directory change notification handle
+	FILETIME lastWrite;			// last known write time of the watched file
+#else
+	int inotifyFd;				// inotify instance used for the watched file's directory
+	int watchFd;				// inotify watch descriptor for the directory
+#endif
+
+	// polls the platform for any changes to the watched file since the last call
+	bool PollPlatform();
+
+	// returns a monotonic time in milliseconds
+	static uint32_t GetTimeMs();
+
+public:
+	// begins watching the file at the given path
+	FileWatcher(const char* path);
+
+	// stops watching the file
+	virtual ~FileWatcher();
+
+	// returns true once after each completed modification of the watched file
+	bool HasChanged();
+
+	// returns the path of the watched file
+	const char* GetPath() const {
+		return filePath;
+	}
+};
@@ -0,0 +1,52 @@
+#include "FrameScheduler.h"
+
+// longest the main loop sleeps while idle, which bounds how late background changes (such as a re-exported model
+// file) are noticed
+#define IDLE_POLL_MS 100
+
+FrameScheduler::FrameScheduler(float withMaxFPS) : maxFPS(withMaxFPS), lastFrameTime(0.0), hasDrawn(false),
+	framesDrawn(0), idleChecks(0) {
+}
+
+bool FrameScheduler::ShouldDraw(Viewer* viewer, double now) {
+	if (!viewer) {
+		return false;
+	}
+
+	// background work that finished (model reloads, etc) changes what's on screen
+	if (viewer->Poll()) {
+		viewer->Invalidate();
+	}
+
+	if (!viewer->IsDirty() && !viewer->IsAnimating()) {
+		idleChecks++;
+		return false;
+	}
+
+	// hold the frame back until the cap allows it
+	if (maxFPS > 0.0f && hasDrawn && now - lastFrameTime < 1.0 / maxFPS) {
+		return false;
+	}
+
+	viewer->ClearDirty();
+	lastFrameTime = now;
+	hasDrawn = true;
+	framesDrawn++;
+	return true;
+}
+
+uint32_t FrameScheduler::GetWaitMs(Viewer* viewer, double now) const {
+	if (!viewer || (!viewer->IsDirty() && !viewer->IsAnimating())) {
+		return IDLE_POLL_MS;
+	}
+
+	// a frame is wanted, so only wait as long as the cap requires
+	if (maxFPS <= 0.0f || !hasDrawn) {
+		return 0;
+	}
+	double remaining = lastFrameTime + 1.0 / maxFPS - now;
+	if (remaining <= 0.0) {
+		return 0;
+	}
+	return (uint32_t) mini((int32_t) ceil(remaining * 1000.0), IDLE_POLL_MS);
+}
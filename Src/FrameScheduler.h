@@ -0,0 +1,42 @@
+#pragma once
+
+#include "SpecViz.h"
+
+// decides when the main loop draws a frame: only when the viewer is dirty (or animating), and never faster than the
+// frame rate cap. Contains no platform code and takes the current time as a parameter, so it can drive a windowed
+// loop, a headless one, or be stepped through with made up times
+class FrameScheduler {
+protected:
+	float maxFPS;				// frame rate cap (0 for uncapped)
+	double lastFrameTime;		// time the last frame was drawn at
+	bool hasDrawn;				// a frame has been drawn, so lastFrameTime is valid
+	uint32_t framesDrawn;		// frames drawn so far
+	uint32_t idleChecks;		// times the scheduler was asked about a frame but had nothing to draw
+
+public:
+	// creates a scheduler with the given frame rate cap (0 for uncapped)
+	FrameScheduler(float withMaxFPS = 0.0f);
+
+	// sets the frame rate cap (0 for uncapped)
+	void SetMaxFPS(float withMaxFPS) {
+		maxFPS = withMaxFPS;
+	}
+
+	// polls the viewer for background changes, then returns true if it should be drawn at the given time (in
+	// seconds). When true is returned the viewer's dirty flag is cleared, so invalidations made while drawing are
+	// kept for the next frame
+	bool ShouldDraw(Viewer* viewer, double now);
+
+	// returns how many milliseconds the main loop can sleep (waking early for input) before asking ShouldDraw again
+	uint32_t GetWaitMs(Viewer* viewer, double now) const;
+
+	// returns the number of frames drawn so far
+	uint32_t GetFramesDrawn() const {
+		return framesDrawn;
+	}
+
+	// returns the number of times there was nothing to draw
+	uint32_t GetIdleChecks() const {
+		return idleChecks;
+	}
+};
@@ -0,0 +1,98 @@
+#include "GLDebug.h"
+
+#include <map>
+#include <mutex>
+
+// severities from most to least severe
+static const GLenum debugSeverities[] = {
+	GL_DEBUG_SEVERITY_HIGH,
+	GL_DEBUG_SEVERITY_MEDIUM,
+	GL_DEBUG_SEVERITY_LOW,
+	GL_DEBUG_SEVERITY_NOTIFICATION,
+};
+
+// times each message (by source and ID) has been seen. Asynchronous messages can come from any of the driver's threads
+static std::mutex debugMutex;
+static std::map<uint64_t, uint32_t> debugRepeats;
+
+static const char* GetSourceName(GLenum source) {
+	switch (source) {
+		case GL_DEBUG_SOURCE_API: return "api";
+		case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+		case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+		case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+		case GL_DEBUG_SOURCE_APPLICATION: return "application";
+		default: return "other";
+	}
+}
+
+static const char* GetTypeName(GLenum type) {
+	switch (type) {
+		case GL_DEBUG_TYPE_ERROR: return "error";
+		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+		case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+		case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+		default: return "message";
+	}
+}
+
+static const char* GetSeverityName(GLenum severity) {
+	switch (severity) {
+		case GL_DEBUG_SEVERITY_HIGH: return "high";
+		case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+		case GL_DEBUG_SEVERITY_LOW: return "low";
+		default: return "notification";
+	}
+}
+
+static void GLAPIENTRY DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+	const GLchar* message, const void* userParam) {
+	uint32_t seen;
+	{
+		std::lock_guard<std::mutex> lock(debugMutex);
+		seen = ++debugRepeats[((uint64_t) source << 32) | id];
+	}
+	if (seen > GL_DEBUG_MAX_REPEATS) {
+		return;
+	}
+
+	// Log only has room for so much, and driver messages can run long
+	Log("GL %s %s (%s severity, id %d): %.400s%s", GetSourceName(source), GetTypeName(type), GetSeverityName(severity),
+		id, message, seen == GL_DEBUG_MAX_REPEATS ? " (further repeats dropped)" : "");
+
+	// with synchronous output, the call that raised an error is on the stack here
+	assert(type != GL_DEBUG_TYPE_ERROR);
+}
+
+bool InitDebugOutput(GLenum minSeverity, bool synchronous) {
+	if (!GLEW_KHR_debug) {
+		Log("Driver has no debug output, GL errors are only caught by GLCHECK in debug builds");
+		return false;
+	}
+
+	glDebugMessageCallback(DebugCallback, NULL);
+	glEnable(GL_DEBUG_OUTPUT);
+	if (synchronous) {
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	} else {
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+	SetDebugOutputSeverity(minSeverity);
+	GLCHECK();
+
+	Log("GL debug output enabled (%s, %s severity and up)", synchronous ? "synchronous" : "asynchronous",
+		GetSeverityName(minSeverity));
+	return true;
+}
+
+void SetDebugOutputSeverity(GLenum minSeverity) {
+	// severities are switched on from the most severe down to the lowest one wanted
+	bool enabled = true;
+	for (uint32_t i = 0; i < sizeof(debugSeverities) / sizeof(debugSeverities[0]); i++) {
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, debugSeverities[i], 0, NULL, enabled ? GL_TRUE : GL_FALSE);
+		if (debugSeverities[i] == minSeverity) {
+			enabled = false;
+		}
+	}
+}
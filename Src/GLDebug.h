@@ -0,0 +1,17 @@
+#pragma once
+
+#include "SpecViz.h"
+
+// times each distinct debug message is logged before its repeats are dropped, so a warning raised every frame doesn't
+// flood the log
+#define GL_DEBUG_MAX_REPEATS 8
+
+// routes the driver's debug output (KHR_debug) for the current context into Log: errors, undefined and deprecated
+// behaviour, and performance warnings of at least the given severity (GL_DEBUG_SEVERITY_HIGH, _MEDIUM, _LOW or
+// _NOTIFICATION). Messages normally arrive asynchronously, so nothing waits on the driver to check for them. With
+// synchronous set they arrive inside the call that caused them, which is slower but puts the culprit on the stack.
+// Returns false if the driver has no debug output
+bool InitDebugOutput(GLenum minSeverity, bool synchronous);
+
+// changes the lowest severity of message logged
+void SetDebugOutputSeverity(GLenum minSeverity);
@@ -0,0 +1,227 @@
+#include "SpecViz.h"
+
+#include <thread>
+
+// frames between logs of the call counts
+#define GL_STATE_LOG_INTERVAL 300
+
+// tracked state that hasn't been set through the cache yet
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+
+// texture targets tracked on each unit
+#define GL_STATE_TEXTURE_TARGETS 3
+static const GLenum stateTextureTargets[GL_STATE_TEXTURE_TARGETS] = {
+	GL_TEXTURE_2D,
+	GL_TEXTURE_2D_ARRAY,
+	GL_TEXTURE_BUFFER,
+};
+
+// capabilities tracked by Enable and Disable
+#define GL_STATE_CAPABILITIES 4
+static const GLenum stateCapabilities[GL_STATE_CAPABILITIES] = {
+	GL_DEPTH_TEST,
+	GL_BLEND,
+	GL_CULL_FACE,
+	GL_RASTERIZER_DISCARD,
+};
+
+// the last value set for each piece of state, or GL_STATE_UNKNOWN
+struct GLStateCache {
+	uint32_t program;
+	uint32_t vertexArray;
+	uint32_t activeUnit;
+	uint32_t textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS];
+	uint32_t capabilities[GL_STATE_CAPABILITIES];
+	uint32_t depthMask;
+	uint32_t depthFunc;
+	uint32_t blendSource;
+	uint32_t blendDestination;
+	uint32_t colorMask;
+};
+
+static GLStateCache stateCache;
+static bool stateTracking = false;
+static std::thread::id stateThread;
+
+// call counts of the frame in progress, and of the last finished one
+static uint32_t stateIssued = 0;
+static uint32_t stateSkipped = 0;
+static uint32_t stateFrameIssued = 0;
+static uint32_t stateFrameSkipped = 0;
+static uint32_t stateFrameNumber = 0;
+
+// returns true if the call should be filtered through the cache
+static bool IsTracking() {
+	return stateTracking && std::this_thread::get_id() == stateThread;
+}
+
+// returns true (and counts the call as issued) if the tracked value differs from the new one, which it's updated to
+static bool ShouldIssue(uint32_t& tracked, uint32_t value) {
+	if (tracked == value) {
+		stateSkipped++;
+		return false;
+	}
+	tracked = value;
+	stateIssued++;
+	return true;
+}
+
+static uint32_t FindTextureTarget(GLenum target) {
+	for (uint32_t i = 0; i < GL_STATE_TEXTURE_TARGETS; i++) {
+		if (stateTextureTargets[i] == target) {
+			return i;
+		}
+	}
+	return GL_STATE_TEXTURE_TARGETS;
+}
+
+static uint32_t FindCapability(GLenum capability) {
+	for (uint32_t i = 0; i < GL_STATE_CAPABILITIES; i++) {
+		if (stateCapabilities[i] == capability) {
+			return i;
+		}
+	}
+	return GL_STATE_CAPABILITIES;
+}
+
+void GLState::Init() {
+	stateThread = std::this_thread::get_id();
+	stateTracking = true;
+	Invalidate();
+}
+
+void GLState::Invalidate() {
+	memset(&stateCache, 0xFF, sizeof(stateCache));
+}
+
+void GLState::UseProgram(GLuint program) {
+	if (!IsTracking() || ShouldIssue(stateCache.program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void GLState::ForgetProgram(GLuint program) {
+	if (IsTracking() && stateCache.program == program) {
+		stateCache.program = GL_STATE_UNKNOWN;
+	}
+}
+
+void GLState::BindVertexArray(GLuint vertexArray) {
+	if (!IsTracking() || ShouldIssue(stateCache.vertexArray, vertexArray)) {
+		glBindVertexArray(vertexArray);
+	}
+}
+
+void GLState::ForgetVertexArray(GLuint vertexArray) {
+	if (IsTracking() && stateCache.vertexArray == vertexArray) {
+		stateCache.vertexArray = 0;
+	}
+}
+
+void GLState::BindTexture(uint32_t unit, GLenum target, GLuint texture) {
+	if (!IsTracking()) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		return;
+	}
+
+	if (ShouldIssue(stateCache.activeUnit, unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	uint32_t targetIndex = FindTextureTarget(target);
+	if (unit >= GL_STATE_TEXTURE_UNITS || targetIndex == GL_STATE_TEXTURE_TARGETS) {
+		stateIssued++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (ShouldIssue(stateCache.textures[unit][targetIndex], texture)) {
+		glBindTexture(target, texture);
+	}
+}
+
+void GLState::ForgetTexture(GLuint texture) {
+	if (!IsTracking()) {
+		return;
+	}
+	for (uint32_t unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+		for (uint32_t i = 0; i < GL_STATE_TEXTURE_TARGETS; i++) {
+			if (stateCache.textures[unit][i] == texture) {
+				stateCache.textures[unit][i] = 0;
+			}
+		}
+	}
+}
+
+void GLState::Enable(GLenum capability) {
+	uint32_t index = FindCapability(capability);
+	if (!IsTracking() || index == GL_STATE_CAPABILITIES || ShouldIssue(stateCache.capabilities[index], 1)) {
+		glEnable(capability);
+	}
+}
+
+void GLState::Disable(GLenum capability) {
+	uint32_t index = FindCapability(capability);
+	if (!IsTracking() || index == GL_STATE_CAPABILITIES || ShouldIssue(stateCache.capabilities[index], 0)) {
+		glDisable(capability);
+	}
+}
+
+void GLState::DepthMask(bool write) {
+	if (!IsTracking() || ShouldIssue(stateCache.depthMask, write ? 1 : 0)) {
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void GLState::DepthFunc(GLenum func) {
+	if (!IsTracking() || ShouldIssue(stateCache.depthFunc, func)) {
+		glDepthFunc(func);
+	}
+}
+
+void GLState::BlendFunc(GLenum source, GLenum destination) {
+	if (!IsTracking()) {
+		glBlendFunc(source, destination);
+		return;
+	}
+
+	// both factors go in the one call, so it's only skipped when neither changes
+	if (stateCache.blendSource == source && stateCache.blendDestination == destination) {
+		stateSkipped++;
+		return;
+	}
+	stateCache.blendSource = source;
+	stateCache.blendDestination = destination;
+	stateIssued++;
+	glBlendFunc(source, destination);
+}
+
+void GLState::ColorMask(bool write) {
+	if (!IsTracking() || ShouldIssue(stateCache.colorMask, write ? 1 : 0)) {
+		GLboolean value = write ? GL_TRUE : GL_FALSE;
+		glColorMask(value, value, value, value);
+	}
+}
+
+void GLState::EndFrame() {
+	stateFrameIssued = stateIssued;
+	stateFrameSkipped = stateSkipped;
+	stateIssued = 0;
+	stateSkipped = 0;
+
+	stateFrameNumber++;
+	if (stateFrameNumber % GL_STATE_LOG_INTERVAL == 0) {
+		LogStats();
+	}
+}
+
+void GLState::GetFrameStats(uint32_t& issued, uint32_t& skipped) {
+	issued = stateFrameIssued;
+	skipped = stateFrameSkipped;
+}
+
+void GLState::LogStats() {
+	uint32_t total = stateFrameIssued + stateFrameSkipped;
+	Log("GL state: %d of %d calls issued last frame (%d skipped as redundant)", stateFrameIssued, total,
+		stateFrameSkipped);
+}
@@ -0,0 +1,209 @@
+#include "GPUProfiler.h"
+
+#include <algorithm>
+
+// frames between statistics being logged
+#define GPU_PROFILER_LOG_INTERVAL 300
+
+GPUProfiler::GPUProfiler() : numPasses(0), frameNumber(0), current(NULL), numOpen(0), droppedFrames(0) {
+	supported = GLEW_ARB_timer_query != 0;
+	memset(frames, 0, sizeof(frames));
+	if (supported) {
+		for (uint32_t i = 0; i < GPU_PROFILER_LATENCY; i++) {
+			glGenQueries(GPU_PROFILER_MAX_PASSES * 2, frames[i].queries);
+		}
+		GLCHECK();
+	} else {
+		Log("GPU profiling unavailable, the driver doesn't support timer queries");
+	}
+}
+
+GPUProfiler::~GPUProfiler() {
+	if (supported) {
+		for (uint32_t i = 0; i < GPU_PROFILER_LATENCY; i++) {
+			glDeleteQueries(GPU_PROFILER_MAX_PASSES * 2, frames[i].queries);
+		}
+	}
+}
+
+uint32_t GPUProfiler::FindPass(const char* name) {
+	for (uint32_t i = 0; i < numPasses; i++) {
+		if (passes[i].name == name || !strcmp(passes[i].name, name)) {
+			return i;
+		}
+	}
+	if (numPasses == GPU_PROFILER_MAX_PASSES) {
+		return GPU_PROFILER_MAX_PASSES;
+	}
+
+	passes[numPasses].name = name;
+	passes[numPasses].count = 0;
+	return numPasses++;
+}
+
+void GPUProfiler::CollectResults() {
+	for (uint32_t i = 0; i < GPU_PROFILER_LATENCY; i++) {
+		FrameQueries& frame = frames[i];
+		if (!frame.pending) {
+			continue;
+		}
+
+		// queries complete in order, so once the last one issued (the end of the frame pass, which EndFrame closes after
+		// every other pass) is available they all are
+		GLuint available = 0;
+		glGetQueryObjectuiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			continue;
+		}
+
+		for (uint32_t p = 0; p < frame.numPasses; p++) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.queries[p * 2], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[p * 2 + 1], GL_QUERY_RESULT, &end);
+
+			PassHistory& pass = passes[frame.passes[p]];
+			GPUPassSample& sample = pass.samples[pass.count % GPU_PROFILER_HISTORY];
+			sample.frame = frame.frame;
+			sample.ms = (float) ((double) (end - begin) / 1.0E+6);
+			pass.count++;
+		}
+		frame.pending = false;
+	}
+}
+
+void GPUProfiler::BeginFrame() {
+	if (!supported) {
+		return;
+	}
+	CollectResults();
+
+	// if the GPU is so far behind that this frame's queries are still waiting, give up on that frame's results
+	current = &frames[frameNumber % GPU_PROFILER_LATENCY];
+	if (current->pending) {
+		current->pending = false;
+		droppedFrames++;
+	}
+	current->numPasses = 0;
+	current->frame = frameNumber;
+	numOpen = 0;
+
+	BeginPass("frame");
+}
+
+void GPUProfiler::EndFrame() {
+	if (!supported || !current) {
+		return;
+	}
+
+	// close the frame pass (and anything left open)
+	while (numOpen) {
+		EndPass();
+	}
+	current->pending = current->numPasses > 0;
+	current = NULL;
+
+	frameNumber++;
+	if (frameNumber % GPU_PROFILER_LOG_INTERVAL == 0) {
+		LogStats();
+	}
+}
+
+void GPUProfiler::BeginPass(const char* name) {
+	if (!supported || !current) {
+		return;
+	}
+
+	// a pass that can't be timed (the frame or pass table is full) still gets an open entry, so that its EndPass
+	// doesn't close the pass around it
+	if (numOpen == GPU_PROFILER_MAX_DEPTH) {
+		assert(false);
+		return;
+	}
+	uint32_t pass = current->numPasses < GPU_PROFILER_MAX_PASSES ? FindPass(name) : GPU_PROFILER_MAX_PASSES;
+	if (pass == GPU_PROFILER_MAX_PASSES) {
+		openPasses[numOpen++] = GPU_PROFILER_UNTIMED;
+		return;
+	}
+
+	uint32_t index = current->numPasses++;
+	current->passes[index] = pass;
+	glQueryCounter(current->queries[index * 2], GL_TIMESTAMP);
+	openPasses[numOpen++] = index;
+}
+
+void GPUProfiler::EndPass() {
+	if (!supported || !current || !numOpen) {
+		return;
+	}
+	uint32_t index = openPasses[--numOpen];
+	if (index != GPU_PROFILER_UNTIMED) {
+		glQueryCounter(current->queries[index * 2 + 1], GL_TIMESTAMP);
+	}
+}
+
+bool GPUProfiler::GetStats(const char* name, float& minMs, float& avgMs, float& p99Ms) {
+	uint32_t pass = FindPass(name);
+	if (pass == GPU_PROFILER_MAX_PASSES || !passes[pass].count) {
+		return false;
+	}
+
+	// sort a copy of the history to find the percentile
+	uint32_t count = mini(passes[pass].count, GPU_PROFILER_HISTORY);
+	float sorted[GPU_PROFILER_HISTORY];
+	float total = 0.0f;
+	for (uint32_t i = 0; i < count; i++) {
+		sorted[i] = passes[pass].samples[i].ms;
+		total += sorted[i];
+	}
+	std::sort(sorted, sorted + count);
+
+	minMs = sorted[0];
+	avgMs = total / count;
+	p99Ms = sorted[(count * 99 + 99) / 100 - 1];
+	return true;
+}
+
+void GPUProfiler::LogStats() {
+	if (!supported) {
+		return;
+	}
+
+	Log("GPU timings over the last %d frames (%d frames dropped):", mini(frameNumber, GPU_PROFILER_HISTORY), droppedFrames);
+	for (uint32_t i = 0; i < numPasses; i++) {
+		float minMs, avgMs, p99Ms;
+		if (GetStats(passes[i].name, minMs, avgMs, p99Ms)) {
+			Log("  %-16s min %7.3f ms  avg %7.3f ms  p99 %7.3f ms", passes[i].name, minMs, avgMs, p99Ms);
+		}
+	}
+}
+
+bool GPUProfiler::SaveCSV(const char* filename) {
+	FILE* f = NULL;
+	fopen_s(&f, filename, "w");
+	if (!f) {
+		Log("Unable to write GPU timings to '%s'", filename);
+		return false;
+	}
+
+	fprintf(f, "frame,pass,gpu_ms\n");
+	for (uint32_t i = 0; i < numPasses; i++) {
+		// oldest sample first
+		uint32_t count = mini(passes[i].count, GPU_PROFILER_HISTORY);
+		uint32_t first = passes[i].count - count;
+		for (uint32_t s = first; s < passes[i].count; s++) {
+			const GPUPassSample& sample = passes[i].samples[s % GPU_PROFILER_HISTORY];
+			fprintf(f, "%d,%s,%.4f\n", sample.frame, passes[i].name, sample.ms);
+		}
+	}
+	fclose(f);
+
+	return true;
+}
+
+GPUProfiler* GetGPUProfiler() {
+	static GPUProfiler* profiler = NULL;
+	if (!profiler) {
+		profiler = new GPUProfiler();
+	}
+	return profiler;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "SpecViz.h"
+
+// frames of timestamp queries kept in flight. Results are read back once the GPU has caught up, so the profiler never
+// waits on it
+#define GPU_PROFILER_LATENCY 4
+
+// most passes (including nested ones) that can be timed in a single frame
+#define GPU_PROFILER_MAX_PASSES 16
+
+// deepest passes can nest, counting the ones that couldn't be timed
+#define GPU_PROFILER_MAX_DEPTH 32
+
+// open pass entry for a pass that isn't being timed, so its EndPass still closes the right pass
+#define GPU_PROFILER_UNTIMED 0xFFFFFFFF
+
+// samples kept per pass for the rolling statistics
+#define GPU_PROFILER_HISTORY 256
+
+// a single timing of a pass
+struct GPUPassSample {
+	uint32_t frame;
+	float ms;
+};
+
+// measures how long the GPU spends on named passes of each frame using GL_TIMESTAMP queries. Passes may nest, and the
+// whole frame is timed as the "frame" pass. Keeps a rolling history per pass for min/avg/p99 statistics, which are
+// logged periodically and can be saved as CSV. Does nothing when the driver lacks timer queries
+class GPUProfiler {
+protected:
+	// timing history of a pass
+	struct PassHistory {
+		const char* name;
+		GPUPassSample samples[GPU_PROFILER_HISTORY];
+		uint32_t count;						// samples recorded in total (the history keeps the latest)
+	};
+
+	// the queries issued for a frame
+	struct FrameQueries {
+		GLuint queries[GPU_PROFILER_MAX_PASSES * 2];	// begin and end timestamp of each pass
+		uint32_t passes[GPU_PROFILER_MAX_PASSES];		// history index of each pass
+		uint32_t numPasses;
+		uint32_t frame;
+		bool pending;									// waiting on the GPU for results
+	};
+
+	bool supported;
+	PassHistory passes[GPU_PROFILER_MAX_PASSES];
+	uint32_t numPasses;
+	FrameQueries frames[GPU_PROFILER_LATENCY];
+	uint32_t frameNumber;
+	FrameQueries* current;
+
+	// passes begun but not yet ended this frame (indices into current's queries, or GPU_PROFILER_UNTIMED)
+	uint32_t openPasses[GPU_PROFILER_MAX_DEPTH];
+	uint32_t numOpen;
+
+	uint32_t droppedFrames;			// frames whose results weren't ready when their queries were needed again
+
+	// returns the history index for the named pass, adding it if needed (GPU_PROFILER_MAX_PASSES if there's no room)
+	uint32_t FindPass(const char* name);
+
+	// reads back the results of every frame the GPU has finished
+	void CollectResults();
+
+public:
+	GPUProfiler();
+	virtual ~GPUProfiler();
+
+	// starts timing a frame, reading back results from earlier frames that are ready
+	void BeginFrame();
+
+	// finishes timing the frame, logging the statistics every so often
+	void EndFrame();
+
+	// starts timing a pass with the given name (a string that outlives the profiler, such as a literal)
+	void BeginPass(const char* name);
+
+	// ends the most recently begun pass
+	void EndPass();
+
+	// gets the rolling statistics in milliseconds for the named pass, returning false if it has no samples
+	bool GetStats(const char* name, float& minMs, float& avgMs, float& p99Ms);
+
+	// logs the rolling statistics of every pass
+	void LogStats();
+
+	// writes the sample history of every pass to a CSV file (frame, pass, gpu_ms)
+	bool SaveCSV(const char* filename);
+};
+
+// returns the GPU profiler for the main GL context, creating it on first use
+GPUProfiler* GetGPUProfiler();
@@ -1,26 +1,45 @@
 
 // This file contains object oriented graphics declarations using OpenGL
 
-// macro that throws an assertion if OpenGL encounters an error
+// macro that throws an assertion if OpenGL encounters an error. glGetError makes many drivers wait on their command
+// threads, so release builds leave it out entirely and errors reach the log through the debug output callback instead
+// (see InitDebugOutput)
+#ifdef _DEBUG
 #define GLCHECK() { assert(glGetError() == 0); }
+#else
+#define GLCHECK() {}
+#endif
+
+// returns true if buffers, VAOs and textures are created and filled through GL 4.5 direct state access (with immutable
+// storage), which never touches the bindings used for drawing. Otherwise they're bound to be edited
+bool IsDirectStateAccessSupported();
 
 // root gl shader class for convenience. Reads shader from a file by default
 class Shader {
 protected:
-	GLuint shaderId;			// shader identifier via OpenGL
+	GLuint shaderId;			// shader identifier via OpenGL (0 until compiled)
+	GLenum type;				// shader type (GL_VERTEX_SHADER, etc)
 	const char* code;			// locally allocated string of the shader code
 
 public:
 	// creates an instances of this shader from the provided file path with the given predefined macros
-	Shader(const char* filePath, const char* predefine);	
+	Shader(const char* filePath, const char* predefine, GLenum withType);
+	virtual ~Shader();
 
-	// compiles the created shader instance from its code
-	void Compile();
+	// compiles the created shader instance from its code. Compiling is deferred until a ShaderProgram actually needs
+	// it, which it won't when the linked program is in the program binary cache. Unless wait is set the compile is
+	// only issued, and errors are reported by a later Compile(true)
+	void Compile(bool wait = true);
 
 	// returns the OpenGL shader ID for this shader
 	GLuint GetId() const {
 		return shaderId;
 	}
+
+	// returns the shader code (including predefines)
+	const char* GetCode() const {
+		return code;
+	}
 };
 
 // encapsulates a gl pixel shader
@@ -45,22 +64,131 @@ public:
 	VertexShader(const char* path, const char* predefine);
 };
 
+// uniform block binding point of the shared Camera block
+#define CAMERA_BLOCK_BINDING 0
+
+// uniform block binding point of the multi projection Projections block
+#define PROJECTION_BLOCK_BINDING 1
+
+// most projections a multi projection view can hold. Sized so the Projections block fits in the 16 KB of uniform
+// block every driver supports (must match the shaders)
+#define MAX_PROJECTIONS 200
+
+// per program uniforms, whose locations are looked up once when a program is linked
+enum UniformId {
+	UNIFORM_ALPHA,
+	UNIFORM_TEX_MATRIX,
+	UNIFORM_COLOR_MAP,
+	UNIFORM_NORMAL_MAP,
+	UNIFORM_SCALE,
+	UNIFORM_NUM_PROJECTIONS,
+	UNIFORM_FIRST_PROJECTION,
+	UNIFORM_PROJECTION_TABLE,
+	UNIFORM_PROJECTION_VISIBILITY,
+	UNIFORM_USE_VISIBILITY,
+	UNIFORM_VISIBILITY_WORDS,
+	UNIFORM_GBUFFER_POSITION,
+	UNIFORM_GBUFFER_NORMAL,
+	UNIFORM_GBUFFER_TRIANGLE,
+	NUM_UNIFORMS
+};
+
 // encapsulates a gl shader program
 class ShaderProgram {
 protected:
-	GLuint programId;	// shader program ID as represented in OpenGL
+	GLuint programId;				// shader program ID as represented in OpenGL
+	GLint uniforms[NUM_UNIFORMS];	// uniform locations by UniformId (-1 for uniforms the program doesn't use)
+
+	// shaders the program is built from, and the state of a link that has been issued but not finished
+	PixelShader* pShader;
+	VertexShader* vShader;
+	bool linking;
+	double startTime;
+
+	// program binary cache entry for this program
+	bool useCache;
+	uint64_t key;
+	char cachePath[64];
+
+	// tries to create the program from its binary cache file
+	bool LoadBinary();
+
+	// writes the linked program to its binary cache file
+	void SaveBinary();
+
+	// binds uniform blocks and fills in the uniform table once the program is linked
+	void SetupUniforms();
 
 public:
-	// creates and links a ShaderProgram given the two compiled pixel and vertex instances
-	ShaderProgram(PixelShader* pShader, VertexShader* vShader);
+	// creates and links a ShaderProgram given the pixel and vertex shaders. The linked program is loaded from the
+	// on-disk program binary cache when possible, and only compiled and linked (then cached) otherwise. A deferred
+	// program only issues its compile and link; Finish() must be called before it is used
+	ShaderProgram(PixelShader* pShader, VertexShader* vShader, bool deferred = false);
+	virtual ~ShaderProgram();
+
+	// returns true if Finish() can be called without waiting for the driver to finish compiling
+	bool IsReady();
+
+	// waits for a deferred program's link to complete and makes it ready for use
+	void Finish();
+
+	// returns true if the driver compiles and links programs on its own threads (KHR_parallel_shader_compile)
+	static bool IsParallelCompileSupported();
 
 	// binds the shader program for drawining
 	void Bind();
 
-	// gets the uniform index for the uniform with the given name
+	// returns the uniform location for the given uniform from the table built at link time
+	GLint GetUniform(UniformId id) const {
+		return uniforms[id];
+	}
+
+	// gets the uniform index for the uniform with the given name (a driver lookup, so keep it out of per frame code)
 	GLint GetUniform(const char* name);
 };
 
+// camera and light state shared by every program through the std140 "Camera" uniform block. The vec3s are padded out
+// to the 16 byte alignment std140 gives them
+struct CameraBlock {
+	glm::mat4 objMatrix;
+	glm::mat4 viewMatrix;
+	glm::mat4 projMatrix;
+	glm::vec3 eyePosition;
+	float padding0;
+	glm::vec3 lightDirection;
+	float padding1;
+
+	CameraBlock() : padding0(0.0f), padding1(0.0f) {
+	}
+
+	CameraBlock(const glm::mat4& withObj, const glm::mat4& withView, const glm::mat4& withProj, const glm::vec3& withEye,
+		const glm::vec3& withLight) : objMatrix(withObj), viewMatrix(withView), projMatrix(withProj), eyePosition(withEye),
+		padding0(0.0f), lightDirection(withLight), padding1(0.0f) {
+	}
+};
+
+// GLSL declaration of CameraBlock. Shader inserts it into every shader after the #version line (and any predefine), so
+// this is the one copy of the layout to keep in step with the struct
+#define CAMERA_BLOCK_GLSL \
+	"layout(std140) uniform Camera {\n" \
+	"	mat4 objMatrix;\n" \
+	"	mat4 viewMatrix;\n" \
+	"	mat4 projMatrix;\n" \
+	"	vec3 eyePosition;\n" \
+	"	vec3 lightDirection;\n" \
+	"};\n"
+
+// uploads the camera block for this frame, which every program sees at CAMERA_BLOCK_BINDING. Nothing is sent when the
+// camera hasn't changed since the last call
+void SetCameraBlock(const CameraBlock& camera);
+
+// matrices of every projection in a multi projection view, shared with the shaders through the std140 "Projections"
+// uniform block. Each projection's image sits in the corner of its texture array layer, covering uvScale of it
+struct ProjectionBlock {
+	glm::mat4 texMatrix[MAX_PROJECTIONS];
+	glm::vec4 uvScale[MAX_PROJECTIONS];
+};
+
 // Encapsulates a gl vertex array buffer
 class VertexBuffer {
 	GLuint buffer;		// the buffer according to OpenGL
@@ -72,6 +200,9 @@ public:
 	// destructor
 	virtual ~VertexBuffer();
 
+	// replaces dataSize bytes of the buffer contents starting at the given byte offset
+	void Update(uint32_t offset, const void* data, uint32_t dataSize);
+
 	GLuint GetId() const {
 		return buffer;
 	}
@@ -88,6 +219,9 @@ public:
 	IndexBuffer(void* data, uint32_t dataSize, GLenum drawType);
 	virtual ~IndexBuffer();
 
+	// replaces dataSize bytes of the index data starting at the given byte offset
+	void Update(uint32_t offset, const void* data, uint32_t dataSize);
+
 	// returns the index buffer id according to OpenGL
 	GLuint GetId() const {
 		return buffer;
@@ -104,13 +238,57 @@ public:
 	}
 };
 
+// Encapsulates a gl uniform buffer attached to a uniform block binding point
+class UniformBuffer {
+	GLuint buffer;			// the buffer id according to OpenGL
+	uint32_t size;			// size of the buffer in bytes
+
+public:
+	// creates a uniform buffer of the given size and attaches it to the given binding point
+	UniformBuffer(uint32_t dataSize, GLuint binding);
+	virtual ~UniformBuffer();
+
+	// replaces the entire contents of the buffer
+	void Update(const void* data);
+
+	GLuint GetId() const {
+		return buffer;
+	}
+};
+
+// Encapsulates a gl buffer texture, which gives shaders texelFetch access to a large array of data
+class BufferTexture {
+	GLuint buffer;			// the buffer id according to OpenGL
+	GLuint texture;			// the texture id the buffer is viewed through
+	GLenum format;			// texel format the buffer is viewed as
+	uint32_t size;			// size of the buffer in bytes
+
+public:
+	// creates a buffer texture viewing the given data as texels of the given format (GL_RGBA16UI, GL_R32F, etc)
+	BufferTexture(const void* data, uint32_t dataSize, GLenum withFormat);
+	virtual ~BufferTexture();
+
+	// replaces the entire contents of the buffer, which may change size
+	void Update(const void* data, uint32_t dataSize);
+
+	// binds the buffer texture to the given sampler ID
+	void Bind(uint32_t samplerId);
+};
+
+// attribute locations of the static per vertex projection data (see BuildProjectedAttributes). Facing amounts take
+// one location per four projections and projected UVs one per two, so 16 projections fill every location up to 16
+#define PROJECTED_FACING_ATTRIB 4
+#define PROJECTED_UV_ATTRIB 8
+
 // Encapsulates a vertex array object
 class VAO {
 protected:
-	GLuint id;		// vao id according to OpenGL
+	GLuint id;				// vao id according to OpenGL
+	GLuint vertexBuffer;	// the vertex buffer the standard attributes read from
 public:
 	// creates a VAO binding given the vertex buffer and index buffer
 	VAO(VertexBuffer* withVerts, IndexBuffer* withIndices);
+	~VAO();
 
 	// binds the VAO For drawing
 	void Bind();
@@ -118,26 +296,88 @@ public:
 	// enables arrays using the VAO with the given number of attributes
 	void EnableArrays(int32_t count);
 
+	// enables an extra attribute at the given location, read from its own vertex buffer rather than the one the VAO
+	// was created with
+	void AddArray(VertexBuffer* buffer, uint32_t location, int32_t components, GLenum type, bool normalized,
+		int32_t stride, uint32_t offset);
+
 	// unbinds any VAO (should be used prior to deletion)
 	static void Unbind();
 };
 
+// highest anisotropy used for mipmapped textures (clamped to what the driver supports)
+#define TEXTURE_MAX_ANISOTROPY 8.0f
+
+// how a texture is sampled
+enum TextureFilter {
+	TEXTURE_FILTER_NEAREST,		// single level, nearest texel (exact pixel values, but aliases and thrashes the texture cache when minified)
+	TEXTURE_FILTER_TRILINEAR,	// full mip chain with trilinear and anisotropic filtering
+};
+
 // encapsulates a gl texture
 class Texture { 
 protected:
 	GLuint textureId;			// texture ID according to OpenGL
+	GLenum target;				// GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for texture arrays
 	GLuint width;				// texture width in pixels
 	GLuint height;				// texture height in pixels
+	uint32_t layers;			// layers of a texture array (0 otherwise)
 	GLenum format;				// texture format (GL_RGBA8, etc)
+	TextureFilter filter;		// how the texture is sampled
+	uint32_t numLevels;			// mip levels in the texture's storage
 	
 	// helper functions for generating texture in OpenGL with this texture object
 	GLenum GetInternal(GLenum format);
 	GLenum GetFormat(GLenum format);
 	GLenum GetDataType(GLenum format);
 
+	// returns the size of a single pixel of the given format in bytes
+	static uint32_t GetPixelSize(GLenum format);
+
+	// derived textures fill in their own description
+	Texture() {}
+
+	// creates the OpenGL texture described by this object, setting up its sampling and storage (it's left bound to
+	// unit 0 unless direct state access is used). Returns true if the storage of every level is allocated (levels are
+	// then filled in with glTexSubImage)
+	bool Create();
+
+	// sets the filtering, mip range and wrapping of the texture (bound, without direct state access)
+	void SetParameters();
+
+	// sends up a single mip level of the given layer (ignored for plain textures)
+	void UploadLevel(uint32_t level, uint32_t layer, uint32_t levelWidth, uint32_t levelHeight, const void* data,
+		bool allocated);
+
+	// sends up the given image as the given layer, building each mip level from the one before it on the CPU
+	void UploadLevels(uint32_t layer, const void* data, bool allocated);
+
 public:
-	// creates a texture with the given texture data and format
-	Texture(void* data, uint32_t withWidth, uint32_t withHeight, GLenum withFormat);
+	// creates a texture with the given texture data and format. Trilinear textures get a full mip chain built from the
+	// data on the CPU
+	Texture(void* data, uint32_t withWidth, uint32_t withHeight, GLenum withFormat,
+		TextureFilter withFilter = TEXTURE_FILTER_TRILINEAR);
+	virtual ~Texture();
+
+	// returns the number of mip levels for a texture of the given size
+	static uint32_t GetNumLevels(uint32_t width, uint32_t height);
+
+	// returns the size in bytes of a single level of the given size and format (including compressed formats)
+	static uint32_t GetLevelSize(GLenum format, uint32_t width, uint32_t height);
+
+	// box filters the given image of the given format down to the next mip level (half size, rounded down but at least
+	// 1) into the given memory
+	static void GenerateMip(const void* data, uint32_t width, uint32_t height, GLenum format, void* intoMip);
+
+	// builds the first numLevels mip levels of the given image of the given format, calling func(level, levelWidth,
+	// levelHeight, levelData) with each level, largest first. Each level's data is only valid during its call
+	static void BuildMipChain(const void* data, uint32_t width, uint32_t height, GLenum format, uint32_t numLevels,
+		const std::function<void(uint32_t, uint32_t, uint32_t, const void*)>& func);
+
+	// returns the format of the texture
+	GLenum GetTextureFormat() const {
+		return format;
+	}
 
 	// returns the aspect ratio of the texture as a floating point
 	float GetAspect() const {
@@ -158,13 +398,135 @@ public:
 	void Bind(uint32_t samplerId);
 	
 	// using FreeImage, create a texture image fro the given image path with the desired format
-	static Texture* CreateFromFile(const char* filePath, GLenum desiredFormat);
+	static Texture* CreateFromFile(const char* filePath, GLenum desiredFormat,
+		TextureFilter filter = TEXTURE_FILTER_TRILINEAR);
 
 	// using FreeImage, create an RGBA8 texture using the image wirh rgbPath for the color channels, and the
 	// image with alphaPath as the alpha channel (a combined image)
-	static Texture* CreateFromFileCombined(const char* rgbPath, const char* alphaPath);
+	static Texture* CreateFromFileCombined(const char* rgbPath, const char* alphaPath,
+		TextureFilter filter = TEXTURE_FILTER_TRILINEAR);
+
+	// using FreeImage, loads the combined image CreateFromFileCombined would use as RGBA8 pixels (allocated with
+	// malloc), returning NULL if the color image can't be loaded
+	static uint8_t* LoadFileCombined(const char* rgbPath, const char* alphaPath, uint32_t& intoWidth, uint32_t& intoHeight);
+
+	// using FreeImage, loads the red channel of the image at the given path as 8 bit pixels (allocated with malloc),
+	// returning NULL if it can't be loaded
+	static uint8_t* LoadFileChannel(const char* filePath, uint32_t& intoWidth, uint32_t& intoHeight);
+
+	// using FreeImage, reads the size of the image at the given path (without decoding it, where the format allows)
+	static bool GetImageSize(const char* filePath, uint32_t& intoWidth, uint32_t& intoHeight);
 
 	// save the given image data as a PNG using FreeImage with the optional target size (otherwise it will save with the same source size)
 	static void SavePNG(const char* filename, uint32_t width, uint32_t height, uint8_t* colors,
 		uint32_t destWidth = 0, uint32_t destHeight = 0);
+};
+
+// encapsulates a gl 2D texture array, whose layers share a size and format and are sampled through one sampler
+class TextureArray : public Texture {
+public:
+	// creates an empty texture array of the given size, number of layers and format
+	TextureArray(uint32_t withWidth, uint32_t withHeight, uint32_t withLayers, GLenum withFormat,
+		TextureFilter withFilter = TEXTURE_FILTER_TRILINEAR);
+
+	// returns the number of layers
+	uint32_t GetLayers() const {
+		return layers;
+	}
+
+	// fills in a layer from an image of the array's size and (uncompressed) format, building its mips on the CPU
+	void SetLayer(uint32_t layer, const void* data);
+
+	// fills in a layer of a compressed array from the blocks of every mip level, largest first
+	void SetLayerCompressed(uint32_t layer, const void* blocks);
+};
+
+// most color attachments a render target can have
+#define MAX_RENDER_TARGET_COLORS 4
+
+// encapsulates a gl frame buffer with texture color attachments (that can be sampled once drawn) and a depth buffer
+class RenderTarget {
+protected:
+	GLuint frameBuffer;								// frame buffer ID according to OpenGL
+	GLuint depthBuffer;								// depth render buffer
+	GLuint colorTextures[MAX_RENDER_TARGET_COLORS];	// color attachment textures
+	uint32_t numColors;
+	uint32_t width;
+	uint32_t height;
+
+	// frame buffer and viewport to return to when unbound
+	GLint savedFrameBuffer;
+	GLint savedViewport[4];
+
+public:
+	// creates a render target of the given size with a color attachment texture of each of the given formats (GL_RGBA8,
+	// GL_RGBA16F, GL_R32UI, etc) and a 24 bit depth buffer
+	RenderTarget(uint32_t withWidth, uint32_t withHeight, const GLenum* colorFormats, uint32_t withNumColors);
+	virtual ~RenderTarget();
+
+	uint32_t GetWidth() const {
+		return width;
+	}
+
+	uint32_t GetHeight() const {
+		return height;
+	}
+
+	// draws into every color attachment from now on, over the whole target
+	void Bind();
+
+	// returns to drawing into the frame buffer and viewport that were in use when Bind was called
+	void Unbind();
+
+	// binds the given color attachment texture to the given sampler ID
+	void BindColor(uint32_t index, uint32_t samplerId);
+};
+
+// texture units whose bindings are tracked (for the GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY and GL_TEXTURE_BUFFER targets)
+#define GL_STATE_TEXTURE_UNITS 16
+
+// tracks the bindings and raster state of the main GL context, so that changes to state that's already in effect
+// never reach the driver. The binding wrappers (ShaderProgram::Bind, Texture::Bind, VAO::Bind, etc) and the viewers'
+// raster state setup go through it instead of calling GL themselves. Calls made on other threads (which draw with
+// their own contexts) and before Init go straight through. Counts the calls issued and skipped each frame
+class GLState {
+public:
+	// starts tracking the context current on the calling thread, with every piece of state unknown
+	static void Init();
+
+	// forgets all the tracked state, for after something outside the cache has changed it
+	static void Invalidate();
+
+	static void UseProgram(GLuint program);
+
+	// drops a program that's about to be deleted from the tracked binding, as its ID may be reused
+	static void ForgetProgram(GLuint program);
+	static void BindVertexArray(GLuint vertexArray);
+
+	// drops a vertex array that's about to be deleted from the tracked binding, as GL unbinds it (and may reuse its ID)
+	static void ForgetVertexArray(GLuint vertexArray);
+
+	// binds the texture to the given target of the given unit, leaving that unit active (as glTexImage2D and the like
+	// expect)
+	static void BindTexture(uint32_t unit, GLenum target, GLuint texture);
+
+	// drops a texture that's about to be deleted from the tracked bindings, as GL unbinds it (and may reuse its ID)
+	static void ForgetTexture(GLuint texture);
+
+	// raster state. Enable and Disable track GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE and GL_RASTERIZER_DISCARD
+	static void Enable(GLenum capability);
+	static void Disable(GLenum capability);
+	static void DepthMask(bool write);
+	static void DepthFunc(GLenum func);
+	static void BlendFunc(GLenum source, GLenum destination);
+	static void ColorMask(bool write);
+
+	// finishes counting a frame's calls, logging the counts every so often
+	static void EndFrame();
+
+	// gets the calls issued to GL and skipped as redundant over the last finished frame
+	static void GetFrameStats(uint32_t& issued, uint32_t& skipped);
+
+	// logs the counts of the last finished frame
+	static void LogStats();
 };
\ No newline at end of file
@@ -0,0 +1,599 @@
+#include "MeshArchive.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+#define ARCHIVE_VERSION 1
+
+// vertices and indices per independently decodable block
+#define VERTICES_PER_BLOCK 65536
+#define INDICES_PER_BLOCK (3 * 65536)
+
+// number of byte planes a vertex is split into: position xyz, uv and octahedral normal as 16 bit lo/hi planes and
+// the four 8 bit color channels
+#define POSITION_PLANES 6
+#define UV_PLANES 4
+#define NORMAL_PLANES 4
+#define COLOR_PLANES 4
+#define VERTEX_PLANES (POSITION_PLANES + UV_PLANES + NORMAL_PLANES + COLOR_PLANES)
+
+// rANS coder parameters (32 bit state, byte wise renormalization)
+#define RANS_PROB_BITS 12
+#define RANS_PROB_SCALE (1 << RANS_PROB_BITS)
+#define RANS_L (1u << 23)
+
+// archive file header, followed by a table of the compressed size of every block and then the blocks themselves
+// (all vertex blocks, then all index blocks)
+struct MeshArchiveHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t numVertexBlocks;
+	uint32_t numIndexBlocks;
+	float boundMin[3];
+	float boundMax[3];
+	float centerOffset[3];
+	float positionMin[3];		// position quantization: position = positionMin + q * positionStep
+	float positionStep[3];
+	float uvMin[2];				// uv quantization: uv = uvMin + q * uvStep
+	float uvStep[2];
+};
+
+// helpers for writing and reading little endian values to byte arrays
+static void WriteU16(std::vector<uint8_t>& out, uint32_t value) {
+	out.push_back((uint8_t) value);
+	out.push_back((uint8_t) (value >> 8));
+}
+
+static void WriteU32(std::vector<uint8_t>& out, uint32_t value) {
+	out.push_back((uint8_t) value);
+	out.push_back((uint8_t) (value >> 8));
+	out.push_back((uint8_t) (value >> 16));
+	out.push_back((uint8_t) (value >> 24));
+}
+
+struct ByteReader {
+	const uint8_t* cur;
+	const uint8_t* end;
+	bool failed;
+
+	ByteReader(const uint8_t* withData, uint32_t size) : cur(withData), end(withData + size), failed(false) {
+	}
+
+	uint32_t ReadU8() {
+		if (cur + 1 > end) { failed = true; return 0; }
+		return *cur++;
+	}
+
+	uint32_t ReadU16() {
+		if (cur + 2 > end) { failed = true; return 0; }
+		uint32_t ret = cur[0] | (cur[1] << 8);
+		cur += 2;
+		return ret;
+	}
+
+	uint32_t ReadU32() {
+		if (cur + 4 > end) { failed = true; return 0; }
+		uint32_t ret = cur[0] | (cur[1] << 8) | (cur[2] << 16) | ((uint32_t) cur[3] << 24);
+		cur += 4;
+		return ret;
+	}
+};
+
+// scales the symbol counts so they sum to RANS_PROB_SCALE, keeping every used symbol at a frequency of at least 1
+static void NormalizeFrequencies(const uint32_t* counts, uint32_t total, uint32_t* freqs) {
+	uint32_t sum = 0;
+	uint32_t largest = 0;
+	for (uint32_t s = 0; s < 256; s++) {
+		freqs[s] = 0;
+		if (counts[s]) {
+			freqs[s] = (uint32_t) ((uint64_t) counts[s] * RANS_PROB_SCALE / total);
+			if (freqs[s] == 0) {
+				freqs[s] = 1;
+			}
+			sum += freqs[s];
+			if (freqs[s] > freqs[largest]) {
+				largest = s;
+			}
+		}
+	}
+
+	// rounding leaves the sum short; give the remainder to the most common symbol
+	if (sum < RANS_PROB_SCALE) {
+		freqs[largest] += RANS_PROB_SCALE - sum;
+		return;
+	}
+
+	// rare symbols bumped up to 1 can push the sum over; take the excess from the most common symbols
+	while (sum > RANS_PROB_SCALE) {
+		uint32_t best = 0;
+		for (uint32_t s = 1; s < 256; s++) {
+			if (freqs[s] > freqs[best]) {
+				best = s;
+			}
+		}
+		uint32_t take = sum - RANS_PROB_SCALE;
+		if (take > freqs[best] - 1) {
+			take = freqs[best] - 1;
+		}
+		freqs[best] -= take;
+		sum -= take;
+	}
+}
+
+// entropy codes a stream of bytes and appends it to out as: raw length, symbol frequency table, coded length, coded bytes
+static void EncodeStream(const uint8_t* data, uint32_t length, std::vector<uint8_t>& out) {
+	WriteU32(out, length);
+	if (!length) {
+		return;
+	}
+
+	uint32_t counts[256] = { 0 };
+	for (uint32_t i = 0; i < length; i++) {
+		counts[data[i]]++;
+	}
+
+	uint32_t freqs[256];
+	uint32_t cumulative[256];
+	NormalizeFrequencies(counts, length, freqs);
+
+	uint32_t numSymbols = 0;
+	uint32_t cum = 0;
+	for (uint32_t s = 0; s < 256; s++) {
+		cumulative[s] = cum;
+		cum += freqs[s];
+		if (freqs[s]) {
+			numSymbols++;
+		}
+	}
+
+	WriteU16(out, numSymbols);
+	for (uint32_t s = 0; s < 256; s++) {
+		if (freqs[s]) {
+			out.push_back((uint8_t) s);
+			WriteU16(out, freqs[s]);
+		}
+	}
+
+	// rANS encodes in reverse so that decoding runs forward. Each symbol costs at most RANS_PROB_BITS bits
+	std::vector<uint8_t> coded(length * 2 + 16);
+	uint8_t* codedEnd = &coded[0] + coded.size();
+	uint8_t* ptr = codedEnd;
+	uint32_t x = RANS_L;
+	for (int32_t i = (int32_t) length - 1; i >= 0; i--) {
+		uint32_t s = data[i];
+		uint32_t freq = freqs[s];
+		uint32_t xMax = ((RANS_L >> RANS_PROB_BITS) << 8) * freq;
+		while (x >= xMax) {
+			*--ptr = (uint8_t) x;
+			x >>= 8;
+		}
+		x = ((x / freq) << RANS_PROB_BITS) + (x % freq) + cumulative[s];
+	}
+	ptr -= 4;
+	ptr[0] = (uint8_t) x;
+	ptr[1] = (uint8_t) (x >> 8);
+	ptr[2] = (uint8_t) (x >> 16);
+	ptr[3] = (uint8_t) (x >> 24);
+
+	WriteU32(out, codedEnd - ptr);
+	out.insert(out.end(), ptr, codedEnd);
+}
+
+// decodes a stream written by EncodeStream
+static bool DecodeStream(ByteReader& reader, std::vector<uint8_t>& out) {
+	uint32_t length = reader.ReadU32();
+	out.resize(length);
+	if (!length || reader.failed) {
+		return !reader.failed;
+	}
+
+	uint32_t freqs[256] = { 0 };
+	uint32_t cumulative[256];
+	uint32_t numSymbols = reader.ReadU16();
+	for (uint32_t i = 0; i < numSymbols; i++) {
+		uint32_t s = reader.ReadU8();
+		freqs[s] = reader.ReadU16();
+	}
+
+	// build the slot to symbol lookup, validating the table along the way
+	uint8_t slotSymbol[RANS_PROB_SCALE];
+	uint32_t cum = 0;
+	for (uint32_t s = 0; s < 256; s++) {
+		cumulative[s] = cum;
+		if (cum + freqs[s] > RANS_PROB_SCALE) {
+			return false;
+		}
+		memset(slotSymbol + cum, s, freqs[s]);
+		cum += freqs[s];
+	}
+	if (cum != RANS_PROB_SCALE) {
+		return false;
+	}
+
+	uint32_t codedLength = reader.ReadU32();
+	if (reader.failed || codedLength < 4 || reader.cur + codedLength > reader.end) {
+		return false;
+	}
+	const uint8_t* ptr = reader.cur;
+	const uint8_t* ptrEnd = reader.cur + codedLength;
+	reader.cur = ptrEnd;
+
+	uint32_t x = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t) ptr[3] << 24);
+	ptr += 4;
+	for (uint32_t i = 0; i < length; i++) {
+		uint32_t slot = x & (RANS_PROB_SCALE - 1);
+		uint32_t s = slotSymbol[slot];
+		out[i] = (uint8_t) s;
+		x = freqs[s] * (x >> RANS_PROB_BITS) + slot - cumulative[s];
+		while (x < RANS_L && ptr < ptrEnd) {
+			x = (x << 8) | *ptr++;
+		}
+	}
+
+	return true;
+}
+
+// zigzag coding maps small signed deltas to small unsigned values
+static inline uint32_t ZigZag16(uint16_t delta) {
+	int16_t d = (int16_t) delta;
+	return (uint16_t) ((d << 1) ^ (d >> 15));
+}
+
+static inline uint16_t UnZigZag16(uint32_t value) {
+	return (uint16_t) ((value >> 1) ^ (0 - (value & 1)));
+}
+
+static inline uint32_t ZigZag8(uint8_t delta) {
+	int8_t d = (int8_t) delta;
+	return (uint8_t) ((d << 1) ^ (d >> 7));
+}
+
+static inline uint8_t UnZigZag8(uint32_t value) {
+	return (uint8_t) ((value >> 1) ^ (0 - (value & 1)));
+}
+
+// quantizes value to 16 bits given the range minimum and step size
+static inline uint16_t Quantize16(float value, float minimum, float step) {
+	float q = (value - minimum) / step + 0.5f;
+	if (q < 0.0f) return 0;
+	if (q > 65535.0f) return 65535;
+	return (uint16_t) q;
+}
+
+// octahedral normal encoding to two 16 bit values
+static void EncodeNormal(const glm::vec3& n, uint16_t& u, uint16_t& v) {
+	float len = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	glm::vec2 p = len > 0.0f ? glm::vec2(n.x, n.y) / len : glm::vec2(0.0f, 0.0f);
+	if (n.z < 0.0f) {
+		glm::vec2 folded((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+		p = folded;
+	}
+	u = Quantize16(p.x, -1.0f, 2.0f / 65535.0f);
+	v = Quantize16(p.y, -1.0f, 2.0f / 65535.0f);
+}
+
+static glm::vec3 DecodeNormal(uint16_t u, uint16_t v) {
+	glm::vec2 p(u * (2.0f / 65535.0f) - 1.0f, v * (2.0f / 65535.0f) - 1.0f);
+	glm::vec3 n(p.x, p.y, 1.0f - fabs(p.x) - fabs(p.y));
+	if (n.z < 0.0f) {
+		n.x = (1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(n);
+}
+
+// splits a block of vertices into delta coded byte planes and entropy codes each plane
+static void EncodeVertexBlock(const MeshArchiveHeader& header, const PlyVertex* verts, uint32_t count, std::vector<uint8_t>& out) {
+	std::vector<uint8_t> planes(count * VERTEX_PLANES);
+	uint16_t prev[7] = { 0 };
+	uint8_t prevColor[4] = { 0 };
+
+	for (uint32_t i = 0; i < count; i++) {
+		const PlyVertex& vert = verts[i];
+		uint16_t q[7];
+		for (uint32_t a = 0; a < 3; a++) {
+			q[a] = Quantize16(vert.position[a], header.positionMin[a], header.positionStep[a]);
+		}
+		q[3] = Quantize16(vert.uv.x, header.uvMin[0], header.uvStep[0]);
+		q[4] = Quantize16(vert.uv.y, header.uvMin[1], header.uvStep[1]);
+		EncodeNormal(vert.normal, q[5], q[6]);
+
+		for (uint32_t c = 0; c < 7; c++) {
+			uint32_t z = ZigZag16((uint16_t) (q[c] - prev[c]));
+			planes[(c * 2) * count + i] = (uint8_t) z;
+			planes[(c * 2 + 1) * count + i] = (uint8_t) (z >> 8);
+			prev[c] = q[c];
+		}
+
+		for (uint32_t c = 0; c < 4; c++) {
+			float value = vert.color[c] < 0.0f ? 0.0f : (vert.color[c] > 1.0f ? 1.0f : vert.color[c]);
+			uint8_t color = (uint8_t) (value * 255.0f + 0.5f);
+			planes[(14 + c) * count + i] = (uint8_t) ZigZag8((uint8_t) (color - prevColor[c]));
+			prevColor[c] = color;
+		}
+	}
+
+	for (uint32_t p = 0; p < VERTEX_PLANES; p++) {
+		EncodeStream(&planes[p * count], count, out);
+	}
+}
+
+// decodes a block written by EncodeVertexBlock directly into the destination vertices
+static bool DecodeVertexBlock(const MeshArchiveHeader& header, const uint8_t* data, uint32_t size, PlyVertex* verts, uint32_t count) {
+	ByteReader reader(data, size);
+	std::vector<uint8_t> planes[VERTEX_PLANES];
+	for (uint32_t p = 0; p < VERTEX_PLANES; p++) {
+		if (!DecodeStream(reader, planes[p]) || planes[p].size() != count) {
+			return false;
+		}
+	}
+
+	uint16_t prev[7] = { 0 };
+	uint8_t prevColor[4] = { 0 };
+	for (uint32_t i = 0; i < count; i++) {
+		uint16_t q[7];
+		for (uint32_t c = 0; c < 7; c++) {
+			q[c] = prev[c] + UnZigZag16(planes[c * 2][i] | (planes[c * 2 + 1][i] << 8));
+			prev[c] = q[c];
+		}
+
+		PlyVertex& vert = verts[i];
+		for (uint32_t a = 0; a < 3; a++) {
+			vert.position[a] = header.positionMin[a] + q[a] * header.positionStep[a];
+		}
+		vert.uv.x = header.uvMin[0] + q[3] * header.uvStep[0];
+		vert.uv.y = header.uvMin[1] + q[4] * header.uvStep[1];
+		vert.normal = DecodeNormal(q[5], q[6]);
+
+		for (uint32_t c = 0; c < 4; c++) {
+			prevColor[c] += UnZigZag8(planes[14 + c][i]);
+			vert.color[c] = prevColor[c] / 255.0f;
+		}
+	}
+
+	return true;
+}
+
+// codes each index as a zigzag variable length delta from the previous index, then entropy codes the result
+static void EncodeIndexBlock(const uint32_t* indices, uint32_t count, std::vector<uint8_t>& out) {
+	std::vector<uint8_t> bytes;
+	bytes.reserve(count * 2);
+
+	uint32_t prev = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		int32_t delta = (int32_t) (indices[i] - prev);
+		uint32_t z = (uint32_t) ((delta << 1) ^ (delta >> 31));
+		while (z >= 0x80) {
+			bytes.push_back((uint8_t) (z | 0x80));
+			z >>= 7;
+		}
+		bytes.push_back((uint8_t) z);
+		prev = indices[i];
+	}
+
+	EncodeStream(bytes.empty() ? NULL : &bytes[0], bytes.size(), out);
+}
+
+static bool DecodeIndexBlock(const uint8_t* data, uint32_t size, uint32_t* indices, uint32_t count, uint32_t vertexCount) {
+	ByteReader reader(data, size);
+	std::vector<uint8_t> bytes;
+	if (!DecodeStream(reader, bytes)) {
+		return false;
+	}
+
+	uint32_t prev = 0;
+	uint32_t cur = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t z = 0;
+		uint32_t shift = 0;
+		do {
+			if (cur >= bytes.size() || shift > 28) {
+				return false;
+			}
+			z |= (uint32_t) (bytes[cur] & 0x7f) << shift;
+			shift += 7;
+		} while (bytes[cur++] & 0x80);
+
+		prev += (uint32_t) ((z >> 1) ^ (0 - (z & 1)));
+		if (prev >= vertexCount) {
+			return false;
+		}
+		indices[i] = prev;
+	}
+
+	return true;
+}
+
+bool IsMeshArchive(const char* filename) {
+	FILE* f = NULL;
+	fopen_s(&f, filename, "rb");
+	if (!f) {
+		return false;
+	}
+
+	char magic[4] = { 0 };
+	fread(magic, 1, 4, f);
+	fclose(f);
+
+	return !memcmp(magic, "SVMA", 4);
+}
+
+bool SaveMeshArchive(const char* filename, const PlyModelData& data) {
+	double startTime = GetTimeSeconds();
+
+	const std::vector<PlyVertex>& vertices = data.vertices;
+	const std::vector<uint32_t>& indices = data.indices;
+	if (vertices.empty() || indices.empty()) {
+		return false;
+	}
+
+	MeshArchiveHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "SVMA", 4);
+	header.version = ARCHIVE_VERSION;
+	header.vertexCount = vertices.size();
+	header.indexCount = indices.size();
+	header.numVertexBlocks = (header.vertexCount + VERTICES_PER_BLOCK - 1) / VERTICES_PER_BLOCK;
+	header.numIndexBlocks = (header.indexCount + INDICES_PER_BLOCK - 1) / INDICES_PER_BLOCK;
+	for (uint32_t a = 0; a < 3; a++) {
+		header.boundMin[a] = data.boundMin[a];
+		header.boundMax[a] = data.boundMax[a];
+		header.centerOffset[a] = data.centerOffset[a];
+	}
+
+	// quantization ranges cover the (centered) positions and the uvs actually used
+	glm::vec3 posMin = vertices[0].position, posMax = vertices[0].position;
+	glm::vec2 uvMin = vertices[0].uv, uvMax = vertices[0].uv;
+	for (uint32_t i = 1; i < vertices.size(); i++) {
+		posMin = glm::min(posMin, vertices[i].position);
+		posMax = glm::max(posMax, vertices[i].position);
+		uvMin = glm::min(uvMin, vertices[i].uv);
+		uvMax = glm::max(uvMax, vertices[i].uv);
+	}
+	for (uint32_t a = 0; a < 3; a++) {
+		header.positionMin[a] = posMin[a];
+		header.positionStep[a] = posMax[a] > posMin[a] ? (posMax[a] - posMin[a]) / 65535.0f : 1.0f;
+	}
+	for (uint32_t a = 0; a < 2; a++) {
+		header.uvMin[a] = uvMin[a];
+		header.uvStep[a] = uvMax[a] > uvMin[a] ? (uvMax[a] - uvMin[a]) / 65535.0f : 1.0f;
+	}
+
+	// encode every block in parallel into its own buffer
+	uint32_t numBlocks = header.numVertexBlocks + header.numIndexBlocks;
+	std::vector<std::vector<uint8_t> > blocks(numBlocks);
+	ParallelFor(numBlocks, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t b = begin; b < end; b++) {
+			if (b < header.numVertexBlocks) {
+				uint32_t first = b * VERTICES_PER_BLOCK;
+				uint32_t count = mini(VERTICES_PER_BLOCK, header.vertexCount - first);
+				EncodeVertexBlock(header, &vertices[first], count, blocks[b]);
+			} else {
+				uint32_t first = (b - header.numVertexBlocks) * INDICES_PER_BLOCK;
+				uint32_t count = mini(INDICES_PER_BLOCK, header.indexCount - first);
+				EncodeIndexBlock(&indices[first], count, blocks[b]);
+			}
+		}
+	});
+
+	// write out the header, block size table, then the blocks
+	FILE* f = NULL;
+	fopen_s(&f, filename, "wb");
+	if (!f) {
+		Log("Unable to open '%s' for writing", filename);
+		return false;
+	}
+
+	fwrite(&header, sizeof(header), 1, f);
+	uint32_t totalSize = sizeof(header) + numBlocks * sizeof(uint32_t);
+	for (uint32_t b = 0; b < numBlocks; b++) {
+		uint32_t size = blocks[b].size();
+		fwrite(&size, sizeof(size), 1, f);
+		totalSize += size;
+	}
+	for (uint32_t b = 0; b < numBlocks; b++) {
+		fwrite(&blocks[b][0], 1, blocks[b].size(), f);
+	}
+	fclose(f);
+
+	uint32_t rawSize = header.vertexCount * sizeof(PlyVertex) + header.indexCount * sizeof(uint32_t);
+	Log("Wrote mesh archive '%s': %d bytes (%.1fx smaller than %d raw bytes) in %.1f ms", filename, totalSize,
+		(float) rawSize / totalSize, rawSize, (GetTimeSeconds() - startTime) * 1000.0);
+
+	return true;
+}
+
+bool LoadMeshArchive(const char* filename, PlyModelData& into) {
+	double startTime = GetTimeSeconds();
+
+	// read in the whole file at once, blocks are then decoded straight out of it
+	FILE* f = NULL;
+	fopen_s(&f, filename, "rb");
+	if (!f) {
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	uint32_t fileSize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	std::vector<uint8_t> file(fileSize);
+	uint32_t readSize = fileSize ? fread(&file[0], 1, fileSize, f) : 0;
+	fclose(f);
+
+	MeshArchiveHeader header;
+	if (readSize != fileSize || fileSize < sizeof(header)) {
+		Log("Mesh archive '%s' is incomplete.", filename);
+		return false;
+	}
+	memcpy(&header, &file[0], sizeof(header));
+	if (memcmp(header.magic, "SVMA", 4) || header.version != ARCHIVE_VERSION) {
+		Log("'%s' is not a supported mesh archive.", filename);
+		return false;
+	}
+
+	// the block counts have to match the element counts exactly, or decoding would run off the ends of the arrays
+	if (!header.vertexCount || !header.indexCount || header.indexCount % 3 ||
+		header.numVertexBlocks != (header.vertexCount + VERTICES_PER_BLOCK - 1) / VERTICES_PER_BLOCK ||
+		header.numIndexBlocks != (header.indexCount + INDICES_PER_BLOCK - 1) / INDICES_PER_BLOCK) {
+		Log("Mesh archive '%s' is corrupt (bad counts).", filename);
+		return false;
+	}
+
+	// find where each block starts from the size table
+	uint32_t numBlocks = header.numVertexBlocks + header.numIndexBlocks;
+	if (sizeof(header) + numBlocks * sizeof(uint32_t) > fileSize) {
+		Log("Mesh archive '%s' is incomplete.", filename);
+		return false;
+	}
+	std::vector<uint32_t> blockSizes(numBlocks);
+	std::vector<uint32_t> blockOffsets(numBlocks);
+	memcpy(&blockSizes[0], &file[sizeof(header)], numBlocks * sizeof(uint32_t));
+	uint32_t offset = sizeof(header) + numBlocks * sizeof(uint32_t);
+	for (uint32_t b = 0; b < numBlocks; b++) {
+		// compared against what's left of the file, as a corrupt size could wrap the offset
+		if (blockSizes[b] > fileSize - offset) {
+			Log("Mesh archive '%s' is incomplete.", filename);
+			return false;
+		}
+		blockOffsets[b] = offset;
+		offset += blockSizes[b];
+	}
+
+	for (uint32_t a = 0; a < 3; a++) {
+		into.boundMin[a] = header.boundMin[a];
+		into.boundMax[a] = header.boundMax[a];
+		into.centerOffset[a] = header.centerOffset[a];
+	}
+	into.vertices.resize(header.vertexCount);
+	into.indices.resize(header.indexCount);
+
+	// decode all blocks in parallel directly into their place in the final arrays
+	std::vector<uint8_t> blockOk(numBlocks, 0);
+	ParallelFor(numBlocks, 1, [&](uint32_t begin, uint32_t end) {
+		PROFILE_SCOPE("decode archive blocks");
+		for (uint32_t b = begin; b < end; b++) {
+			const uint8_t* data = &file[blockOffsets[b]];
+			if (b < header.numVertexBlocks) {
+				uint32_t first = b * VERTICES_PER_BLOCK;
+				uint32_t count = mini(VERTICES_PER_BLOCK, header.vertexCount - first);
+				blockOk[b] = DecodeVertexBlock(header, data, blockSizes[b], &into.vertices[first], count);
+			} else {
+				uint32_t first = (b - header.numVertexBlocks) * INDICES_PER_BLOCK;
+				uint32_t count = mini(INDICES_PER_BLOCK, header.indexCount - first);
+				blockOk[b] = DecodeIndexBlock(data, blockSizes[b], &into.indices[first], count, header.vertexCount);
+			}
+		}
+	});
+
+	for (uint32_t b = 0; b < numBlocks; b++) {
+		if (!blockOk[b]) {
+			Log("Mesh archive '%s' is corrupt (block %d).", filename, b);
+			return false;
+		}
+	}
+
+	Log("Read mesh archive '%s': %d vertices, %d triangles in %.1f ms", filename, header.vertexCount,
+		header.indexCount / 3, (GetTimeSeconds() - startTime) * 1000.0);
+
+	return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "PlyModel.h"
+
+// Compressed mesh archives (.svm) store PlyModel data far more compactly than PLY files:
+//   - positions are quantized to 16 bits per axis over the mesh bounds, uvs to 16 bits over their range
+//   - normals are octahedral encoded to 2 x 16 bits and colors stored as 8 bits per channel
+//   - triangle indices are delta coded against the previous index as variable length integers
+//   - every attribute is delta coded and split into byte planes, each entropy coded with rANS
+// Vertices and indices are stored in fixed size blocks that can each be decoded independently, so encoding and
+// decoding both run across all cores, and decoding writes straight into the interleaved PlyVertex layout used on the GPU
+
+// returns true if the given file is a compressed mesh archive
+bool IsMeshArchive(const char* filename);
+
+// compresses the given model data into a mesh archive at the given path
+bool SaveMeshArchive(const char* filename, const PlyModelData& data);
+
+// decompresses the mesh archive at the given path into the given model data
+bool LoadMeshArchive(const char* filename, PlyModelData& into);
@@ -1,39 +1,39 @@
 
 #include "SpecViz.h"
+#include "OrbitViewer.h"
+#include "GPUProfiler.h"
+#include "Profiler.h"
 #include "PlyModel.h"
 
-// Standard model viewer shows model fully opaque with lighting effects for comparison to projected mapped version
+#include <string>
 
-class ModelViewer : public Viewer {
+// Standard model viewer shows model fully opaque with lighting effects for comparison to projected mapped version.
+// Models baked by MultiProjViewer::BakeAtlas are shown with their atlas texture instead, and models with vertex colors
+// (such as those from MultiProjViewer::BakeVertexColors) with their colors in place of a texture
+
+class ModelViewer : public OrbitViewer {
 public:
 	PixelShader* pShader;
 	VertexShader* vShader;
 	ShaderProgram* program;
 	bool rotate;
-	glm::vec3 rotation;
-	glm::vec3 center;
-	glm::mat4 objMatrix;
-	glm::mat4 viewMatrix;
-	glm::mat4 projMatrix;
 	glm::vec3 lightDirection;
 
 	float lightPitch;
 	float lightYaw;
-	float cameraDistance;
-	float baseCameraDistance;
 	float fieldOfView;
 
-	PlyModel* model;
+	Texture* atlasTexture;		// NULL unless the model has a baked atlas next to it
 
 	ModelViewer(const char* withFilename);
 	void MainLoop(float deltaTime);
+	bool Poll();
 	void NotifyKeyPress(const char* name);
-	void NotifyMouseWheel(float amt, bool controlHeld);
-	void NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld);
 	virtual ~ModelViewer();
 };
 
 Viewer* CreateModelViewer(const char* filename) {
+	PROFILE_SCOPE("CreateModelViewer");
 	ModelViewer* newViewer = new ModelViewer(filename);
 	return newViewer;
 }
@@ -55,33 +55,66 @@ ModelViewer::ModelViewer(const char* filename) {
 	glGetIntegerv(GL_MINOR_VERSION, &minor);
 	printf("GL %d.%d", major, minor);
 
-	pShader = new PixelShader("Shaders/simple_light.pix");
+	// a baked atlas holds the blended projections, so showing them is a single texture lookup
+	std::string atlasFile = std::string(filename) + ".atlas.png";
+	atlasTexture = Texture::CreateFromFile(atlasFile.c_str(), GL_RGBA8);
+
+	model = new PlyModel(filename);
+	model->EnableHotReload();
+
+	// vertices are white unless the file gave them colors
+	bool hasColors = false;
+	const std::vector<PlyVertex>& vertices = model->GetVertices();
+	for (uint32_t i = 0; i < vertices.size() && !hasColors; i++) {
+		hasColors = vertices[i].color != glm::vec4(1.0f);
+	}
+
+	const char* pixelPath = "Shaders/simple_light.pix";
+	if (atlasTexture) {
+		pixelPath = "Shaders/textured_light.pix";
+	} else if (hasColors) {
+		pixelPath = "Shaders/vertex_color_light.pix";
+	}
+	pShader = new PixelShader(pixelPath);
 	vShader = new VertexShader("Shaders/lit_vertex.vert");
 	program = new ShaderProgram(pShader, vShader);
 
-	model = new PlyModel(filename);
+	// uniforms that never change are set once up front
+	program->Bind();
+	glUniform1f(program->GetUniform(UNIFORM_ALPHA), 1.0f);
+	glUniform1i(program->GetUniform(UNIFORM_COLOR_MAP), 0);
 	
 	fieldOfView = 30.0f;
 	baseCameraDistance = glm::length(model->GetScale()) / 1.404f * 90.0f / fieldOfView;
 	cameraDistance = baseCameraDistance;
 }
 
+bool ModelViewer::Poll() {
+	// pick up any re-exported version of the model file
+	return model->PollReload();
+}
+
 void ModelViewer::MainLoop(float deltaTime) {
 	GLCHECK();
 
 	// set up z write/read
-	glDepthMask(GL_TRUE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::DepthMask(true);
+	GLState::Enable(GL_DEPTH_TEST);
 	GLCHECK();
 
 	// clear frame buffer
+	GetGPUProfiler()->BeginPass("clear");
 	glClearColor(0,0,0,1);
 	glClearDepth(1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 
 	// bind program
 	program->Bind();
+	if (atlasTexture) {
+		atlasTexture->Bind(0);
+	}
 	GLCHECK();
 	
 	projMatrix = glm::infinitePerspective(fieldOfView * glm::pi<float>() / 180.0f, GetAspectRatio(), 0.01f);
@@ -101,19 +134,16 @@ void ModelViewer::MainLoop(float deltaTime) {
 	float pitchVar = 1.0f - sin(lightPitch);
 	lightDirection = glm::normalize(glm::vec3(cos(lightYaw) * pitchVar, sin(lightPitch), sin(lightYaw) * pitchVar));
 	
-	glDisable(GL_BLEND);
+	GLState::Disable(GL_BLEND);
 
 	GLCHECK();
-	glUniformMatrix4fv(program->GetUniform("objMatrix"), 1, GL_FALSE, &objMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("projMatrix"), 1, GL_FALSE, &projMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-	glUniform3fv(program->GetUniform("lightDirection"), 1, &lightDirection.x);
-	glUniform3fv(program->GetUniform("eyePosition"), 1, &eyePosition.x);
-	glUniform1f(program->GetUniform("alpha"), 1.0f);
+	SetCameraBlock(CameraBlock(objMatrix, viewMatrix, projMatrix, eyePosition, lightDirection));
 	GLCHECK();
 
 	// draw our model
+	GetGPUProfiler()->BeginPass("model");
 	model->Render();
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 }
 
@@ -124,40 +154,6 @@ void ModelViewer::NotifyKeyPress(const char* name) {
 	}
 }
 
-void ModelViewer::NotifyMouseWheel(float amt, bool controlHeld) {
-	cameraDistance += baseCameraDistance * -0.005f * amt * (controlHeld ? 0.1f : 1.0f);
-}
-
-void ModelViewer::NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld) {
-	const float p = glm::pi<float>();
-
-	if (button == 2) {
-		rotation.z += y * 0.01f;
-		if (rotation.z > p * 2.0f)
-			rotation.z -= p * 2.0f;
-		if (rotation.z < p * -2.0f)
-			rotation.z += p * 2.0f;
-	} else if (button == 1) {
-		center.x += viewMatrix[0].x * x / 1000.0f * cameraDistance;
-		center.y += viewMatrix[0].y * x / 1000.0f * cameraDistance;
-		center.z += viewMatrix[0].z * x / 1000.0f * cameraDistance;
-		center.x += viewMatrix[1].x * y / 1000.0f * cameraDistance;
-		center.y += viewMatrix[1].y * y / 1000.0f * cameraDistance;
-		center.z += viewMatrix[1].z * y / 1000.0f * cameraDistance;
-	} else if (button == 0) {
-		rotation.x += x * 0.01f;
-		rotation.y -= y * 0.01f;
-		if (rotation.x > p * 2.0f)
-			rotation.x -= p * 2.0f;
-		if (rotation.x < p * -2.0f)
-			rotation.x += p * 2.0f;
-		if (rotation.y > p * 2.0f)
-			rotation.y -= p * 2.0f;
-		if (rotation.y < p * -2.0f)
-			rotation.y += p * 2.0f;
-	}
-}
-
 ModelViewer::~ModelViewer() {
 	delete program;
 	GLCHECK();
@@ -167,6 +163,8 @@ ModelViewer::~ModelViewer() {
 	GLCHECK();
 	delete model;
 	GLCHECK();
+	delete atlasTexture;
+	GLCHECK();
 	
 	glClearColor(1,1,1,1);
 	glClear(GL_COLOR_BUFFER_BIT);
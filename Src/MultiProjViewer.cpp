@@ -1,72 +1,151 @@
 
 #include "SpecViz.h"
+#include "OrbitViewer.h"
+#include "AtlasBake.h"
+#include "GPUProfiler.h"
+#include "Profiler.h"
 #include "PlyModel.h"
+#include "ProjectedAttributes.h"
+#include "ProjectionTable.h"
+#include "ProjectionVisibility.h"
+#include "ShaderPermutations.h"
+#include "TextureCompress.h"
+#include "VertexColorBake.h"
 
 #include <fstream>
+#include <string>
 
 // MultiProjViewer is the main viewer that allows for multiple projections on the 3D mesh simultaneously. Projections
-// should have been run through using CreateProjViewer, and then ideally had a Depth Field made for them
-
-#define MAX_TEXTURES 16
-
-class MultiProjViewer : public Viewer {
+// should have been run through using CreateProjViewer, and then ideally had a Depth Field made for them. Every
+// projection's image is a layer of a single texture array, and their matrices live in a uniform block, so the number
+// of projections is only bounded by MAX_PROJECTIONS and video memory. For many projections the viewer can instead
+// accumulate them in batches into a floating point target, which keeps the cost per projection fixed, or sample only
+// the few projections a precomputed per triangle table picked as covering each triangle best. A deferred path draws the
+// nearest surface into a G-buffer and samples the projections once per pixel, however much the mesh overlaps itself.
+// With up to 16 projections, the projected UVs and facing amounts of every vertex are worked out once at load rather
+// than from the matrices every frame
+
+class MultiProjViewer : public OrbitViewer {
 public:
-	PixelShader* pShader;
-	VertexShader* vShader;
-	ShaderProgram* program;
-
-	glm::vec3 rotation;
-	glm::vec3 center;
-	glm::mat4 objMatrix;
-	glm::mat4 viewMatrix;
+	ShaderProgram* program;			// owned by the precompiled shader permutations
+
 	glm::vec3 lightDirection;
-	
-	glm::mat4 projMatrix;
 
-	glm::mat4 texMatrix[MAX_TEXTURES];
-	Texture* projTexture[MAX_TEXTURES];
+	ProjectionBlock* projections;
+	UniformBuffer* projectionBuffer;
+	TextureArray* projTextures;
 	uint32_t numTextures;
 
 	float lightPitch;
 	float lightYaw;
-	float cameraDistance;
-	float baseCameraDistance;
 	float fieldOfView;
 
-	PlyModel* model;
+	// when set, every frame is drawn and the vertex stage of the model is timed on its own
+	bool profileStages;
+
+	// when set, the weighted colors of each batch of ACCUMULATE_BATCH_SIZE projections are added into accumTarget
+	// and then divided out by the resolve pass, rather than every projection being sampled in a single draw
+	bool accumulate;
+	RenderTarget* accumTarget;		// created to match the viewport on first use
+	PixelShader* depthPShader;
+	VertexShader* depthVShader;
+	ShaderProgram* depthProgram;
+
+	// full screen quad for the resolve pass
+	PixelShader* resolvePShader;
+	VertexShader* resolveVShader;
+	ShaderProgram* resolveProgram;
+	VertexBuffer* quadBuffer;
+	IndexBuffer* quadIndices;
+	VAO* quadVao;
+
+	// best projections of each triangle (see BuildProjectionTable), used in place of sampling every projection when
+	// useTable is set. NULL when there are too few projections for it to help
+	BufferTexture* projectionTable;
+	ShaderProgram* topKProgram;		// owned by the precompiled shader permutations
+	std::vector<std::string> textureFile;
+	std::vector<std::string> edgeFile;
+	bool useTable;
+
+	// scores the model's triangles against every projection and uploads the result to projectionTable
+	void UpdateProjectionTable();
+
+	// which projections see each triangle past the rest of the mesh (see BuildProjectionVisibility), used to skip
+	// the others when useVisibility is set. projectionVisibility is NULL when the mesh is too large for it
+	ProjectionVisibility visibility;
+	BufferTexture* projectionVisibility;
+	bool useVisibility;
+
+	// finds the visibility of every triangle and uploads it to projectionVisibility
+	void UpdateVisibility();
+
+	// sets the visibility uniforms of the given multi projection program, or of every program the viewer draws with
+	void ApplyVisibility(ShaderProgram* toProgram);
+	void ApplyVisibilityToAll();
+
+	// projected UVs and facing amounts of every vertex (see BuildProjectedAttributes), attached to the model's VAO for
+	// the static projection program. NULL when program works them out from texMatrix instead
+	VertexBuffer* projectedBuffer;
+	uint32_t projectedSize;
+
+	// builds the projected attributes of the model and attaches them to its VAO
+	void UpdateProjectedAttributes();
+
+	// draws the model by accumulating batches of projections and resolving them into the current frame buffer
+	void RenderAccumulated();
+
+	// when set, the mesh position, normal and triangle of the nearest surface are drawn into gbuffer first, and a full
+	// screen pass then samples the projections for every covered pixel exactly once
+	bool deferred;
+	RenderTarget* gbuffer;			// created to match the viewport on first use
+	PixelShader* gbufferPShader;
+	VertexShader* gbufferVShader;
+	ShaderProgram* gbufferProgram;
+	ShaderProgram* deferredProgram;		// owned by the precompiled shader permutations
+	ShaderProgram* deferredTopKProgram;	// NULL without a projection table
+
+	// draws the model into the G-buffer and shades it into the current frame buffer
+	void RenderDeferred();
 
 	MultiProjViewer(std::vector<const char*>& filenames);
 	void MainLoop(float deltaTime);
+	bool Poll();
 	void NotifyKeyPress(const char* name);
-	void NotifyMouseWheel(float amt, bool controlHeld);
-	void NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld);
+	bool IsAnimating();
+	bool BakeAtlas(const char* toFile);
+	bool BakeVertexColors(const char* toFile);
 	virtual ~MultiProjViewer();
 };
 
 Viewer* CreateMultiProjViewer(std::vector<const char*>& filenames) {
+	PROFILE_SCOPE("CreateMultiProjViewer");
 	MultiProjViewer* newViewer = new MultiProjViewer(filenames);
 	return newViewer;
 }
 
 MultiProjViewer::MultiProjViewer(std::vector<const char*>& filenames) {
 	GLCHECK();
-	assert(filenames.size() <= MAX_TEXTURES);
+	assert(filenames.size() > 0 && filenames.size() <= MAX_PROJECTIONS);
+	numTextures = filenames.size();
 	
 	// load up the projection files as created from CreateProjViewer
-	char textureFile[MAX_TEXTURES][512];
+	textureFile.resize(numTextures);
 	char modelFile[512];
+	char path[512];
+	projections = new ProjectionBlock();
 
-	for (uint32_t i = 0; i < filenames.size(); i++) {
+	for (uint32_t i = 0; i < numTextures; i++) {
 		const char* filename = filenames[i];
 		std::fstream f(filename, std::ifstream::in);
 
 		// texture and model file paths
-		f >> textureFile[i];
+		f >> path;
 		f >> modelFile;
+		textureFile[i] = path;
 	
 		// projection matrix for this projection
-		float* ref = &texMatrix[i][0].x;
-		for (int32_t i = 0; i < 16; i++) {
+		float* ref = &projections->texMatrix[i][0].x;
+		for (int32_t j = 0; j < 16; j++) {
 			f >> *ref;
 			ref++;
 		}
@@ -79,6 +158,7 @@ MultiProjViewer::MultiProjViewer(std::vector<const char*>& filenames) {
 	lightPitch = 1.0f;
 	lightYaw = 0.0f;
 	model = NULL;
+	profileStages = false;
 
 	int32_t major = 0;
 	int32_t minor = 0;
@@ -86,55 +166,288 @@ MultiProjViewer::MultiProjViewer(std::vector<const char*>& filenames) {
 	glGetIntegerv(GL_MINOR_VERSION, &minor);
 	printf("GL %d.%d", major, minor);
 
-	// define the multiprojection shaders with the number of samplers we are using for this viewer instance
-	char samplerDefine[256];
-	sprintf_s(samplerDefine, "#define NUM_SAMPLERS %d\n", filenames.size());
+	// the multiprojection shaders for the number of projections we are using were precompiled at startup. When the
+	// projected attributes fit in the vertex attributes, the program that reads them back is used
+	GLint maxAttributes = 0;
+	glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttributes);
+	ShaderProgram* staticProgram = NULL;
+	if (PROJECTED_UV_ATTRIB + (numTextures + 1) / 2 <= (uint32_t) maxAttributes) {
+		staticProgram = GetStaticProjProgram(numTextures);
+	}
+	program = staticProgram ? staticProgram : GetMultiProjProgram(numTextures);
+
+	// the sampler and projection count never change, so their uniforms are set once up front
+	program->Bind();
+	glUniform1i(program->GetUniform(UNIFORM_COLOR_MAP), 0);
+	glUniform1i(program->GetUniform(UNIFORM_NUM_PROJECTIONS), numTextures);
+	glUniform1i(program->GetUniform(UNIFORM_FIRST_PROJECTION), 0);
+	glUniform1f(program->GetUniform(UNIFORM_ALPHA), 1.0f);
+
+	// accumulation lays down depth from the model's position stream, then uses a program per batch size
+	depthPShader = new PixelShader("Shaders/depth_only.pix");
+	depthVShader = new VertexShader("Shaders/depth_only.vert");
+	depthProgram = new ShaderProgram(depthPShader, depthVShader);
+	for (uint32_t i = 1; i <= ACCUMULATE_BATCH_SIZE; i++) {
+		ShaderProgram* batchProgram = GetAccumulateProgram(i);
+		batchProgram->Bind();
+		glUniform1i(batchProgram->GetUniform(UNIFORM_COLOR_MAP), 0);
+		glUniform1f(batchProgram->GetUniform(UNIFORM_ALPHA), 1.0f);
+	}
+
+	resolvePShader = new PixelShader("Shaders/accumulate_resolve.pix");
+	resolveVShader = new VertexShader("Shaders/passthrough.vert");
+	resolveProgram = new ShaderProgram(resolvePShader, resolveVShader);
+	resolveProgram->Bind();
+	glUniform1i(resolveProgram->GetUniform(UNIFORM_COLOR_MAP), 0);
+	glm::vec2 scale(1.0f, 1.0f);
+	glUniform2fv(resolveProgram->GetUniform(UNIFORM_SCALE), 1, &scale.x);
+
+	struct vPos {
+		float pos[3];
+		float uv[2];
+	};
+	vPos vData[] = {
+		-1,-1,0, 0,0,
+		 1,-1,0, 1,0,
+		-1, 1,0, 0,1,
+		 1, 1,0, 1,1,
+	};
+	quadBuffer = new VertexBuffer(vData, sizeof(vData));
+
+	uint32_t iData[] = {
+		0,1,2,2,1,3
+	};
+	quadIndices = new IndexBuffer(iData, sizeof(iData), GL_TRIANGLES);
 
-	// compile the vertex and pixel shaders with this parameter
-	pShader = new PixelShader("Shaders/multi_textured_light.pix", samplerDefine);
-	vShader = new VertexShader("Shaders/multi_projected_vertex.vert", samplerDefine);
-	program = new ShaderProgram(pShader, vShader);
+	quadVao = new VAO(quadBuffer, quadIndices);
+	quadVao->EnableArrays(2);
+	accumTarget = NULL;
 
 	// load the singular model used for this setup
 	model = new PlyModel(modelFile);
+	model->EnableHotReload();
+	model->EnablePositionStream();
+
+	// every layer of the array is the size of the largest image. Smaller images sit in the corner of their layer
+	uint32_t arrayWidth = 1, arrayHeight = 1;
+	std::vector<glm::uvec2> imageSize(numTextures, glm::uvec2(1, 1));
+	for (uint32_t i = 0; i < numTextures; i++) {
+		Texture::GetImageSize(textureFile[i].c_str(), imageSize[i].x, imageSize[i].y);
+		arrayWidth = maxi(arrayWidth, imageSize[i].x);
+		arrayHeight = maxi(arrayHeight, imageSize[i].y);
+	}
+	for (uint32_t i = 0; i < numTextures; i++) {
+		projections->uvScale[i] = glm::vec4((float) imageSize[i].x / arrayWidth, (float) imageSize[i].y / arrayHeight,
+			0.0f, 0.0f);
+	}
+	projectionBuffer = new UniformBuffer(sizeof(ProjectionBlock), PROJECTION_BLOCK_BINDING);
+	projectionBuffer->Update(projections);
+
+	// neither the mesh nor the matrices change from frame to frame, so the projected UVs only need working out once
+	projectedBuffer = NULL;
+	projectedSize = 0;
+	if (staticProgram) {
+		UpdateProjectedAttributes();
+	}
 	
-	// create a combined depth field / color texture for each instance. In the case that a depth field
+	// create a combined depth field / color layer for each instance. In the case that a depth field
 	// texture has not been generated for a given projection, CreateFromFileCombined will fill the alpha
-	// channel with white, making only normals the relevant weighting for that projection
-	char depthTexture[512];
-	for (uint32_t i = 0; i < filenames.size(); i++) {
-		strcpy(depthTexture, filenames[i]);
-		strcat(depthTexture, ".edgedist.png");
-		projTexture[i] = Texture::CreateFromFileCombined(textureFile[i], depthTexture);
+	// channel with white, making only normals the relevant weighting for that projection. With texture
+	// compression on these are BC3 compressed (and cached) instead
+	projTextures = new TextureArray(arrayWidth, arrayHeight, numTextures, GetProjectionFormat());
+	edgeFile.resize(numTextures);
+	for (uint32_t i = 0; i < numTextures; i++) {
+		edgeFile[i] = std::string(filenames[i]) + ".edgedist.png";
+		LoadProjectionLayer(projTextures, i, textureFile[i].c_str(), edgeFile[i].c_str());
 	}
+	Log("Loaded %d projections into a %dx%d texture array", numTextures, arrayWidth, arrayHeight);
+
+	// the per triangle data below lives in buffer textures, which the mesh has to fit in
+	GLint maxTableTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTableTexels);
+	uint32_t numTriangles = model->GetIndices().size() / 3;
+
+	// occluded projections are found once up front, so they're never sampled for the triangles they can't see
+	projectionVisibility = NULL;
+	if (numTriangles * GetVisibilityWords(numTextures) <= (uint32_t) maxTableTexels) {
+		UpdateVisibility();
+	} else {
+		Log("Model has too many triangles for projection visibility (%d texels at most)", maxTableTexels);
+	}
+	useVisibility = projectionVisibility != NULL;
+
+	// with more projections than any triangle needs, only sample the best few of each triangle. The table takes two
+	// texels per triangle
+	projectionTable = NULL;
+	topKProgram = NULL;
+	if (numTextures > PROJECTION_TABLE_K) {
+		if (numTriangles * 2 <= (uint32_t) maxTableTexels) {
+			topKProgram = GetTopKProgram();
+			topKProgram->Bind();
+			glUniform1i(topKProgram->GetUniform(UNIFORM_COLOR_MAP), 0);
+			glUniform1i(topKProgram->GetUniform(UNIFORM_PROJECTION_TABLE), 1);
+			glUniform1f(topKProgram->GetUniform(UNIFORM_ALPHA), 1.0f);
+			UpdateProjectionTable();
+		} else {
+			Log("Model has too many triangles for a projection table (%d texels at most)", maxTableTexels);
+		}
+	}
+	useTable = projectionTable != NULL;
+
+	// past the most projections a single draw samples, accumulating is the faster way (unless the table is in use)
+	accumulate = numTextures > 16 && !useTable;
+
+	// the G-buffer holds mesh space positions, so it's drawn with the vertex shader the per fragment projection uses
+	gbufferPShader = new PixelShader("Shaders/gbuffer.pix");
+	gbufferVShader = new VertexShader("Shaders/multi_projected_vertex.vert", "#define FRAGMENT_PROJECTION 1\n");
+	gbufferProgram = new ShaderProgram(gbufferPShader, gbufferVShader);
+	deferredProgram = GetDeferredProgram(false);
+	deferredTopKProgram = projectionTable ? GetDeferredProgram(true) : NULL;
+	ShaderProgram* shadePrograms[2] = { deferredProgram, deferredTopKProgram };
+	for (uint32_t i = 0; i < 2 && shadePrograms[i]; i++) {
+		shadePrograms[i]->Bind();
+		glUniform1i(shadePrograms[i]->GetUniform(UNIFORM_COLOR_MAP), 0);
+		glUniform1i(shadePrograms[i]->GetUniform(UNIFORM_PROJECTION_TABLE), 1);
+		glUniform1i(shadePrograms[i]->GetUniform(UNIFORM_GBUFFER_POSITION), 3);
+		glUniform1i(shadePrograms[i]->GetUniform(UNIFORM_GBUFFER_NORMAL), 4);
+		glUniform1i(shadePrograms[i]->GetUniform(UNIFORM_GBUFFER_TRIANGLE), 5);
+		glUniform1i(shadePrograms[i]->GetUniform(UNIFORM_NUM_PROJECTIONS), numTextures);
+		glUniform1i(shadePrograms[i]->GetUniform(UNIFORM_FIRST_PROJECTION), 0);
+		glUniform1f(shadePrograms[i]->GetUniform(UNIFORM_ALPHA), 1.0f);
+		glUniform2fv(shadePrograms[i]->GetUniform(UNIFORM_SCALE), 1, &scale.x);
+	}
+	gbuffer = NULL;
+	deferred = false;
+
+	ApplyVisibilityToAll();
 
-	numTextures = filenames.size();
 	fieldOfView = 30.0f;
 	baseCameraDistance = glm::length(model->GetScale()) / 1.404f * 90.0f / fieldOfView;
 	cameraDistance = baseCameraDistance;
 }
 
+void MultiProjViewer::UpdateProjectedAttributes() {
+	std::vector<uint8_t> attributes;
+	BuildProjectedAttributes(model->GetVertices(), projections->texMatrix, projections->uvScale, numTextures, attributes);
+
+	uint32_t attributeSize = attributes.size();
+	if (projectedBuffer && projectedSize == attributeSize) {
+		projectedBuffer->Update(0, attributes.data(), attributeSize);
+	} else {
+		delete projectedBuffer;
+		projectedBuffer = new VertexBuffer(attributes.data(), attributeSize);
+		projectedSize = attributeSize;
+	}
+
+	// a reload that changes the vertex count recreates the model's VAO, so the arrays are always attached again
+	VAO* vao = model->GetVAO();
+	uint32_t stride = GetProjectedAttributeStride(numTextures);
+	uint32_t numFacing = (numTextures + 3) / 4;
+	for (uint32_t i = 0; i < numFacing; i++) {
+		vao->AddArray(projectedBuffer, PROJECTED_FACING_ATTRIB + i, 4, GL_UNSIGNED_BYTE, true, stride, i * 4);
+	}
+	for (uint32_t i = 0; i < (numTextures + 1) / 2; i++) {
+		vao->AddArray(projectedBuffer, PROJECTED_UV_ATTRIB + i, 4, GL_UNSIGNED_SHORT, true, stride,
+			numFacing * 4 + i * 4 * sizeof(uint16_t));
+	}
+	VAO::Unbind();
+	GLCHECK();
+}
+
+void MultiProjViewer::UpdateProjectionTable() {
+	std::vector<TriangleProjections> table;
+	BuildProjectionTable(model->GetVertices(), model->GetIndices(), projections->texMatrix, edgeFile,
+		projectionVisibility ? &visibility : NULL, table);
+
+	uint32_t tableSize = table.size() * sizeof(TriangleProjections);
+	if (!projectionTable) {
+		projectionTable = new BufferTexture(table.data(), tableSize, GL_RGBA16UI);
+	} else {
+		projectionTable->Update(table.data(), tableSize);
+	}
+	GLCHECK();
+}
+
+void MultiProjViewer::UpdateVisibility() {
+	BuildProjectionVisibility(model->GetBVH(), model->GetVertices(), model->GetIndices(), projections->texMatrix,
+		numTextures, visibility);
+
+	uint32_t visibilitySize = visibility.masks.size() * sizeof(uint32_t);
+	if (!projectionVisibility) {
+		projectionVisibility = new BufferTexture(visibility.masks.data(), visibilitySize, GL_R32UI);
+	} else {
+		projectionVisibility->Update(visibility.masks.data(), visibilitySize);
+	}
+	GLCHECK();
+}
+
+void MultiProjViewer::ApplyVisibility(ShaderProgram* toProgram) {
+	toProgram->Bind();
+	glUniform1i(toProgram->GetUniform(UNIFORM_PROJECTION_VISIBILITY), 2);
+	glUniform1i(toProgram->GetUniform(UNIFORM_USE_VISIBILITY), useVisibility);
+	glUniform1i(toProgram->GetUniform(UNIFORM_VISIBILITY_WORDS), visibility.words);
+}
+
+void MultiProjViewer::ApplyVisibilityToAll() {
+	ApplyVisibility(program);
+	if (topKProgram) {
+		ApplyVisibility(topKProgram);
+	}
+	ApplyVisibility(deferredProgram);
+	if (deferredTopKProgram) {
+		ApplyVisibility(deferredTopKProgram);
+	}
+	for (uint32_t i = 1; i <= ACCUMULATE_BATCH_SIZE; i++) {
+		ApplyVisibility(GetAccumulateProgram(i));
+	}
+}
+
+bool MultiProjViewer::Poll() {
+	// pick up any re-exported version of the model file, whose triangles have to be scored again
+	if (!model->PollReload()) {
+		return false;
+	}
+	if (projectedBuffer) {
+		UpdateProjectedAttributes();
+	}
+	if (projectionVisibility) {
+		UpdateVisibility();
+	}
+	if (projectionTable) {
+		UpdateProjectionTable();
+	}
+	return true;
+}
+
 void MultiProjViewer::MainLoop(float deltaTime) {
 	GLCHECK();
 
 	// set up z write/read
-	glDepthMask(GL_TRUE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::DepthMask(true);
+	GLState::Enable(GL_DEPTH_TEST);
 	GLCHECK();
 
 	// clear frame buffer
+	GetGPUProfiler()->BeginPass("clear");
 	glClearColor(0,0,0,1);
 	glClearDepth(1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 
 	// bind program
-	program->Bind();
+	if (useTable) {
+		topKProgram->Bind();
+		projectionTable->Bind(1);
+	} else {
+		program->Bind();
+	}
 	GLCHECK();
 	
-	// bind textures
-	for (uint32_t i = 0; i < numTextures; i++) {
-		projTexture[i]->Bind(i);
+	// bind every projection at once
+	projTextures->Bind(0);
+	if (projectionVisibility) {
+		projectionVisibility->Bind(2);
 	}
 
 	projMatrix = glm::infinitePerspective(fieldOfView * glm::pi<float>() / 180.0f, GetAspectRatio(), 0.01f);
@@ -154,88 +467,279 @@ void MultiProjViewer::MainLoop(float deltaTime) {
 	float pitchVar = 1.0f - sin(lightPitch);
 	lightDirection = glm::normalize(glm::vec3(cos(lightYaw) * pitchVar, sin(lightPitch), sin(lightYaw) * pitchVar));
 	
-	glDisable(GL_BLEND);
+	GLState::Disable(GL_BLEND);
+
+	GLCHECK();
+	SetCameraBlock(CameraBlock(objMatrix, viewMatrix, projMatrix, eyePosition, lightDirection));
+	GLCHECK();
+
+	if (deferred) {
+		RenderDeferred();
+		return;
+	}
 
+	if (accumulate) {
+		RenderAccumulated();
+		return;
+	}
+
+	// draw our model
+	GetGPUProfiler()->BeginPass("model");
+	model->Render();
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
-	glUniformMatrix4fv(program->GetUniform("objMatrix"), 1, GL_FALSE, &objMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("projMatrix"), 1, GL_FALSE, &projMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
 
-	// set the texMatrix array with numTextures size
-	glUniformMatrix4fv(program->GetUniform("texMatrix"), numTextures, GL_FALSE, &texMatrix[0][0][0]);
-	glUniform3fv(program->GetUniform("lightDirection"), 1, &lightDirection.x);
-	glUniform3fv(program->GetUniform("eyePosition"), 1, &eyePosition.x);
-	glUniform1f(program->GetUniform("alpha"), 1.0f);
+	// draw the model again with rasterization off, so only the vertex stage (its per projection texMatrix products,
+	// or with the static projection program its attribute fetches) is timed. The rest of the model pass is the
+	// fragment stage
+	if (profileStages) {
+		GetGPUProfiler()->BeginPass("model vertex");
+		GLState::Enable(GL_RASTERIZER_DISCARD);
+		model->Render();
+		GLState::Disable(GL_RASTERIZER_DISCARD);
+		GetGPUProfiler()->EndPass();
+		GLCHECK();
+	}
+}
 
-	// bind each sampler to the corresponding texture index
-	GLint textureList[MAX_TEXTURES] = {
-		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
-	};
-	glUniform1iv(program->GetUniform("colorMap"), numTextures, textureList);
+void MultiProjViewer::RenderAccumulated() {
+	// the accumulation target follows the size of the viewport
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (!accumTarget || accumTarget->GetWidth() != (uint32_t) viewport[2] ||
+		accumTarget->GetHeight() != (uint32_t) viewport[3]) {
+		delete accumTarget;
+		GLenum format = GL_RGBA16F;
+		accumTarget = new RenderTarget(viewport[2], viewport[3], &format, 1);
+	}
 
+	accumTarget->Bind();
+	glClearColor(0,0,0,0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	GLCHECK();
 
-	// draw our model
+	// lay down the depth of the nearest surface first, so each batch only shades the visible fragments once
+	GetGPUProfiler()->BeginPass("depth");
+	depthProgram->Bind();
+	GLState::ColorMask(false);
+	model->RenderPositions();
+	GLState::ColorMask(true);
+	GetGPUProfiler()->EndPass();
+	GLCHECK();
+
+	// add the weighted color and weight of every batch of projections into the target
+	GetGPUProfiler()->BeginPass("accumulate");
+	GLState::DepthFunc(GL_EQUAL);
+	GLState::DepthMask(false);
+	GLState::Enable(GL_BLEND);
+	GLState::BlendFunc(GL_ONE, GL_ONE);
+	for (uint32_t first = 0; first < numTextures; first += ACCUMULATE_BATCH_SIZE) {
+		ShaderProgram* batchProgram = GetAccumulateProgram(mini(numTextures - first, ACCUMULATE_BATCH_SIZE));
+		batchProgram->Bind();
+		glUniform1i(batchProgram->GetUniform(UNIFORM_FIRST_PROJECTION), first);
+		model->Render();
+	}
+	GLState::Disable(GL_BLEND);
+	GLState::DepthMask(true);
+	GLState::DepthFunc(GL_LESS);
+	GetGPUProfiler()->EndPass();
+	GLCHECK();
+
+	accumTarget->Unbind();
+
+	// divide out the sums over the whole frame
+	GetGPUProfiler()->BeginPass("resolve");
+	GLState::Disable(GL_DEPTH_TEST);
+	resolveProgram->Bind();
+	accumTarget->BindColor(0, 0);
+	quadVao->Bind();
+	glDrawElements(quadIndices->GetType(), quadIndices->GetCount(), GL_UNSIGNED_INT, (void*) 0);
+	GLState::Enable(GL_DEPTH_TEST);
+	GetGPUProfiler()->EndPass();
+	GLCHECK();
+}
+
+void MultiProjViewer::RenderDeferred() {
+	// the G-buffer follows the size of the viewport. Positions need full floats to stay steady up close, and triangle
+	// IDs get an integer attachment of their own so that every ID is exact
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (!gbuffer || gbuffer->GetWidth() != (uint32_t) viewport[2] || gbuffer->GetHeight() != (uint32_t) viewport[3]) {
+		delete gbuffer;
+		GLenum formats[3] = { GL_RGBA32F, GL_RGBA16F, GL_R32UI };
+		gbuffer = new RenderTarget(viewport[2], viewport[3], formats, 3);
+	}
+
+	// only the nearest surface of each pixel is left in the G-buffer, however many triangles cover it
+	GetGPUProfiler()->BeginPass("gbuffer");
+	gbuffer->Bind();
+	glClearColor(0,0,0,0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gbufferProgram->Bind();
 	model->Render();
+	gbuffer->Unbind();
+	GetGPUProfiler()->EndPass();
+	GLCHECK();
+
+	// every covered pixel samples and blends the projections once
+	GetGPUProfiler()->BeginPass("deferred shading");
+	GLState::Disable(GL_DEPTH_TEST);
+	if (useTable) {
+		deferredTopKProgram->Bind();
+		projectionTable->Bind(1);
+	} else {
+		deferredProgram->Bind();
+	}
+	gbuffer->BindColor(0, 3);
+	gbuffer->BindColor(1, 4);
+	gbuffer->BindColor(2, 5);
+	quadVao->Bind();
+	glDrawElements(quadIndices->GetType(), quadIndices->GetCount(), GL_UNSIGNED_INT, (void*) 0);
+	GLState::Enable(GL_DEPTH_TEST);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 }
 
-void MultiProjViewer::NotifyKeyPress(const char* name) {
-	// has to be overridden since it is an abstract function but does nothing
+bool MultiProjViewer::BakeAtlas(const char* toFile) {
+	PROFILE_SCOPE("MultiProjViewer::BakeAtlas");
+
+	PlyModelData source, baked;
+	model->GetData(source);
+	if (!BuildAtlasParameterization(source, ATLAS_SIZE, baked)) {
+		return false;
+	}
+
+	VertexBuffer bakeVertices(&baked.vertices[0], sizeof(PlyVertex) * baked.vertices.size());
+	IndexBuffer bakeIndices(&baked.indices[0], sizeof(uint32_t) * baked.indices.size(), GL_TRIANGLES);
+	VAO bakeVao(&bakeVertices, &bakeIndices);
+	bakeVao.EnableArrays(4);
+
+	// the blend is drawn flattened over the atlas, sampling every projection per texel with the viewer's weighting
+	const char* bakeDefines = "#define FRAGMENT_PROJECTION 1\n#define ATLAS_BAKE 1\n";
+	PixelShader bakePShader("Shaders/multi_textured_light.pix", bakeDefines);
+	VertexShader bakeVShader("Shaders/multi_projected_vertex.vert", bakeDefines);
+	ShaderProgram bakeProgram(&bakePShader, &bakeVShader);
+	bakeProgram.Bind();
+	glUniform1i(bakeProgram.GetUniform(UNIFORM_COLOR_MAP), 0);
+	glUniform1i(bakeProgram.GetUniform(UNIFORM_NUM_PROJECTIONS), numTextures);
+	glUniform1i(bakeProgram.GetUniform(UNIFORM_FIRST_PROJECTION), 0);
+	glUniform1f(bakeProgram.GetUniform(UNIFORM_ALPHA), 1.0f);
+	ApplyVisibility(&bakeProgram);
+	projTextures->Bind(0);
+	if (projectionVisibility) {
+		projectionVisibility->Bind(2);
+	}
+	GLCHECK();
+
+	// texels the mesh covers come out with full alpha, the rest stay clear for dilation to fill
+	GLenum format = GL_RGBA8;
+	RenderTarget atlasTarget(ATLAS_SIZE, ATLAS_SIZE, &format, 1);
+	atlasTarget.Bind();
+	glClearColor(0,0,0,0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	GLState::Disable(GL_DEPTH_TEST);
+	GLState::Disable(GL_BLEND);
+	bakeVao.Bind();
+	glDrawElements(bakeIndices.GetType(), bakeIndices.GetCount(), GL_UNSIGNED_INT, (void*) 0);
+	VAO::Unbind();
+	GLCHECK();
+
+	std::vector<uint8_t> atlas(ATLAS_SIZE * ATLAS_SIZE * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, ATLAS_SIZE, ATLAS_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, &atlas[0]);
+	atlasTarget.Unbind();
+	GLState::Enable(GL_DEPTH_TEST);
+	GLCHECK();
+
+	DilateAtlas(&atlas[0], ATLAS_SIZE, ATLAS_SIZE, ATLAS_CHART_PADDING);
+
+	// SavePNG takes RGB
+	for (uint32_t i = 0; i < ATLAS_SIZE * ATLAS_SIZE; i++) {
+		atlas[i * 3] = atlas[i * 4];
+		atlas[i * 3 + 1] = atlas[i * 4 + 1];
+		atlas[i * 3 + 2] = atlas[i * 4 + 2];
+	}
+	std::string atlasFile = std::string(toFile) + ".atlas.png";
+	Texture::SavePNG(atlasFile.c_str(), ATLAS_SIZE, ATLAS_SIZE, &atlas[0]);
+
+	if (!PlyModel::Save(toFile, baked)) {
+		return false;
+	}
+	Log("Baked %d projections into '%s'", numTextures, atlasFile.c_str());
+	return true;
 }
 
-void MultiProjViewer::NotifyMouseWheel(float amt, bool controlHeld) {
-	// mouse wheel is used to determine camera distance (how the model is scaled in the perspective view)
-	cameraDistance += baseCameraDistance * -0.005f * amt * (controlHeld ? 0.1f : 1.0f);
+bool MultiProjViewer::BakeVertexColors(const char* toFile) {
+	PlyModelData data;
+	model->GetData(data);
+	::BakeVertexColors(data.vertices, projections->texMatrix, textureFile, edgeFile);
+	return PlyModel::Save(toFile, data);
 }
 
-void MultiProjViewer::NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld) {
-	const float p = glm::pi<float>();
-
-	if (button == 2) {
-		// right mouse click and up/down will rotate along the z axis
-		rotation.z += y * 0.01f;
-		if (rotation.z > p * 2.0f)
-			rotation.z -= p * 2.0f;
-		if (rotation.z < p * -2.0f)
-			rotation.z += p * 2.0f;
-	} else if (button == 1) {
-		// middle click will offset (math here uses the current view direction to determine up / down )
-		center.x += viewMatrix[0].x * x / 1000.0f * cameraDistance;
-		center.y += viewMatrix[0].y * x / 1000.0f * cameraDistance;
-		center.z += viewMatrix[0].z * x / 1000.0f * cameraDistance;
-		center.x += viewMatrix[1].x * y / 1000.0f * cameraDistance;
-		center.y += viewMatrix[1].y * y / 1000.0f * cameraDistance;
-		center.z += viewMatrix[1].z * y / 1000.0f * cameraDistance;
-	} else if (button == 0) {
-		// left click will rotate about x and y (pitch and yaw respectively)
-		rotation.x += x * 0.01f;
-		rotation.y -= y * 0.01f;
-		if (rotation.x > p * 2.0f)
-			rotation.x -= p * 2.0f;
-		if (rotation.x < p * -2.0f)
-			rotation.x += p * 2.0f;
-		if (rotation.y > p * 2.0f)
-			rotation.y -= p * 2.0f;
-		if (rotation.y < p * -2.0f)
-			rotation.y += p * 2.0f;
+void MultiProjViewer::NotifyKeyPress(const char* name) {
+	// p toggles per stage GPU profiling
+	if (!strcmp(name, "p")) {
+		profileStages = !profileStages;
+		Log("Stage profiling %s", profileStages ? "on" : "off");
+	}
+
+	// t toggles sampling only the projections picked by the table
+	if (!strcmp(name, "t") && projectionTable) {
+		useTable = !useTable;
+		Log("Projection table %s", useTable ? "on" : "off");
 	}
+
+	// v toggles skipping the projections that can't see a triangle
+	if (!strcmp(name, "v") && projectionVisibility) {
+		useVisibility = !useVisibility;
+		ApplyVisibilityToAll();
+		Log("Projection visibility %s", useVisibility ? "on" : "off");
+	}
+
+	// a toggles accumulating the projections in batches
+	if (!strcmp(name, "a")) {
+		accumulate = !accumulate;
+		Log("Batched accumulation %s", accumulate ? "on" : "off");
+	}
+
+	// d toggles deferred shading from the G-buffer
+	if (!strcmp(name, "d")) {
+		deferred = !deferred;
+		Log("Deferred shading %s", deferred ? "on" : "off");
+	}
+}
+
+bool MultiProjViewer::IsAnimating() {
+	return profileStages;
 }
 
 MultiProjViewer::~MultiProjViewer() {
 	// clean up 
-	delete program;
-	GLCHECK();
-	delete pShader;
-	GLCHECK();
-	delete vShader;
-	GLCHECK();
 	delete model;
 	GLCHECK();
 
-	for (uint32_t i = 0; i < numTextures; i++) {
-		delete projTexture[i];
-	}
+	delete projectedBuffer;
+	delete projectionTable;
+	delete projectionVisibility;
+	delete projTextures;
+	delete projectionBuffer;
+	delete projections;
+	GLCHECK();
+
+	delete accumTarget;
+	delete gbuffer;
+	delete gbufferProgram;
+	delete gbufferPShader;
+	delete gbufferVShader;
+	delete quadVao;
+	delete quadBuffer;
+	delete quadIndices;
+	delete resolveProgram;
+	delete resolvePShader;
+	delete resolveVShader;
+	delete depthProgram;
+	delete depthPShader;
+	delete depthVShader;
 	GLCHECK();
 	
 	glClearColor(1,1,1,1);
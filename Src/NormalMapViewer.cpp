@@ -1,5 +1,7 @@
 
 #include "SpecViz.h"
+#include "GPUProfiler.h"
+#include "Profiler.h"
 #include "PlyModel.h"
 
 class NormalMapViewer : public Viewer {
@@ -29,6 +31,7 @@ public:
 };
 
 Viewer* CreateNormalMapViewer(const char* normalMap, const char* colorMap) {
+	PROFILE_SCOPE("CreateNormalMapViewer");
 	NormalMapViewer* newViewer = new NormalMapViewer(normalMap, colorMap);
 	return newViewer;
 }
@@ -48,6 +51,11 @@ NormalMapViewer::NormalMapViewer(const char* normalFile, const char* colorFile)
 	pShader = new PixelShader("Shaders/world_normal.pix");
 	vShader = new VertexShader("Shaders/passthrough.vert");
 	program = new ShaderProgram(pShader, vShader);
+
+	// uniforms that never change are set once up front
+	program->Bind();
+	glUniform1i(program->GetUniform(UNIFORM_NORMAL_MAP), 0);
+	glUniform1i(program->GetUniform(UNIFORM_COLOR_MAP), 1);
 	
 	normalTexture = Texture::CreateFromFile(normalFile, GL_RGBA8);
 	colorTexture = Texture::CreateFromFile(colorFile, GL_RGBA8);
@@ -79,14 +87,16 @@ void NormalMapViewer::MainLoop(float deltaTime) {
 	GLCHECK();
 
 	// set up z write/read
-	glDepthMask(GL_FALSE);
-	glDisable(GL_DEPTH_TEST);
+	GLState::DepthMask(false);
+	GLState::Disable(GL_DEPTH_TEST);
 	GLCHECK();
 
 	// clear frame buffer
+	GetGPUProfiler()->BeginPass("clear");
 	glClearColor(0,0,0,1);
 	glClearDepth(1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 
 	// bind program
@@ -108,12 +118,7 @@ void NormalMapViewer::MainLoop(float deltaTime) {
 	lightDirection = glm::normalize(glm::vec3(cos(lightYaw) * pitchVar, sin(lightPitch), sin(lightYaw) * pitchVar));
 	
 	GLCHECK();
-	glUniformMatrix4fv(program->GetUniform("projMatrix"), 1, GL_FALSE, &projMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-	glUniform3fv(program->GetUniform("lightDirection"), 1, &lightDirection.x);
-	glUniform3fv(program->GetUniform("eyePosition"), 1, &eyePosition.x);
-	glUniform1i(program->GetUniform("normalMap"), 0);
-	glUniform1i(program->GetUniform("colorMap"), 1);
+	SetCameraBlock(CameraBlock(glm::mat4(), viewMatrix, projMatrix, eyePosition, lightDirection));
 	GLCHECK();
 
 	// bind texture
@@ -121,8 +126,10 @@ void NormalMapViewer::MainLoop(float deltaTime) {
 	colorTexture->Bind(1);
 
 	// draw our quad
+	GetGPUProfiler()->BeginPass("background");
 	vao->Bind();
 	glDrawElements(iBuffer->GetType(), iBuffer->GetCount(), GL_UNSIGNED_INT, (void*) 0);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 }
 
@@ -0,0 +1,59 @@
+#include "OrbitViewer.h"
+#include "PlyModel.h"
+
+OrbitViewer::OrbitViewer() : rotation(0.0f, 0.0f, 0.0f), center(0.0f, 0.0f, 0.0f), cameraDistance(1.0f),
+	baseCameraDistance(1.0f), model(NULL) {
+}
+
+void OrbitViewer::NotifyMouseWheel(float amt, bool controlHeld) {
+	// mouse wheel is used to determine camera distance (how the model is scaled in the perspective view)
+	cameraDistance += baseCameraDistance * -0.005f * amt * (controlHeld ? 0.1f : 1.0f);
+}
+
+void OrbitViewer::NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld) {
+	const float p = glm::pi<float>();
+
+	if (button == 2) {
+		// right mouse click and up/down will rotate along the z axis
+		rotation.z += y * 0.01f;
+		if (rotation.z > p * 2.0f)
+			rotation.z -= p * 2.0f;
+		if (rotation.z < p * -2.0f)
+			rotation.z += p * 2.0f;
+	} else if (button == 1) {
+		// middle click will offset (math here uses the current view direction to determine up / down )
+		center.x += viewMatrix[0].x * x / 1000.0f * cameraDistance;
+		center.y += viewMatrix[0].y * x / 1000.0f * cameraDistance;
+		center.z += viewMatrix[0].z * x / 1000.0f * cameraDistance;
+		center.x += viewMatrix[1].x * y / 1000.0f * cameraDistance;
+		center.y += viewMatrix[1].y * y / 1000.0f * cameraDistance;
+		center.z += viewMatrix[1].z * y / 1000.0f * cameraDistance;
+	} else if (button == 0) {
+		// left click will rotate about x and y (pitch and yaw respectively)
+		rotation.x += x * 0.01f;
+		rotation.y -= y * 0.01f;
+		if (rotation.x > p * 2.0f)
+			rotation.x -= p * 2.0f;
+		if (rotation.x < p * -2.0f)
+			rotation.x += p * 2.0f;
+		if (rotation.y > p * 2.0f)
+			rotation.y -= p * 2.0f;
+		if (rotation.y < p * -2.0f)
+			rotation.y += p * 2.0f;
+	}
+}
+
+void OrbitViewer::NotifyMouseDoubleClick(float x, float y) {
+	glm::vec3 point;
+	if (model && model->Pick(projMatrix * viewMatrix * objMatrix, x, y, point)) {
+		center = glm::vec3(objMatrix * glm::vec4(point, 1.0f));
+		Log("Picked model point (%.4f, %.4f, %.4f)", point.x, point.y, point.z);
+	}
+}
+
+bool OrbitViewer::SetCameraPose(const CameraPose& pose) {
+	rotation = pose.rotation;
+	center = pose.center;
+	cameraDistance = baseCameraDistance * pose.distance;
+	return true;
+}
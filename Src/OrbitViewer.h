@@ -0,0 +1,33 @@
+#pragma once
+
+#include "SpecViz.h"
+
+class PlyModel;
+
+// base of the viewers that orbit a camera around a single model (ModelViewer, ProjViewer and MultiProjViewer), holding
+// the camera state they share and the mouse handling that moves it
+class OrbitViewer : public Viewer {
+public:
+	glm::vec3 rotation;
+	glm::vec3 center;
+	glm::mat4 objMatrix;
+	glm::mat4 viewMatrix;
+	glm::mat4 projMatrix;
+
+	float cameraDistance;
+	float baseCameraDistance;	// distance the model is first viewed from
+
+	PlyModel* model;
+
+	OrbitViewer();
+
+	// the wheel moves the camera in and out, and dragging rotates the model (left and right buttons) or moves the
+	// center (middle button)
+	void NotifyMouseWheel(float amt, bool controlHeld);
+	void NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld);
+
+	// orbits around the point on the model that was double clicked
+	void NotifyMouseDoubleClick(float x, float y);
+
+	bool SetCameraPose(const CameraPose& pose);
+};
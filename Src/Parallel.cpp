@@ -0,0 +1,47 @@
+#include "Parallel.h"
+#include <thread>
+#include <atomic>
+
+uint32_t GetWorkerCount() {
+	uint32_t count = std::thread::hardware_concurrency();
+	return count ? count : 1;
+}
+
+void ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& func) {
+	if (grainSize == 0) {
+		grainSize = 1;
+	}
+
+	uint32_t numChunks = (count + grainSize - 1) / grainSize;
+	if (numChunks <= 1) {
+		if (count) {
+			func(0, count);
+		}
+		return;
+	}
+
+	// each thread (including this one) keeps grabbing the next chunk until all are taken
+	std::atomic<uint32_t> nextChunk(0);
+	auto worker = [&]() {
+		uint32_t chunk;
+		while ((chunk = nextChunk++) < numChunks) {
+			uint32_t begin = chunk * grainSize;
+			uint32_t end = begin + grainSize < count ? begin + grainSize : count;
+			func(begin, end);
+		}
+	};
+
+	uint32_t numThreads = GetWorkerCount();
+	if (numThreads > numChunks) {
+		numThreads = numChunks;
+	}
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < numThreads; i++) {
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+	for (uint32_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "SpecViz.h"
+#include <functional>
+
+// returns the number of worker threads used for parallel work (the number of hardware threads available)
+uint32_t GetWorkerCount();
+
+// splits the range [0, count) into chunks of at most grainSize and runs func(begin, end) on each chunk across all
+// worker threads, returning once every chunk is done. Runs inline when the range fits in a single chunk
+void ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& func);
@@ -1,25 +1,18 @@
 
 #include "PlyModel.h"
+#include "FileWatcher.h"
+#include "Arena.h"
+#include "MeshArchive.h"
+#include "BVH.h"
+#include "Profiler.h"
 #include <fstream>
+#include <algorithm>
 #include <vector>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
-// struct represents a vertex used for PlyModels in both the loading process and how vertices stored in data for GPU
-struct PlyVertex {
-	glm::vec3 position;
-	glm::vec2 uv;
-	glm::vec4 color;
-	glm::vec3 normal;
-
-	PlyVertex() {
-		position = glm::vec3(0,0,0);
-		uv = glm::vec2(0.5,0.5);
-		color = glm::vec4(1,1,1,1);
-		normal = glm::vec3(0,0,0);
-	}
-};
-
 // verious PLY property types that represent various  OpenGL vertex attributes or their components
 enum PlyPropertyType {
 	PPT_X,
@@ -124,11 +117,15 @@ T byte_swap(T& withValue) {
 	return *((T*)&ret);
 }
 
+// elements and everything they allocate while reading the header live in the loader's arena
 struct PlyElement {
-	std::vector<PlyProperty> properties;
+	std::vector<PlyProperty, ArenaAllocator<PlyProperty> > properties;
 	const char* name; 
 	uint32_t count;
 
+	PlyElement(MemoryArena* arena) : properties(ArenaAllocator<PlyProperty>(arena)), name(NULL), count(0) {
+	}
+
 	virtual void prepare() {
 	}
 
@@ -267,20 +264,18 @@ struct PlyElement {
 	}
 
 	virtual ~PlyElement() {
-		if (name) {
-			free((void*) name);
-			name = NULL;
-		}
 	}
 };
 
 struct VertexPlyElement : public PlyElement {
 	std::vector<PlyVertex> vertices;
 
+	VertexPlyElement(MemoryArena* arena) : PlyElement(arena) {
+	}
+
 	void prepare() {
-		for (uint32_t i = 0; i < count; i++) {
-			vertices.push_back(PlyVertex());
-		}
+		// the count is known up front, so size the array once rather than growing it
+		vertices.resize(count);
 	}
 
 	virtual void read_prop_float(uint32_t index, PlyPropertyType type, float value) {
@@ -302,10 +297,6 @@ struct VertexPlyElement : public PlyElement {
 		}
 	}
 
-	VertexBuffer* CreateVertexBuffer() {
-		return new VertexBuffer(&vertices[0], sizeof(PlyVertex) * vertices.size());
-	}
-
 	void calc_bounds(glm::vec3& intoMin, glm::vec3& intoMax) {
 		intoMin = vertices[0].position;
 		intoMax = vertices[0].position;
@@ -373,6 +364,14 @@ struct VertexPlyElement : public PlyElement {
 struct FacePlyElement : public PlyElement {
 	std::vector<uint32_t> indices;
 
+	FacePlyElement(MemoryArena* arena) : PlyElement(arena) {
+	}
+
+	void prepare() {
+		// assume triangles, quads will grow the array past this
+		indices.reserve(count * 3);
+	}
+
 	uint32_t get_highest() {
 		uint32_t ret = 0;
 		for (uint32_t i = 0; i < indices.size(); i++) {
@@ -454,13 +453,32 @@ struct FacePlyElement : public PlyElement {
 		// otherwise currently unsupported:
 		PlyElement::read_prop_list_binary(index, type, count, file, bigEndian);
 	}
+};
+
+bool PlyModel::Load(const char* filename, PlyModelData& into, const glm::vec3* withOffset) {
+	PROFILE_SCOPE("PlyModel::Load");
 
-	IndexBuffer* CreateIndexBuffer() {
-		return new IndexBuffer(&indices[0], 4 * indices.size(), GL_TRIANGLES);
+	// compressed mesh archives are decoded directly rather than parsed
+	if (IsMeshArchive(filename)) {
+		if (!LoadMeshArchive(filename, into)) {
+			return false;
+		}
+
+		// archives are stored centered, so only move the positions if a different center was asked for
+		if (withOffset && *withOffset != into.centerOffset) {
+			glm::vec3 delta = *withOffset - into.centerOffset;
+			for (uint32_t i = 0; i < into.vertices.size(); i++) {
+				into.vertices[i].position += delta;
+			}
+			into.centerOffset = *withOffset;
+		}
+		return true;
 	}
-};
 
-PlyModel::PlyModel(const char* filename) : vao(NULL), iBuffer(NULL), vBuffer(NULL) {
+	// all transient loader state is allocated from this arena and released at once when the load returns
+	MemoryArena arena(64 * 1024);
+	int32_t heapAllocsBefore = GetHeapAllocationCount();
+
 	fstream file(filename);
 	char buffer[512], buffer2[512], buffer3[512];
 
@@ -469,7 +487,7 @@ PlyModel::PlyModel(const char* filename) : vao(NULL), iBuffer(NULL), vBuffer(NUL
 	if (strcmp(buffer, "ply")) {
 		file.close();
 		Log("Not a ply file.");
-		return;
+		return false;
 	}
 	file >> buffer >> buffer2 >> buffer3;
 
@@ -484,13 +502,14 @@ PlyModel::PlyModel(const char* filename) : vao(NULL), iBuffer(NULL), vBuffer(NUL
 	if (strcmp(buffer, "format") || strcmp(buffer3, "1.0") || (!isAscii && !isBinary)) {
 		file.close();
 		Log("Not an ascii or binary 1.0 formatted ply file.");
-		return;
+		return false;
 	}
 
 	// read in our elements and their associated properties:
 	VertexPlyElement* vertElement = NULL;
 	FacePlyElement* faceElement = NULL;
-	std::vector<PlyElement*> elements;
+	ArenaAllocator<PlyElement*> elementAlloc(&arena);
+	std::vector<PlyElement*, ArenaAllocator<PlyElement*> > elements(elementAlloc);
 	do {
 		file >> buffer;
 		while (!strcmp(buffer, "element")) {
@@ -499,15 +518,15 @@ PlyModel::PlyModel(const char* filename) : vao(NULL), iBuffer(NULL), vBuffer(NUL
 			file >> count;			// element count
 			PlyElement* newElement;
 			if (!strcmp(buffer, "vertex")) {
-				newElement = new VertexPlyElement;
+				newElement = arena.New<VertexPlyElement>(&arena);
 				vertElement = (VertexPlyElement*) newElement;
 			} else if (!strcmp(buffer, "face")) {
-				newElement = new FacePlyElement;
+				newElement = arena.New<FacePlyElement>(&arena);
 				faceElement = (FacePlyElement*) newElement;
 			} else {
-				newElement = new PlyElement;
+				newElement = arena.New<PlyElement>(&arena);
 			};
-			newElement->name = _strdup(buffer);
+			newElement->name = arena.StrDup(buffer);
 			newElement->count = count;
 
 			// read in properties
@@ -534,16 +553,20 @@ PlyModel::PlyModel(const char* filename) : vao(NULL), iBuffer(NULL), vBuffer(NUL
 
 			elements.push_back(newElement);
 		}
-	} while (strcmp(buffer, "end_header"));		// read until the end of the header
+	} while (strcmp(buffer, "end_header") && !file.eof());		// read until the end of the header
 
 	// error if there isn't a vertex or face element set up:
 	if (!vertElement || !faceElement) {
 		Log("Couldn't find both vertices and faces in the ply file for loading!");
+		for (uint32_t i = 0; i < elements.size(); i++) {
+			elements[i]->~PlyElement();
+		}
 		file.close();
-		return;
+		return false;
 	}
 
 	// allow each element to read itself in:
+	PROFILE_BEGIN(parseScope, "parse ply");
 	if (isAscii) {
 		for (uint32_t i = 0; i < elements.size(); i++) {
 			elements[i]->read_ascii(file);
@@ -557,12 +580,11 @@ PlyModel::PlyModel(const char* filename) : vao(NULL), iBuffer(NULL), vBuffer(NUL
 		uint32_t offset = (uint32_t) file.tellg();
 		file.close();
 		file.open(filename, std::ifstream::in | std::ifstream::binary);
-		char* textHeader = (char*) malloc(offset+1);
+		char* textHeader = (char*) arena.Alloc(offset+1, 1);
 		memset(textHeader, 0, offset+1);
 		file.read(textHeader, offset);
 		char* endOffset = strstr(textHeader, "end_header") + 9;
 		uint32_t offsetHeader = endOffset - textHeader;
-		free((void*) textHeader);
 
 		file.seekg(offsetHeader);
 		while (file.get() != 0x0a) {}
@@ -570,48 +592,360 @@ PlyModel::PlyModel(const char* filename) : vao(NULL), iBuffer(NULL), vBuffer(NUL
 		for (uint32_t i = 0; i < elements.size(); i++) {
 			elements[i]->read_binary(file, bigEndian);
 		}
-
-		PlyVertex lastV = vertElement->vertices.back();
-		int i = 1;
 	}
+	PROFILE_END(parseScope);
 
-	// get the highest referenced index
+	// a file that is still being written out may be cut short, so make sure all faces reference loaded vertices
 	uint32_t highestRef = faceElement->get_highest();
-	while (highestRef+1 < vertElement->vertices.size()) {
-		vertElement->vertices.pop_back();
+	if (faceElement->indices.empty() || highestRef >= vertElement->vertices.size()) {
+		Log("Ply file '%s' is incomplete.", filename);
+		for (uint32_t i = 0; i < elements.size(); i++) {
+			elements[i]->~PlyElement();
+		}
+		file.close();
+		return false;
+	}
+
+	// trim any vertices past the highest referenced index
+	if (highestRef+1 < vertElement->vertices.size()) {
+		vertElement->vertices.resize(highestRef+1);
 	}
 
 	// calculate resulting model scale:
-	vertElement->calc_bounds(boundMin, boundMax);
+	vertElement->calc_bounds(into.boundMin, into.boundMax);
 
 	// and center the mesh for better viewing:
-	vertElement->offset(-vertElement->calc_avg());
+	into.centerOffset = withOffset ? *withOffset : -vertElement->calc_avg();
+	vertElement->offset(into.centerOffset);
 
 	// if the vertex element didn't contain normal information, then compute them:
 	if (!vertElement->has_type(PPT_NX)) {
+		PROFILE_SCOPE("construct normals");
 		vertElement->construct_normals(faceElement->indices);
 	}
 
+	// hand the loaded data over to the caller
+	into.vertices.swap(vertElement->vertices);
+	into.indices.swap(faceElement->indices);
+
+	// done! destroy the elements (their memory goes with the arena)
+	for (uint32_t i = 0; i < elements.size(); i++) {
+		elements[i]->~PlyElement();
+	}
+
+	file.close();
+
+	int32_t heapAllocsAfter = GetHeapAllocationCount();
+	if (heapAllocsBefore >= 0) {
+		Log("Loaded '%s': %d heap allocations (before %d, after %d), %d arena allocations in %d blocks",
+			filename, heapAllocsAfter - heapAllocsBefore, heapAllocsBefore, heapAllocsAfter, arena.GetAllocCount(), arena.GetBlockCount());
+	} else {
+		Log("Loaded '%s': %d arena allocations in %d blocks (%d bytes)",
+			filename, arena.GetAllocCount(), arena.GetBlockCount(), (uint32_t) arena.GetBytesUsed());
+	}
+	return true;
+}
+
+bool PlyModel::Save(const char* filename, const PlyModelData& data) {
+	PROFILE_SCOPE("PlyModel::Save");
+
+	FILE* f = NULL;
+	fopen_s(&f, filename, "wb");
+	if (!f) {
+		Log("Unable to write ply file '%s'", filename);
+		return false;
+	}
+
+	uint32_t numTriangles = data.indices.size() / 3;
+	fprintf(f, "ply\nformat binary_little_endian 1.0\n");
+	fprintf(f, "element vertex %d\n", (uint32_t) data.vertices.size());
+	fprintf(f, "property float x\nproperty float y\nproperty float z\n");
+	fprintf(f, "property float nx\nproperty float ny\nproperty float nz\n");
+	fprintf(f, "property float u\nproperty float v\n");
+	fprintf(f, "property uchar red\nproperty uchar green\nproperty uchar blue\n");
+	fprintf(f, "element face %d\n", numTriangles);
+	fprintf(f, "property list uchar int vertex_indices\nend_header\n");
+
+	for (uint32_t i = 0; i < data.vertices.size(); i++) {
+		const PlyVertex& vertex = data.vertices[i];
+		glm::vec3 position = vertex.position - data.centerOffset;
+		float values[8] = {
+			position.x, position.y, position.z,
+			vertex.normal.x, vertex.normal.y, vertex.normal.z,
+			vertex.uv.x, vertex.uv.y
+		};
+		fwrite(values, sizeof(values), 1, f);
+
+		glm::vec3 color = glm::clamp(glm::vec3(vertex.color), 0.0f, 1.0f) * 255.0f + 0.5f;
+		uint8_t rgb[3] = { (uint8_t) color.r, (uint8_t) color.g, (uint8_t) color.b };
+		fwrite(rgb, sizeof(rgb), 1, f);
+	}
+
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		uint8_t count = 3;
+		fwrite(&count, 1, 1, f);
+		fwrite(&data.indices[t * 3], sizeof(uint32_t), 3, f);
+	}
+
+	fclose(f);
+	Log("Saved '%s' (%d vertices, %d triangles)", filename, (uint32_t) data.vertices.size(), numTriangles);
+	return true;
+}
+
+void PlyModel::GetData(PlyModelData& into) const {
+	into.vertices = vertices;
+	into.indices = indices;
+	into.boundMin = boundMin;
+	into.boundMax = boundMax;
+	into.centerOffset = centerOffset;
+}
+
+PlyModel::PlyModel(const char* fromFile) : vao(NULL), iBuffer(NULL), vBuffer(NULL), positionStream(false),
+	positionVao(NULL), positionBuffer(NULL), watcher(NULL), reloadJob(NULL), bvh(NULL) {
+	filename = _strdup(fromFile);
+
+	PlyModelData data;
+	if (!Load(filename, data)) {
+		return;
+	}
+
+	vertices.swap(data.vertices);
+	indices.swap(data.indices);
+	boundMin = data.boundMin;
+	boundMax = data.boundMax;
+	centerOffset = data.centerOffset;
+
+	CreateBuffers();
+}
+
+void PlyModel::CreateBuffers() {
+	PROFILE_SCOPE("upload model buffers");
+
 	// construct vertex buffer from vertex element:
-	vBuffer = vertElement->CreateVertexBuffer();
+	vBuffer = new VertexBuffer(&vertices[0], sizeof(PlyVertex) * vertices.size());
 
 	// construct index buffer from index element:
-	iBuffer = faceElement->CreateIndexBuffer();
+	iBuffer = new IndexBuffer(&indices[0], sizeof(uint32_t) * indices.size(), GL_TRIANGLES);
 
 	// construct vertex array object using both buffers and our common "ply" format:
 	vao = new VAO(vBuffer, iBuffer);
 	vao->EnableArrays(4);
 	vao->Unbind();
 
-	// done! delete elements list
-	for (uint32_t i = 0; i < elements.size(); i++) {
-		delete elements[i];
+	if (positionStream) {
+		CreatePositionStream();
+	}
+}
+
+void PlyModel::CreatePositionStream() {
+	positions.resize(vertices.size());
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		positions[i] = vertices[i].position;
 	}
+	positionBuffer = new VertexBuffer(&positions[0], sizeof(glm::vec3) * positions.size());
+	positionVao = new VAO(positionBuffer, iBuffer);
+	positionVao->EnableArrays(1);
+	positionVao->Unbind();
+}
 
-	file.close();
+void PlyModel::DestroyBuffers() {
+	VAO::Unbind();
+	delete vao;
+	delete positionVao;
+	delete vBuffer;
+	delete positionBuffer;
+	delete iBuffer;
+	vao = NULL;
+	positionVao = NULL;
+	vBuffer = NULL;
+	positionBuffer = NULL;
+	iBuffer = NULL;
+}
+
+void PlyModel::EnablePositionStream() {
+	// a model that failed to load gets the stream along with its buffers, if a reload brings them
+	if (!positionStream) {
+		positionStream = true;
+		if (vBuffer) {
+			CreatePositionStream();
+			GLCHECK();
+		}
+	}
+}
+
+// a reload of the model file running on a background thread
+struct PlyReloadJob {
+	std::thread thread;
+	std::atomic<bool> done;
+	bool succeeded;
+	PlyModelData data;
+
+	PlyReloadJob() : done(false), succeeded(false) {
+	}
+};
+
+// runs of changed elements closer than this are uploaded together, since many small glBufferSubData calls cost more
+// than sending a few unchanged elements along with them
+#define RELOAD_MERGE_GAP 64
+
+// compares the resident elements with the incoming ones and uploads each changed range into the given buffer,
+// updating the resident copy as it goes. Returns the number of bytes uploaded
+template<class T, class B>
+uint32_t UploadChangedRanges(B* buffer, std::vector<T>& resident, const std::vector<T>& incoming) {
+	uint32_t uploaded = 0;
+	uint32_t count = resident.size();
+	uint32_t i = 0;
+	while (i < count) {
+		// skip to the next changed element
+		if (!memcmp(&resident[i], &incoming[i], sizeof(T))) {
+			i++;
+			continue;
+		}
+
+		// extend the range until RELOAD_MERGE_GAP unchanged elements in a row are found
+		uint32_t first = i;
+		uint32_t last = i;
+		for (i++; i < count && i - last <= RELOAD_MERGE_GAP; i++) {
+			if (memcmp(&resident[i], &incoming[i], sizeof(T))) {
+				last = i;
+			}
+		}
+
+		uint32_t rangeSize = (last - first + 1) * sizeof(T);
+		std::copy(&incoming[first], &incoming[last] + 1, &resident[first]);
+		buffer->Update(first * sizeof(T), &resident[first], rangeSize);
+		uploaded += rangeSize;
+	}
+
+	return uploaded;
+}
+
+void PlyModel::ApplyReload(PlyModelData& data) {
+	boundMin = data.boundMin;
+	boundMax = data.boundMax;
+
+	// the BVH no longer matches the model, rebuild it next time it's needed
+	delete bvh;
+	bvh = NULL;
+
+	if (!vBuffer || data.vertices.size() != vertices.size() || data.indices.size() != indices.size()) {
+		// the topology changed, so the buffers can't be patched in place. Swap in entirely new ones
+		vertices.swap(data.vertices);
+		indices.swap(data.indices);
+		DestroyBuffers();
+		CreateBuffers();
+		GLCHECK();
+
+		Log("Reloaded '%s' (%d vertices, %d triangles, full upload)", filename, (uint32_t) vertices.size(),
+			(uint32_t) (indices.size() / 3));
+		return;
+	}
+
+	// the position stream is compared against its own resident copy, before the vertices take on the new data
+	uint32_t positionBytes = 0;
+	if (positionStream) {
+		std::vector<glm::vec3> newPositions(data.vertices.size());
+		for (uint32_t i = 0; i < data.vertices.size(); i++) {
+			newPositions[i] = data.vertices[i].position;
+		}
+		positionBytes = UploadChangedRanges(positionBuffer, positions, newPositions);
+	}
+
+	uint32_t vertexBytes = UploadChangedRanges(vBuffer, vertices, data.vertices);
+	uint32_t indexBytes = UploadChangedRanges(iBuffer, indices, data.indices);
+	GLCHECK();
+
+	Log("Reloaded '%s' (%d of %d vertex bytes, %d of %d index bytes uploaded)", filename,
+		vertexBytes + positionBytes,
+		(uint32_t) (vertices.size() * sizeof(PlyVertex) + positions.size() * sizeof(glm::vec3)),
+		indexBytes, (uint32_t) (indices.size() * sizeof(uint32_t)));
+}
+
+void PlyModel::EnableHotReload() {
+	if (!watcher) {
+		watcher = new FileWatcher(filename);
+	}
+}
+
+bool PlyModel::PollReload() {
+	if (!watcher) {
+		return false;
+	}
+
+	// kick off a background load as soon as the file has finished changing (one at a time, any further changes
+	// made during the load are picked up by the next poll once it's done)
+	if (!reloadJob && watcher->HasChanged()) {
+		PlyReloadJob* job = new PlyReloadJob;
+		const char* path = filename;
+		glm::vec3 offset = centerOffset;
+		job->thread = std::thread([job, path, offset]() {
+			job->succeeded = PlyModel::Load(path, job->data, &offset);
+			job->done = true;
+		});
+		reloadJob = job;
+	}
+
+	if (!reloadJob || !reloadJob->done) {
+		return false;
+	}
+
+	// the load finished, bring the result over to the GPU
+	reloadJob->thread.join();
+	bool changed = reloadJob->succeeded;
+	if (changed) {
+		ApplyReload(reloadJob->data);
+	}
+	delete reloadJob;
+	reloadJob = NULL;
+
+	return changed;
+}
+
+const BVH* PlyModel::GetBVH() {
+	if (!bvh) {
+		bvh = new BVH(vertices, indices);
+		Log("Built BVH for '%s' (%d nodes) in %.1f ms", filename, bvh->GetNodeCount(), bvh->GetBuildTime() * 1000.0f);
+	}
+	return bvh;
+}
+
+bool PlyModel::Pick(const glm::mat4& objViewProj, float x, float y, glm::vec3& intoPoint) {
+	if (indices.empty()) {
+		return false;
+	}
+
+	Ray ray = BVH::GetScreenRay(objViewProj, x, y);
+	RayHit hit;
+	if (!GetBVH()->Intersect(ray, hit)) {
+		return false;
+	}
+
+	intoPoint = ray.origin + ray.direction * hit.t;
+	return true;
+}
+
+PlyModel::~PlyModel() {
+	if (reloadJob) {
+		reloadJob->thread.join();
+		delete reloadJob;
+	}
+	delete watcher;
+	delete bvh;
+
+	DestroyBuffers();
+	free((void*) filename);
 }
 
 void PlyModel::Render() {
 	vao->Bind();
 	glDrawElements(iBuffer->GetType(), iBuffer->GetCount(), GL_UNSIGNED_INT, (void*) 0);
-}
\ No newline at end of file
+}
+
+void PlyModel::RenderPositions() {
+	if (!positionVao) {
+		Render();
+		return;
+	}
+	positionVao->Bind();
+	glDrawElements(iBuffer->GetType(), iBuffer->GetCount(), GL_UNSIGNED_INT, (void*) 0);
+}
@@ -2,6 +2,33 @@
 
 #include "SpecViz.h"
 
+class FileWatcher;
+struct PlyReloadJob;
+class BVH;
+
+// struct represents a vertex used for PlyModels in both the loading process and how vertices stored in data for GPU
+struct PlyVertex {
+	glm::vec3 position;
+	glm::vec2 uv;
+	glm::vec4 color;
+	glm::vec3 normal;
+
+	PlyVertex() {
+		position = glm::vec3(0,0,0);
+		uv = glm::vec2(0.5,0.5);
+		color = glm::vec4(1,1,1,1);
+		normal = glm::vec3(0,0,0);
+	}
+};
+
+// CPU side model data as read from a PLY file, before it is sent to OpenGL
+struct PlyModelData {
+	std::vector<PlyVertex> vertices;
+	std::vector<uint32_t> indices;
+	glm::vec3 boundMin, boundMax;
+	glm::vec3 centerOffset;			// offset that was applied to all positions to center the mesh
+};
+
 // representation of a PLY Model used for the viewer
 class PlyModel {
 protected:
@@ -12,12 +39,58 @@ protected:
 	IndexBuffer* iBuffer;
 	VertexBuffer* vBuffer;
 
+	// optional tightly packed copy of just the positions, with a VAO of its own sharing the index buffer, for passes
+	// that only write depth (a quarter of the vertex fetch of the full layout)
+	bool positionStream;
+	VAO* positionVao;
+	VertexBuffer* positionBuffer;
+	std::vector<glm::vec3> positions;
+
 	// bounds for the mesh (used to determine default camera placement, etc)
 	glm::vec3 boundMin, boundMax;
 
+	// resident copy of the data last sent to the GPU, used to find what changed when the file is reloaded
+	std::vector<PlyVertex> vertices;
+	std::vector<uint32_t> indices;
+	glm::vec3 centerOffset;
+
+	// hot reload support: the watched file and the background load currently in flight (if any)
+	const char* filename;
+	FileWatcher* watcher;
+	PlyReloadJob* reloadJob;
+
+	// ray query acceleration structure over the resident data, built on first use
+	BVH* bvh;
+
+	// creates the vertex buffer, index buffer and VAO from the resident data (and the position stream, if enabled)
+	void CreateBuffers();
+
+	// frees the vertex buffer, index buffer and VAO (and the position stream)
+	void DestroyBuffers();
+
+	// creates the position only vertex buffer and VAO from the resident data, once the index buffer exists
+	void CreatePositionStream();
+
+	// replaces the resident data with the reloaded data, uploading only what changed where possible
+	void ApplyReload(PlyModelData& data);
+
 public:
 	// create a ply model from the given PLY file path
-	PlyModel(const char* filename);
+	PlyModel(const char* fromFile);
+
+	// destructor
+	virtual ~PlyModel();
+
+	// reads the given PLY file into CPU side data without touching OpenGL (safe to call from any thread). When
+	// withOffset is provided it is used to center the mesh, otherwise the mesh is centered on its average position
+	static bool Load(const char* filename, PlyModelData& into, const glm::vec3* withOffset = NULL);
+
+	// writes the given data to a binary PLY file with positions (with the centering offset taken back out), normals,
+	// UVs and colors, which Load reads back
+	static bool Save(const char* filename, const PlyModelData& data);
+
+	// returns a copy of the resident data, as Load would give it
+	void GetData(PlyModelData& into) const;
 
 	// returns the AABB size of the model
 	glm::vec3 GetScale() const {
@@ -34,6 +107,11 @@ public:
 		return vao;
 	}
 
+	// returns the position only vertex array object, or NULL if the position stream isn't enabled
+	VAO* GetPositionVAO() const {
+		return positionVao;
+	}
+
 	// returns the index buffer used for the model data
 	IndexBuffer* GetIndexBuffer() const {
 		return iBuffer;
@@ -44,6 +122,38 @@ public:
 		return vBuffer;
 	}
 
+	// returns the CPU side copy of the model vertices
+	const std::vector<PlyVertex>& GetVertices() const {
+		return vertices;
+	}
+
+	// returns the CPU side copy of the model triangle indices
+	const std::vector<uint32_t>& GetIndices() const {
+		return indices;
+	}
+
+	// returns the BVH over the model's triangles, building it if it doesn't exist yet (or the model was reloaded)
+	const BVH* GetBVH();
+
+	// finds the point on the model under the given normalized device coordinates (-1 to 1) of the given matrix, which
+	// must transform from model space to clip space. Returns false if the model isn't under that point
+	bool Pick(const glm::mat4& objViewProj, float x, float y, glm::vec3& intoPoint);
+
+	// starts watching the model's file so that it is reloaded in the background whenever it is re-exported
+	void EnableHotReload();
+
+	// checks for file changes and finished background reloads. Must be called from the thread owning the GL context,
+	// and returns true when the model's GPU data changed
+	bool PollReload();
+
+	// creates the position only vertex stream (kept up to date through reloads from then on), for programs that read
+	// nothing but in_Position such as Shaders/depth_only.vert
+	void EnablePositionStream();
+
 	// render the model in OpenGL using the current program and texture settings
 	void Render();
-};
\ No newline at end of file
+
+	// render the model from the position stream when it's enabled (otherwise the same as Render). The current program
+	// must only read in_Position
+	void RenderPositions();
+};
@@ -0,0 +1,66 @@
+#include "Profiler.h"
+
+#include <atomic>
+
+// thread local storage for plain data, which VS2013 doesn't support thread_local for
+#ifdef _MSC_VER
+#define PROFILE_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILE_THREAD_LOCAL __thread
+#endif
+
+// ring of recorded events. Each recording claims the next slot, so threads never wait on each other
+static ProfileEvent profileEvents[PROFILE_EVENT_CAPACITY];
+static std::atomic<uint32_t> profileEventCount(0);
+
+// index of the calling thread (0 until its first event)
+static PROFILE_THREAD_LOCAL uint32_t profileThread = 0;
+static std::atomic<uint32_t> profileThreadCount(0);
+
+void RecordProfileEvent(const char* name, double start, double end) {
+	if (!profileThread) {
+		profileThread = ++profileThreadCount;
+	}
+
+	ProfileEvent& event = profileEvents[profileEventCount++ % PROFILE_EVENT_CAPACITY];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	event.thread = profileThread;
+}
+
+bool SaveProfileTrace(const char* filename) {
+	FILE* f = NULL;
+	fopen_s(&f, filename, "w");
+	if (!f) {
+		Log("Unable to write profile trace to '%s'", filename);
+		return false;
+	}
+
+	// only the most recent events are still in the ring
+	uint32_t total = profileEventCount;
+	uint32_t count = mini(total, PROFILE_EVENT_CAPACITY);
+	uint32_t first = total - count;
+
+	// trace times are in microseconds, relative to the earliest event
+	double baseTime = 1.0E+30;
+	for (uint32_t i = first; i < total; i++) {
+		baseTime = glm::min(baseTime, profileEvents[i % PROFILE_EVENT_CAPACITY].start);
+	}
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	uint32_t numThreads = profileThreadCount;
+	for (uint32_t t = 1; t <= numThreads; t++) {
+		fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n", t, t);
+	}
+	for (uint32_t i = first; i < total; i++) {
+		const ProfileEvent& event = profileEvents[i % PROFILE_EVENT_CAPACITY];
+		fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n", event.name,
+			event.thread, (event.start - baseTime) * 1.0E+6, (event.end - event.start) * 1.0E+6, i + 1 < total ? "," : "");
+	}
+	fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(f);
+
+	Log("Saved %d profile events (%d dropped) to '%s'", count, total - count, filename);
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "SpecViz.h"
+
+// CPU profiling is compiled in unless SPECVIZ_PROFILE is defined as 0, in which case every PROFILE_ macro is empty
+#ifndef SPECVIZ_PROFILE
+#define SPECVIZ_PROFILE 1
+#endif
+
+// number of events kept. Once full, the oldest events are overwritten
+#define PROFILE_EVENT_CAPACITY 65536
+
+// a timed span of work on a thread
+struct ProfileEvent {
+	const char* name;		// must outlive the profiler (a string literal)
+	double start;			// seconds, from GetTimeSeconds
+	double end;
+	uint32_t thread;		// small index identifying the thread, in order of first use
+};
+
+// records a span of work on the calling thread. Safe to call from any thread
+void RecordProfileEvent(const char* name, double start, double end);
+
+// writes every recorded event to the given file in the Chrome trace event format (load it in chrome://tracing)
+bool SaveProfileTrace(const char* filename);
+
+#if SPECVIZ_PROFILE
+
+// times the span from its construction to its destruction (or End())
+class ProfileScope {
+protected:
+	const char* name;
+	double start;
+
+public:
+	ProfileScope(const char* withName) : name(withName), start(GetTimeSeconds()) {
+	}
+
+	~ProfileScope() {
+		End();
+	}
+
+	// records the span now instead of at destruction
+	void End() {
+		if (name) {
+			RecordProfileEvent(name, start, GetTimeSeconds());
+			name = NULL;
+		}
+	}
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// times the rest of the enclosing scope
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+// times a stage within a function, from PROFILE_BEGIN to the matching PROFILE_END (or the end of the scope)
+#define PROFILE_BEGIN(var, name) ProfileScope var(name)
+#define PROFILE_END(var) var.End()
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_BEGIN(var, name)
+#define PROFILE_END(var)
+
+#endif
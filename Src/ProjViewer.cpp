@@ -1,42 +1,36 @@
 
 #include "SpecViz.h"
+#include "OrbitViewer.h"
+#include "GPUProfiler.h"
+#include "Profiler.h"
 #include "PlyModel.h"
 
 #include <fstream>
 
-class ProjViewer : public Viewer {
+class ProjViewer : public OrbitViewer {
 public:
 	PixelShader* pShader;
 	VertexShader* vShader;
 	ShaderProgram* program;
 
-	glm::vec3 rotation;
-	glm::vec3 center;
-	glm::mat4 objMatrix;
-	glm::mat4 viewMatrix;
 	glm::mat4 texMatrix;
 	glm::vec3 lightDirection;
 	
-	glm::mat4 projMatrix;
 	Texture* projTexture;
 
 	float lightPitch;
 	float lightYaw;
-	float cameraDistance;
-	float baseCameraDistance;
 	float fieldOfView;
 
-	PlyModel* model;
-
 	ProjViewer(const char* withFilename);
 	void MainLoop(float deltaTime);
+	bool Poll();
 	void NotifyKeyPress(const char* name);
-	void NotifyMouseWheel(float amt, bool controlHeld);
-	void NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld);
 	virtual ~ProjViewer();
 };
 
 Viewer* CreateProjViewer(const char* filename) {
+	PROFILE_SCOPE("CreateProjViewer");
 	ProjViewer* newViewer = new ProjViewer(filename);
 	return newViewer;
 }
@@ -76,7 +70,14 @@ ProjViewer::ProjViewer(const char* filename) {
 	vShader = new VertexShader("Shaders/projected_vertex.vert");
 	program = new ShaderProgram(pShader, vShader);
 
+	// uniforms that never change are set once up front
+	program->Bind();
+	glUniformMatrix4fv(program->GetUniform(UNIFORM_TEX_MATRIX), 1, GL_FALSE, &texMatrix[0][0]);
+	glUniform1f(program->GetUniform(UNIFORM_ALPHA), 1.0f);
+	glUniform1i(program->GetUniform(UNIFORM_COLOR_MAP), 0);
+
 	model = new PlyModel(modelFile);
+	model->EnableHotReload();
 	projTexture = Texture::CreateFromFile(textureFile, GL_RGBA8);
 	
 	fieldOfView = 30.0f;
@@ -84,18 +85,25 @@ ProjViewer::ProjViewer(const char* filename) {
 	cameraDistance = baseCameraDistance;
 }
 
+bool ProjViewer::Poll() {
+	// pick up any re-exported version of the model file
+	return model->PollReload();
+}
+
 void ProjViewer::MainLoop(float deltaTime) {
 	GLCHECK();
 
 	// set up z write/read
-	glDepthMask(GL_TRUE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::DepthMask(true);
+	GLState::Enable(GL_DEPTH_TEST);
 	GLCHECK();
 
 	// clear frame buffer
+	GetGPUProfiler()->BeginPass("clear");
 	glClearColor(0,0,0,1);
 	glClearDepth(1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 
 	// bind program
@@ -122,61 +130,22 @@ void ProjViewer::MainLoop(float deltaTime) {
 	float pitchVar = 1.0f - sin(lightPitch);
 	lightDirection = glm::normalize(glm::vec3(cos(lightYaw) * pitchVar, sin(lightPitch), sin(lightYaw) * pitchVar));
 	
-	glDisable(GL_BLEND);
+	GLState::Disable(GL_BLEND);
 
 	GLCHECK();
-	glUniformMatrix4fv(program->GetUniform("objMatrix"), 1, GL_FALSE, &objMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("projMatrix"), 1, GL_FALSE, &projMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
-	glUniformMatrix4fv(program->GetUniform("texMatrix"), 1, GL_FALSE, &texMatrix[0][0]);
-	glUniform3fv(program->GetUniform("lightDirection"), 1, &lightDirection.x);
-	glUniform3fv(program->GetUniform("eyePosition"), 1, &eyePosition.x);
-	glUniform1f(program->GetUniform("alpha"), 1.0f);
-	glUniform1i(program->GetUniform("colorMap"), 0);
+	SetCameraBlock(CameraBlock(objMatrix, viewMatrix, projMatrix, eyePosition, lightDirection));
 	GLCHECK();
 
 	// draw our model
+	GetGPUProfiler()->BeginPass("model");
 	model->Render();
+	GetGPUProfiler()->EndPass();
 	GLCHECK();
 }
 
 void ProjViewer::NotifyKeyPress(const char* name) {
 }
 
-void ProjViewer::NotifyMouseWheel(float amt, bool controlHeld) {
-	cameraDistance += baseCameraDistance * -0.005f * amt * (controlHeld ? 0.1f : 1.0f);
-}
-
-void ProjViewer::NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld) {
-	const float p = glm::pi<float>();
-
-	if (button == 2) {
-		rotation.z += y * 0.01f;
-		if (rotation.z > p * 2.0f)
-			rotation.z -= p * 2.0f;
-		if (rotation.z < p * -2.0f)
-			rotation.z += p * 2.0f;
-	} else if (button == 1) {
-		center.x += viewMatrix[0].x * x / 1000.0f * cameraDistance;
-		center.y += viewMatrix[0].y * x / 1000.0f * cameraDistance;
-		center.z += viewMatrix[0].z * x / 1000.0f * cameraDistance;
-		center.x += viewMatrix[1].x * y / 1000.0f * cameraDistance;
-		center.y += viewMatrix[1].y * y / 1000.0f * cameraDistance;
-		center.z += viewMatrix[1].z * y / 1000.0f * cameraDistance;
-	} else if (button == 0) {
-		rotation.x += x * 0.01f;
-		rotation.y -= y * 0.01f;
-		if (rotation.x > p * 2.0f)
-			rotation.x -= p * 2.0f;
-		if (rotation.x < p * -2.0f)
-			rotation.x += p * 2.0f;
-		if (rotation.y > p * 2.0f)
-			rotation.y -= p * 2.0f;
-		if (rotation.y < p * -2.0f)
-			rotation.y += p * 2.0f;
-	}
-}
-
 ProjViewer::~ProjViewer() {
 	delete program;
 	GLCHECK();
@@ -0,0 +1,64 @@
+#include "ProjectedAttributes.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "VertexSIMD.h"
+
+uint32_t GetProjectedAttributeStride(uint32_t numProjections) {
+	return (numProjections + 3) / 4 * 4 + (numProjections + 1) / 2 * 4 * sizeof(uint16_t);
+}
+
+void BuildProjectedAttributes(const std::vector<PlyVertex>& vertices, const glm::mat4* texMatrices,
+	const glm::vec4* uvScales, uint32_t numProjections, std::vector<uint8_t>& into) {
+	PROFILE_SCOPE("BuildProjectedAttributes");
+
+	uint32_t numVertices = vertices.size();
+	uint32_t stride = GetProjectedAttributeStride(numProjections);
+	uint32_t uvOffset = (numProjections + 3) / 4 * 4;
+	into.assign(numVertices * stride, 0);
+
+	uint32_t numPackets = (numVertices + 3) / 4;
+	ParallelFor(numPackets, 4096, [&](uint32_t begin, uint32_t end) {
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 uvMin = _mm_set1_ps(PROJECTED_UV_MIN);
+		const __m128 uvRange = _mm_set1_ps(1.0f / (PROJECTED_UV_MAX - PROJECTED_UV_MIN));
+
+		for (uint32_t packet = begin; packet < end; packet++) {
+			VertexPacket4 v;
+			LoadVertices4(vertices, packet, v);
+
+			for (uint32_t i = 0; i < numProjections; i++) {
+				ProjectedVertices4 proj;
+				ProjectVertices4(v, texMatrices[i], proj);
+
+				// UV as the vertex shader had it, (xy / w * 0.5 + 0.5) * uvScale, then stored across the UV range. A
+				// zero w gives infinities (or NaNs) which the clamp turns into the ends of the range
+				__m128 invW = _mm_div_ps(one, proj.w);
+				__m128 u = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(proj.x, invW), half), half),
+					_mm_set1_ps(uvScales[i].x));
+				__m128 uvV = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(proj.y, invW), half), half),
+					_mm_set1_ps(uvScales[i].y));
+				u = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(u, uvMin), uvRange), zero), one);
+				uvV = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(uvV, uvMin), uvRange), zero), one);
+				__m128i encodedU = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(65535.0f)), half));
+				__m128i encodedV = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(uvV, _mm_set1_ps(65535.0f)), half));
+
+				__m128 facing = _mm_min_ps(_mm_max_ps(proj.facing, zero), one);
+				__m128i encodedFacing = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(facing, _mm_set1_ps(255.0f)), half));
+
+				uint32_t laneU[4], laneV[4], laneFacing[4];
+				_mm_storeu_si128((__m128i*) laneU, encodedU);
+				_mm_storeu_si128((__m128i*) laneV, encodedV);
+				_mm_storeu_si128((__m128i*) laneFacing, encodedFacing);
+				for (uint32_t lane = 0; lane < v.lanes; lane++) {
+					uint8_t* vertex = &into[v.index[lane] * stride];
+					vertex[i] = (uint8_t) laneFacing[lane];
+					uint16_t* uv = (uint16_t*) (vertex + uvOffset) + i * 2;
+					uv[0] = (uint16_t) laneU[lane];
+					uv[1] = (uint16_t) laneV[lane];
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "PlyModel.h"
+
+// range projected UVs are stored over. UVs of vertices outside a projection's frustum are clamped to it, which only
+// bends the UVs of triangles reaching well past the image, where the edge distance weights them out anyway
+#define PROJECTED_UV_MIN -1.0f
+#define PROJECTED_UV_MAX 2.0f
+
+// returns the size in bytes of a vertex's projected attributes for the given number of projections
+uint32_t GetProjectedAttributeStride(uint32_t numProjections);
+
+// computes what multi_projected_vertex.vert otherwise works out from texMatrix every frame, for every vertex and
+// projection: the projected UV (scaled by the projection's uvScale) and the facing amount of the vertex normal
+// towards the projection. Each vertex gets GetProjectedAttributeStride bytes, the facing amounts first as unsigned
+// normalized bytes (four projections per attribute) and then the UVs as unsigned normalized shorts over
+// PROJECTED_UV_MIN to PROJECTED_UV_MAX (two projections per attribute). Vertices are transformed four at a time with
+// SSE, in parallel across cores
+void BuildProjectedAttributes(const std::vector<PlyVertex>& vertices, const glm::mat4* texMatrices,
+	const glm::vec4* uvScales, uint32_t numProjections, std::vector<uint8_t>& into);
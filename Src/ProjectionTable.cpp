@@ -0,0 +1,127 @@
+#include "ProjectionTable.h"
+#include "ProjectionVisibility.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+// edge distance image of a projection, in the red channel
+struct EdgeImage {
+	uint8_t* pixels;		// NULL when the projection has no edge distance image
+	uint32_t width;
+	uint32_t height;
+};
+
+// weight multi_textured_light.pix would give the projection at the given mesh position and normal. Facing alone adds
+// a tiny amount, so triangles without any edge weight still keep their best facing projections for the shader to
+// fall back on
+static float ScoreProjection(const glm::mat4& texMatrix, const EdgeImage& edge, const glm::vec3& position,
+	const glm::vec3& normal) {
+	glm::vec4 clip = texMatrix * glm::vec4(position, 1.0f);
+	if (clip.w <= 0.0f) {
+		return 0.0f;
+	}
+	glm::vec2 uv = glm::vec2(clip) / clip.w * 0.5f + 0.5f;
+	if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f) {
+		return 0.0f;
+	}
+
+	glm::vec3 texNormal = glm::vec3(texMatrix * glm::vec4(normal, 0.0f));
+	float texNormalLength = glm::length(texNormal);
+	if (texNormalLength == 0.0f) {
+		return 0.0f;
+	}
+	float facing = fabsf(texNormal.z) / texNormalLength;
+
+	float edgeAmount = 1.0f;
+	if (edge.pixels) {
+		uint32_t x = mini((int32_t) (uv.x * edge.width), edge.width - 1);
+		uint32_t y = mini((int32_t) (uv.y * edge.height), edge.height - 1);
+		edgeAmount = edge.pixels[y * edge.width + x] / 255.0f;
+	}
+
+	return glm::max(edgeAmount - 0.1f, 0.0f) * facing + facing * 0.0001f;
+}
+
+void BuildProjectionTable(const std::vector<PlyVertex>& vertices, const std::vector<uint32_t>& indices,
+	const glm::mat4* texMatrices, const std::vector<std::string>& edgePaths, const ProjectionVisibility* visibility,
+	std::vector<TriangleProjections>& into) {
+	PROFILE_SCOPE("BuildProjectionTable");
+
+	uint32_t numTriangles = indices.size() / 3;
+	uint32_t numProjections = edgePaths.size();
+
+	// running best scores per triangle, best first
+	std::vector<float> bestScore(numTriangles * PROJECTION_TABLE_K, 0.0f);
+	std::vector<uint16_t> bestId(numTriangles * PROJECTION_TABLE_K, 0);
+
+	// a group of images (one per worker) is in memory at a time
+	uint32_t groupSize = GetWorkerCount();
+	std::vector<EdgeImage> group(groupSize);
+
+	for (uint32_t first = 0; first < numProjections; first += groupSize) {
+		uint32_t count = mini(numProjections - first, groupSize);
+
+		PROFILE_BEGIN(loadProfile, "load edge images");
+		ParallelFor(count, 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				EdgeImage& image = group[i];
+				image.pixels = Texture::LoadFileChannel(edgePaths[first + i].c_str(), image.width, image.height);
+			}
+		});
+		PROFILE_END(loadProfile);
+
+		PROFILE_BEGIN(scoreProfile, "score triangles");
+		ParallelFor(numTriangles, 4096, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t t = begin; t < end; t++) {
+				const PlyVertex& v0 = vertices[indices[t * 3]];
+				const PlyVertex& v1 = vertices[indices[t * 3 + 1]];
+				const PlyVertex& v2 = vertices[indices[t * 3 + 2]];
+				glm::vec3 center = (v0.position + v1.position + v2.position) / 3.0f;
+				glm::vec3 normal = v0.normal + v1.normal + v2.normal;
+
+				float* score = &bestScore[t * PROJECTION_TABLE_K];
+				uint16_t* id = &bestId[t * PROJECTION_TABLE_K];
+				for (uint32_t i = 0; i < count; i++) {
+					if (visibility && !IsProjectionVisible(*visibility, t, first + i)) {
+						continue;
+					}
+					float curScore = ScoreProjection(texMatrices[first + i], group[i], center, normal);
+					if (curScore <= score[PROJECTION_TABLE_K - 1]) {
+						continue;
+					}
+
+					// insertion into the sorted slots, dropping the worst
+					int32_t slot = PROJECTION_TABLE_K - 1;
+					while (slot > 0 && score[slot - 1] < curScore) {
+						score[slot] = score[slot - 1];
+						id[slot] = id[slot - 1];
+						slot--;
+					}
+					score[slot] = curScore;
+					id[slot] = (uint16_t) (first + i);
+				}
+			}
+		});
+		PROFILE_END(scoreProfile);
+
+		for (uint32_t i = 0; i < count; i++) {
+			free(group[i].pixels);
+		}
+	}
+
+	into.resize(numTriangles);
+	uint32_t uncovered = 0;
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		for (uint32_t k = 0; k < PROJECTION_TABLE_K; k++) {
+			into[t].id[k] = bestId[t * PROJECTION_TABLE_K + k];
+			// the shader stops at the first zero weight, so a projection picked on facing alone (whose score rounds
+			// to zero) keeps the smallest weight instead of being dropped
+			float score = bestScore[t * PROJECTION_TABLE_K + k];
+			uint16_t weight = (uint16_t) (glm::clamp(score, 0.0f, 1.0f) * 65535.0f + 0.5f);
+			into[t].weight[k] = score > 0.0f ? (uint16_t) maxi(weight, 1) : 0;
+		}
+		uncovered += into[t].weight[0] == 0;
+	}
+
+	Log("Built projection table of %d triangles against %d projections (%d triangles uncovered)", numTriangles,
+		numProjections, uncovered);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "PlyModel.h"
+#include "ProjectionVisibility.h"
+
+#include <string>
+
+// number of projections kept per triangle. Must match PROJECTION_TABLE_K in multi_textured_light.pix
+#define PROJECTION_TABLE_K 4
+
+// the projections that cover a triangle best, best first. Laid out as two RGBA16UI texels so the table can be read
+// by gl_PrimitiveID from a buffer texture. Unused slots have zero weight, and used ones at least 1
+struct TriangleProjections {
+	uint16_t id[PROJECTION_TABLE_K];
+	uint16_t weight[PROJECTION_TABLE_K];	// score scaled from 0-1 to 0-65535
+};
+
+// scores every triangle of the mesh against every projection the way multi_textured_light.pix weights them (the
+// facing amount of the normal towards the projection times the edge distance less 0.1, at the triangle center, zero
+// outside the projection frustum, plus a tiny amount for facing alone) and keeps the best PROJECTION_TABLE_K per
+// triangle. edgePaths holds the edge distance image of each projection; projections without one are weighted on facing
+// alone. When visibility (from BuildProjectionVisibility) is given, projections that can't see a triangle are never
+// picked for it. Images are loaded a group at a time and triangles are scored in parallel
+void BuildProjectionTable(const std::vector<PlyVertex>& vertices, const std::vector<uint32_t>& indices,
+	const glm::mat4* texMatrices, const std::vector<std::string>& edgePaths, const ProjectionVisibility* visibility,
+	std::vector<TriangleProjections>& into);
@@ -0,0 +1,82 @@
+#include "ProjectionVisibility.h"
+#include "Parallel.h"
+#include "Profiler.h"
+
+#include <atomic>
+
+void BuildProjectionVisibility(const BVH* bvh, const std::vector<PlyVertex>& vertices,
+	const std::vector<uint32_t>& indices, const glm::mat4* texMatrices, uint32_t numProjections,
+	ProjectionVisibility& into) {
+	PROFILE_SCOPE("BuildProjectionVisibility");
+	assert(numProjections <= MAX_PROJECTIONS);
+
+	uint32_t numTriangles = indices.size() / 3;
+	into.words = GetVisibilityWords(numProjections);
+	into.masks.assign(numTriangles * into.words, 0);
+
+	// rays start a little off the surface so they don't hit the triangle they leave from (or its neighbours)
+	glm::vec3 boundMin(1.0E+30F), boundMax(-1.0E+30F);
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		boundMin = glm::min(boundMin, vertices[i].position);
+		boundMax = glm::max(boundMax, vertices[i].position);
+	}
+	float bias = glm::length(boundMax - boundMin) * 1.0E-4F;
+
+	// each projection's viewpoint is where its clip space x, y and w are all zero. For a parallel projection that
+	// point is at infinity and w is zero, leaving the direction towards it
+	std::vector<glm::vec4> viewpoints(numProjections);
+	for (uint32_t p = 0; p < numProjections; p++) {
+		glm::vec4 viewpoint = glm::inverse(texMatrices[p]) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		if (fabsf(viewpoint.w) > 1.0E-12F) {
+			viewpoints[p] = glm::vec4(glm::vec3(viewpoint) / viewpoint.w, 1.0f);
+		} else {
+			// the viewpoint is along whichever way the projection looks back
+			glm::vec4 inFront = glm::inverse(texMatrices[p]) * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
+			glm::vec4 behind = glm::inverse(texMatrices[p]) * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+			viewpoints[p] = glm::vec4(glm::normalize(glm::vec3(inFront) / inFront.w - glm::vec3(behind) / behind.w), 0.0f);
+		}
+	}
+
+	std::atomic<uint32_t> visiblePairs(0);
+	ParallelFor(numTriangles, 1024, [&](uint32_t begin, uint32_t end) {
+		uint32_t localVisible = 0;
+		for (uint32_t t = begin; t < end; t++) {
+			const glm::vec3& p0 = vertices[indices[t * 3]].position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float normalLength = glm::length(normal);
+			normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+
+			uint32_t* mask = &into.masks[t * into.words];
+			for (uint32_t p = 0; p < numProjections; p++) {
+				glm::vec4 clip = texMatrices[p] * glm::vec4(center, 1.0f);
+				if (clip.w <= 0.0f || fabsf(clip.x) > clip.w || fabsf(clip.y) > clip.w) {
+					continue;
+				}
+
+				Ray ray;
+				if (viewpoints[p].w != 0.0f) {
+					glm::vec3 toViewpoint = glm::vec3(viewpoints[p]) - center;
+					ray.tMax = glm::length(toViewpoint);
+					ray.direction = toViewpoint / ray.tMax;
+				} else {
+					ray.direction = glm::vec3(viewpoints[p]);
+				}
+
+				// leave from whichever side of the triangle faces the projection
+				ray.origin = center + normal * (glm::dot(normal, ray.direction) < 0.0f ? -bias : bias);
+				ray.tMin = bias;
+				if (!bvh->Occluded(ray)) {
+					mask[p / 32] |= 1u << (p % 32);
+					localVisible++;
+				}
+			}
+		}
+		visiblePairs += localVisible;
+	});
+
+	Log("Found %d visible triangle projection pairs of %d (%d triangles, %d projections)", (uint32_t) visiblePairs,
+		numTriangles * numProjections, numTriangles, numProjections);
+}
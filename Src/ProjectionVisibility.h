@@ -0,0 +1,31 @@
+#pragma once
+
+#include "BVH.h"
+
+// which projections see each triangle of a mesh, as a mask of words 32 bit words per triangle with bit p set when
+// projection p sees it. The shader is given words as its visibilityWords uniform to find each triangle's mask
+struct ProjectionVisibility {
+	std::vector<uint32_t> masks;
+	uint32_t words;
+
+	ProjectionVisibility() : words(0) {}
+};
+
+// finds which projections actually see each triangle of the mesh, rather than just face it: a projection sees a
+// triangle when the triangle's center is inside its frustum and a ray from the center to the projection's viewpoint
+// isn't blocked by the rest of the mesh. Fills into with just enough words per triangle for numProjections bits. Rays
+// are cast against the given BVH of the mesh, across all cores
+void BuildProjectionVisibility(const BVH* bvh, const std::vector<PlyVertex>& vertices,
+	const std::vector<uint32_t>& indices, const glm::mat4* texMatrices, uint32_t numProjections,
+	ProjectionVisibility& into);
+
+// returns the number of 32 bit words of visibility mask each triangle takes for the given number of projections
+inline uint32_t GetVisibilityWords(uint32_t numProjections) {
+	return (numProjections + 31) / 32;
+}
+
+// returns true if the visibility built by BuildProjectionVisibility says the given triangle is seen by the given
+// projection
+inline bool IsProjectionVisible(const ProjectionVisibility& visibility, uint32_t triangle, uint32_t projection) {
+	return (visibility.masks[triangle * visibility.words + projection / 32] & (1u << (projection % 32))) != 0;
+}
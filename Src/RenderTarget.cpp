@@ -0,0 +1,100 @@
+#include "SpecViz.h"
+
+RenderTarget::RenderTarget(uint32_t withWidth, uint32_t withHeight, const GLenum* colorFormats, uint32_t withNumColors) :
+	numColors(withNumColors), width(withWidth), height(withHeight), savedFrameBuffer(0) {
+	assert(numColors <= MAX_RENDER_TARGET_COLORS);
+
+	// with direct state access the attachments are set up without disturbing any bindings
+	if (IsDirectStateAccessSupported()) {
+		glCreateFramebuffers(1, &frameBuffer);
+		glCreateTextures(GL_TEXTURE_2D, numColors, colorTextures);
+		for (uint32_t i = 0; i < numColors; i++) {
+			glTextureStorage2D(colorTextures[i], 1, colorFormats[i], width, height);
+			glTextureParameteri(colorTextures[i], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTextureParameteri(colorTextures[i], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTextureParameteri(colorTextures[i], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(colorTextures[i], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(colorTextures[i], GL_TEXTURE_MAX_LEVEL, 0);
+			glNamedFramebufferTexture(frameBuffer, GL_COLOR_ATTACHMENT0 + i, colorTextures[i], 0);
+			GLCHECK();
+		}
+
+		glCreateRenderbuffers(1, &depthBuffer);
+		glNamedRenderbufferStorage(depthBuffer, GL_DEPTH_COMPONENT24, width, height);
+		glNamedFramebufferRenderbuffer(frameBuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		GLCHECK();
+
+		GLenum val = glCheckNamedFramebufferStatus(frameBuffer, GL_FRAMEBUFFER);
+		assert(val == GL_FRAMEBUFFER_COMPLETE);
+		return;
+	}
+
+	GLint previousFrameBuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFrameBuffer);
+	glGenFramebuffers(1, &frameBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+	GLCHECK();
+
+	// color attachments are sampled texel for texel, so no filtering or mips
+	glGenTextures(numColors, colorTextures);
+	for (uint32_t i = 0; i < numColors; i++) {
+		GLState::BindTexture(0, GL_TEXTURE_2D, colorTextures[i]);
+		// no data is sent, but integer formats still need an integer pixel format to go with them
+		bool isFloat = colorFormats[i] == GL_RGBA16F || colorFormats[i] == GL_RGBA32F;
+		bool isInteger = colorFormats[i] == GL_R32UI;
+		glTexImage2D(GL_TEXTURE_2D, 0, colorFormats[i], width, height, 0, isInteger ? GL_RED_INTEGER : GL_RGBA,
+			isInteger ? GL_UNSIGNED_INT : isFloat ? GL_FLOAT : GL_UNSIGNED_BYTE, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorTextures[i], 0);
+		GLCHECK();
+	}
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	GLCHECK();
+
+	GLenum val = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	assert(val == GL_FRAMEBUFFER_COMPLETE);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFrameBuffer);
+}
+
+RenderTarget::~RenderTarget() {
+	glDeleteFramebuffers(1, &frameBuffer);
+	glDeleteRenderbuffers(1, &depthBuffer);
+	for (uint32_t i = 0; i < numColors; i++) {
+		GLState::ForgetTexture(colorTextures[i]);
+	}
+	glDeleteTextures(numColors, colorTextures);
+}
+
+void RenderTarget::Bind() {
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFrameBuffer);
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+	GLenum drawBuffers[MAX_RENDER_TARGET_COLORS];
+	for (uint32_t i = 0; i < numColors; i++) {
+		drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	glDrawBuffers(numColors, drawBuffers);
+	glViewport(0, 0, width, height);
+	GLCHECK();
+}
+
+void RenderTarget::Unbind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFrameBuffer);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void RenderTarget::BindColor(uint32_t index, uint32_t samplerId) {
+	assert(index < numColors);
+	GLState::BindTexture(samplerId, GL_TEXTURE_2D, colorTextures[index]);
+}
\ No newline at end of file
@@ -1,13 +1,33 @@
 #include "SpecViz.h"
+#include "Profiler.h"
+#include "FileCache.h"
 
-Shader::Shader(const char* filePath, const char* predefine) : shaderId(0) {
+#include <vector>
+#include <algorithm>
+
+// directory the program binary cache lives in, relative to the working directory like the shaders themselves
+#define PROGRAM_CACHE_DIR "ShaderCache"
+
+// identifies program binary cache files, and their layout version (changing it invalidates every cached program)
+#define PROGRAM_CACHE_MAGIC 0x42505653
+#define PROGRAM_CACHE_VERSION 2
+
+// info stored with each cached program binary
+struct ProgramCacheInfo {
+	uint32_t format;
+};
+
+Shader::Shader(const char* filePath, const char* predefine, GLenum withType) : shaderId(0), type(withType) {
 	Log("Opening shader at '%s'", filePath);
 
+	PROFILE_SCOPE("read shader");
+
 	// this constructor simply sets up the shader code memory using the given predefines. Compile() then sends it to OpenGL
 	if (predefine == NULL) {
 		predefine = "";
 	}
-	uint32_t predefLength = strlen(predefine);
+	uint32_t defineLength = strlen(predefine);
+	uint32_t predefLength = defineLength + strlen(CAMERA_BLOCK_GLSL);
 
 	// open the file
 	FILE* f = NULL;
@@ -18,22 +38,46 @@ Shader::Shader(const char* filePath, const char* predefine) : shaderId(0) {
 	fseek(f, 0, SEEK_END);
 	uint32_t fileSize = ftell(f);
 
-	// allocate the code, and copy predefine into it first
-	code = (const char*) malloc(fileSize+predefLength+1);
-	memset((void*) code, 0, fileSize+predefLength+1);
-	strcpy((char*) code, predefine);
-
-	// append code with contents of file via fseek
+	// allocate the code, and read the file into it leaving room for the predefine
+	char* text = (char*) malloc(fileSize+predefLength+1);
+	memset(text, 0, fileSize+predefLength+1);
 	fseek(f, 0, SEEK_SET);
-	fread((void*) (code+predefLength), 1, fileSize, f);
+	fread(text+predefLength, 1, fileSize, f);
 	fclose(f);
+
+	// the predefine and the camera block go first, but after the #version line, which strict compilers (Mesa) require
+	// to come before anything else
+	uint32_t versionLength = 0;
+	if (!strncmp(text+predefLength, "#version", 8)) {
+		const char* lineEnd = strchr(text+predefLength, '\n');
+		versionLength = lineEnd ? (uint32_t) (lineEnd - (text+predefLength)) + 1 : fileSize;
+	}
+	memmove(text, text+predefLength, versionLength);
+	memcpy(text+versionLength, predefine, defineLength);
+	memcpy(text+versionLength+defineLength, CAMERA_BLOCK_GLSL, predefLength-defineLength);
+	code = text;
 }
 
-void Shader::Compile() {
+Shader::~Shader() {
+	if (shaderId) {
+		glDeleteShader(shaderId);
+	}
+	free((void*) code);
+}
+
+void Shader::Compile(bool wait) {
 	// compile this shader given its preallocated code
-	glShaderSource(shaderId, 1, &code, NULL); 
-	glCompileShader(shaderId);
-	GLCHECK();
+	if (!shaderId) {
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &code, NULL); 
+		glCompileShader(shaderId);
+		GLCHECK();
+	}
+
+	// querying the result blocks until the driver is done compiling
+	if (!wait) {
+		return;
+	}
 
 	GLint ret;
 	glGetShaderiv(shaderId, GL_COMPILE_STATUS, &ret);
@@ -49,38 +93,136 @@ void Shader::Compile() {
 	assert(ret == GL_TRUE);
 }
 
-PixelShader::PixelShader(const char* path) : Shader(path, NULL) {
-	// create a fragment shader and then compile (already set up through constructor)
-	shaderId = glCreateShader(GL_FRAGMENT_SHADER);
+PixelShader::PixelShader(const char* path) : Shader(path, NULL, GL_FRAGMENT_SHADER) {
+}
 
-	Compile();
+PixelShader::PixelShader(const char* path, const char* predefine) : Shader(path, predefine, GL_FRAGMENT_SHADER) {
 }
 
+VertexShader::VertexShader(const char* path) : Shader(path, NULL, GL_VERTEX_SHADER) {
+}
 
-PixelShader::PixelShader(const char* path, const char* predefine) : Shader(path, predefine) {
-	// create a fragment shader and then compile (already set up through constructor)
-	shaderId = glCreateShader(GL_FRAGMENT_SHADER);
+VertexShader::VertexShader(const char* path, const char* predefine) : Shader(path, predefine, GL_VERTEX_SHADER) {
+}
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+bool ShaderProgram::IsParallelCompileSupported() {
+	// newer than our GLEW, so look for the extension by name
+	static int32_t supported = -1;
+	if (supported < 0) {
+		supported = glewGetExtension("GL_KHR_parallel_shader_compile") || glewGetExtension("GL_ARB_parallel_shader_compile");
+	}
+	return supported != 0;
+}
+
+// returns true if the driver can hand back linked program binaries and take them again later
+static bool ProgramBinariesSupported() {
+	if (!GLEW_ARB_get_program_binary) {
+		return false;
+	}
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	return numFormats > 0;
+}
 
-	Compile();
+// returns true if the driver still takes program binaries in the given format (a driver update can drop formats)
+static bool ProgramBinaryFormatSupported(GLenum format) {
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	if (numFormats <= 0) {
+		return false;
+	}
+	std::vector<GLint> formats(numFormats);
+	glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, &formats[0]);
+	return std::find(formats.begin(), formats.end(), (GLint) format) != formats.end();
 }
 
-VertexShader::VertexShader(const char* path) : Shader(path, NULL) {
-	// create a vertex shader and then compile (already set up through constructor)
-	shaderId = glCreateShader(GL_VERTEX_SHADER);
+bool ShaderProgram::LoadBinary() {
+	PROFILE_SCOPE("load program binary");
+
+	ProgramCacheInfo info;
+	uint32_t length = 0;
+	void* binary = LoadCacheFile(cachePath, PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, &info, sizeof(info),
+		length);
+	if (!binary) {
+		return false;
+	}
+
+	// a binary in a format the driver no longer lists would only be rejected with GL_INVALID_ENUM, which the debug
+	// output reports as an error, so it's recompiled without asking
+	bool valid = true;
+	if (!ProgramBinaryFormatSupported(info.format)) {
+		Log("Program binary '%s' is in a format the driver no longer supports, recompiling", cachePath);
+		valid = false;
+	}
+
+	if (valid) {
+		// the driver rejects binaries it can no longer use (after a driver update, etc), leaving the program unlinked
+		glProgramBinary(programId, info.format, binary, length);
+		while (glGetError() != GL_NO_ERROR);
+
+		GLint ret = GL_FALSE;
+		glGetProgramiv(programId, GL_LINK_STATUS, &ret);
+		valid = ret == GL_TRUE;
+		if (!valid) {
+			Log("Program binary '%s' was rejected by the driver, recompiling", cachePath);
+		}
+	}
+	free(binary);
 
-	Compile();
+	return valid;
 }
 
-VertexShader::VertexShader(const char* path, const char* predefine) : Shader(path, predefine) {
-	// create a vertex shader and then compile (already set up through constructor)
-	shaderId = glCreateShader(GL_VERTEX_SHADER);
+void ShaderProgram::SaveBinary() {
+	GLint length = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	ProgramCacheInfo info;
+	GLsizei written = 0;
+	void* binary = malloc(length);
+	glGetProgramBinary(programId, length, &written, &info.format, binary);
+	GLCHECK();
 
-	Compile();
+	if (written > 0) {
+		SaveCacheFile(PROGRAM_CACHE_DIR, cachePath, PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, &info,
+			sizeof(info), binary, written);
+	}
+	free(binary);
 }
 
-ShaderProgram::ShaderProgram(PixelShader* pShader, VertexShader* vShader) {
-	// create the program object and attach our two provided shaders
+ShaderProgram::ShaderProgram(PixelShader* withPShader, VertexShader* withVShader, bool deferred) :
+	pShader(withPShader), vShader(withVShader), linking(false) {
+	PROFILE_SCOPE("ShaderProgram");
+	startTime = GetTimeSeconds();
 	programId = glCreateProgram();
+
+	// programs are cached by their complete source and the driver that built them, since binaries are only valid
+	// for the exact driver that produced them
+	useCache = ProgramBinariesSupported();
+	key = HashString(pShader->GetCode());
+	key = HashString("\n--\n", key);
+	key = HashString(vShader->GetCode(), key);
+	key = HashString((const char*) glGetString(GL_VENDOR), key);
+	key = HashString((const char*) glGetString(GL_RENDERER), key);
+	key = HashString((const char*) glGetString(GL_VERSION), key);
+	GetCacheFilePath(cachePath, sizeof(cachePath), PROGRAM_CACHE_DIR, key, "bin");
+
+	if (useCache && LoadBinary()) {
+		Log("Loaded program '%s' in %.2f ms", cachePath, (GetTimeSeconds() - startTime) * 1000.0);
+		SetupUniforms();
+		return;
+	}
+
+	// issue the compiles and link without waiting on any of them, so a driver with parallel shader compile can work
+	// on them in the background
+	pShader->Compile(false);
+	vShader->Compile(false);
 	glAttachShader(programId, pShader->GetId());
 	glAttachShader(programId, vShader->GetId());
 	GLCHECK();
@@ -90,20 +232,105 @@ ShaderProgram::ShaderProgram(PixelShader* pShader, VertexShader* vShader) {
 	glBindAttribLocation(programId, 1, "in_UV");
 	glBindAttribLocation(programId, 2, "in_Color");
 	glBindAttribLocation(programId, 3, "in_Normal");
+	glBindAttribLocation(programId, PROJECTED_FACING_ATTRIB, "in_ProjectedFacing");
+	glBindAttribLocation(programId, PROJECTED_UV_ATTRIB, "in_ProjectedUV");
+	GLCHECK();
+
+	// and the outputs, for shaders that draw into more than one color attachment
+	glBindFragDataLocation(programId, 0, "out_Color");
+	glBindFragDataLocation(programId, 1, "out_Normal");
+	glBindFragDataLocation(programId, 2, "out_TriangleId");
 	GLCHECK();
 
 	// link the program together now
+	if (useCache) {
+		glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(programId);
 	GLCHECK();
+	linking = true;
+
+	if (!deferred) {
+		Finish();
+	}
+}
+
+ShaderProgram::~ShaderProgram() {
+	GLState::ForgetProgram(programId);
+	glDeleteProgram(programId);
+}
+
+bool ShaderProgram::IsReady() {
+	if (!linking || !IsParallelCompileSupported()) {
+		return true;
+	}
+
+	GLint ret = GL_FALSE;
+	glGetProgramiv(programId, GL_COMPLETION_STATUS_KHR, &ret);
+	return ret == GL_TRUE;
+}
+
+void ShaderProgram::Finish() {
+	if (!linking) {
+		return;
+	}
+	linking = false;
+	PROFILE_SCOPE("finish shader compile");
+
+	// report any compile errors first, since they are the reason a link would fail
+	pShader->Compile(true);
+	vShader->Compile(true);
 
 	// ensure the link succeeded (otherwise we are trying to build a program out of incompatible shaders)
 	GLint ret;
 	glGetProgramiv(programId, GL_LINK_STATUS, &ret);
 	assert(ret == GL_TRUE);
+
+	if (useCache) {
+		SaveBinary();
+	}
+	Log("Compiled program '%s' in %.2f ms", cachePath, (GetTimeSeconds() - startTime) * 1000.0);
+
+	SetupUniforms();
+}
+
+void ShaderProgram::SetupUniforms() {
+	// attach the shared camera block and the projections block (if the program uses them) to the binding points their
+	// buffers live at
+	GLuint cameraBlock = glGetUniformBlockIndex(programId, "Camera");
+	if (cameraBlock != GL_INVALID_INDEX) {
+		glUniformBlockBinding(programId, cameraBlock, CAMERA_BLOCK_BINDING);
+	}
+	GLuint projectionBlock = glGetUniformBlockIndex(programId, "Projections");
+	if (projectionBlock != GL_INVALID_INDEX) {
+		glUniformBlockBinding(programId, projectionBlock, PROJECTION_BLOCK_BINDING);
+	}
+
+	// resolve the uniform table so drawing never has to look uniforms up by name
+	static const char* uniformNames[NUM_UNIFORMS] = {
+		"alpha",
+		"texMatrix",
+		"colorMap",
+		"normalMap",
+		"scale",
+		"numProjections",
+		"firstProjection",
+		"projectionTable",
+		"projectionVisibility",
+		"useVisibility",
+		"visibilityWords",
+		"gbufferPosition",
+		"gbufferNormal",
+		"gbufferTriangle",
+	};
+	for (uint32_t i = 0; i < NUM_UNIFORMS; i++) {
+		uniforms[i] = glGetUniformLocation(programId, uniformNames[i]);
+	}
+	GLCHECK();
 }
 
 void ShaderProgram::Bind() {
-	glUseProgram(programId);
+	GLState::UseProgram(programId);
 }
 
 GLint ShaderProgram::GetUniform(const char* name) {
@@ -0,0 +1,263 @@
+#include "ShaderPermutations.h"
+#include "Parallel.h"
+
+#include <thread>
+#include <chrono>
+
+// most worker threads used to build the permutations of every set. Drivers serialize much of their compile work
+// internally, so more threads mostly just add contexts
+#define MAX_PERMUTATION_WORKERS 4
+
+// number of multi projection shader variants built at startup
+#define MULTI_PROJ_PERMUTATIONS 16
+
+ShaderPermutations::ShaderPermutations(const char* withPixelPath, const char* withVertexPath, const char* withMacro,
+	uint32_t withCount, const char* withPredefine) : pixelPath(withPixelPath), vertexPath(withVertexPath), macro(withMacro),
+	predefine(withPredefine), count(withCount), driverCompile(false) {
+	permutations = new Permutation[count];
+	for (uint32_t i = 0; i < count; i++) {
+		permutations[i].pShader = NULL;
+		permutations[i].vShader = NULL;
+		permutations[i].program = NULL;
+		permutations[i].claimed = false;
+		permutations[i].ready = false;
+	}
+
+	// when the driver compiles in the background, issuing every compile and link up front is all that's needed.
+	// Otherwise the permutations wait for the worker pool PrecompileShaders starts
+	if (ShaderProgram::IsParallelCompileSupported()) {
+		driverCompile = true;
+		for (uint32_t i = 0; i < count; i++) {
+			permutations[i].claimed = true;
+			Build(i, true);
+		}
+		Log("Building %d permutations of '%s' with driver parallel compile", count, pixelPath);
+	}
+}
+
+void ShaderPermutations::Build(uint32_t index, bool deferred) {
+	Permutation& permutation = permutations[index];
+
+	char define[256];
+	sprintf_s(define, "%s#define %s %d\n", predefine, macro, index + 1);
+	permutation.pShader = new PixelShader(pixelPath, define);
+	permutation.vShader = new VertexShader(vertexPath, define);
+	permutation.program = new ShaderProgram(permutation.pShader, permutation.vShader, deferred);
+}
+
+void ShaderPermutations::BuildOnWorker(uint32_t index) {
+	Permutation& permutation = permutations[index];
+	if (permutation.claimed.exchange(true)) {
+		return;
+	}
+	Build(index, false);
+
+	// the main thread may only use the program once this context is done with it
+	glFinish();
+	permutation.ready = true;
+}
+
+bool ShaderPermutations::IsReady(uint32_t value) {
+	assert(value >= 1 && value <= count);
+	Permutation& permutation = permutations[value - 1];
+	if (permutation.ready) {
+		return true;
+	}
+
+	// programs built by the driver in the background are deferred and only need to be finished once their link is
+	// complete
+	return permutation.program && driverCompile && permutation.program->IsReady();
+}
+
+ShaderProgram* ShaderPermutations::Get(uint32_t value) {
+	assert(value >= 1 && value <= count);
+	Permutation& permutation = permutations[value - 1];
+	if (permutation.ready) {
+		return permutation.program;
+	}
+
+	if (!permutation.claimed.exchange(true)) {
+		// no worker has gotten to it yet, so build it here
+		Build(value - 1, false);
+		permutation.ready = true;
+	} else if (!driverCompile) {
+		// a worker is building it right now
+		while (!permutation.ready) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	} else {
+		// issued to the driver up front, wait for its link to complete
+		permutation.program->Finish();
+		permutation.ready = true;
+	}
+
+	return permutation.program;
+}
+
+ShaderPermutations::~ShaderPermutations() {
+	for (uint32_t i = 0; i < count; i++) {
+		delete permutations[i].program;
+		delete permutations[i].pShader;
+		delete permutations[i].vShader;
+	}
+	delete [] permutations;
+}
+
+static ShaderPermutations* multiProjPermutations = NULL;
+static ShaderPermutations* fragmentProjPermutations = NULL;
+static ShaderPermutations* accumulatePermutations = NULL;
+static ShaderPermutations* topKPermutations = NULL;
+static ShaderPermutations* staticProjPermutations = NULL;
+static ShaderPermutations* deferredPermutations = NULL;
+static ShaderPermutations* deferredTopKPermutations = NULL;
+
+// a permutation waiting for the worker pool
+struct PermutationJob {
+	ShaderPermutations* set;
+	uint32_t index;
+};
+
+// the worker pool shared by every permutation set, and the jobs it works through in order. The jobs are all queued
+// before the workers start, so claiming the next one only takes an atomic increment
+static std::vector<std::thread> permutationWorkers;
+static std::vector<void*> permutationContexts;
+static std::vector<PermutationJob> permutationJobs;
+static std::atomic<uint32_t> nextPermutationJob(0);
+
+static void PermutationWorkerMain(void* context) {
+	MakeContextCurrent(context);
+
+	uint32_t next;
+	while ((next = nextPermutationJob++) < permutationJobs.size()) {
+		permutationJobs[next].set->BuildOnWorker(permutationJobs[next].index);
+	}
+
+	MakeContextCurrent(NULL);
+}
+
+// queues every permutation of the set, largest (slowest) first
+static void QueuePermutations(ShaderPermutations* set) {
+	for (uint32_t i = set->GetCount(); i > 0; i--) {
+		PermutationJob job = { set, i - 1 };
+		permutationJobs.push_back(job);
+	}
+}
+
+void PrecompileShaders() {
+	if (multiProjPermutations) {
+		return;
+	}
+
+	multiProjPermutations = new ShaderPermutations("Shaders/multi_textured_light.pix",
+		"Shaders/multi_projected_vertex.vert", "NUM_SAMPLERS", MULTI_PROJ_PERMUTATIONS);
+
+	// beyond the permutations there are too many projections to interpolate, so a single variant projects per fragment
+	fragmentProjPermutations = new ShaderPermutations("Shaders/multi_textured_light.pix",
+		"Shaders/multi_projected_vertex.vert", "FRAGMENT_PROJECTION", 1);
+
+	accumulatePermutations = new ShaderPermutations("Shaders/multi_textured_light.pix",
+		"Shaders/multi_projected_vertex.vert", "NUM_SAMPLERS", ACCUMULATE_BATCH_SIZE, "#define ACCUMULATE 1\n");
+
+	topKPermutations = new ShaderPermutations("Shaders/multi_textured_light.pix",
+		"Shaders/multi_projected_vertex.vert", "TOP_K", 1, "#define FRAGMENT_PROJECTION 1\n");
+
+	staticProjPermutations = new ShaderPermutations("Shaders/multi_textured_light.pix",
+		"Shaders/multi_projected_vertex.vert", "NUM_SAMPLERS", MULTI_PROJ_PERMUTATIONS, "#define STATIC_PROJECTION 1\n");
+
+	// the deferred pass shades a full screen quad from the G-buffer, sampling every projection or only the table's
+	deferredPermutations = new ShaderPermutations("Shaders/multi_textured_light.pix", "Shaders/passthrough.vert",
+		"DEFERRED", 1, "#define FRAGMENT_PROJECTION 1\n");
+
+	deferredTopKPermutations = new ShaderPermutations("Shaders/multi_textured_light.pix", "Shaders/passthrough.vert",
+		"TOP_K", 1, "#define FRAGMENT_PROJECTION 1\n#define DEFERRED 1\n");
+
+	// the driver is already building everything when it compiles in the background
+	if (ShaderProgram::IsParallelCompileSupported()) {
+		return;
+	}
+
+	// otherwise a single pool of workers, each with its own context sharing objects with the main one, builds the
+	// permutations of every set
+	QueuePermutations(multiProjPermutations);
+	QueuePermutations(fragmentProjPermutations);
+	QueuePermutations(accumulatePermutations);
+	QueuePermutations(topKPermutations);
+	QueuePermutations(staticProjPermutations);
+	QueuePermutations(deferredPermutations);
+	QueuePermutations(deferredTopKPermutations);
+	nextPermutationJob = 0;
+
+	uint32_t numWorkers = mini(mini(GetWorkerCount() - 1, MAX_PERMUTATION_WORKERS), (uint32_t) permutationJobs.size());
+	for (uint32_t i = 0; i < numWorkers; i++) {
+		void* context = CreateSharedContext();
+		if (!context) {
+			break;
+		}
+		permutationContexts.push_back(context);
+	}
+	for (uint32_t i = 0; i < permutationContexts.size(); i++) {
+		permutationWorkers.push_back(std::thread(PermutationWorkerMain, permutationContexts[i]));
+	}
+	Log("Building %d shader permutations on %d worker threads", (uint32_t) permutationJobs.size(),
+		(uint32_t) permutationWorkers.size());
+}
+
+void ReleasePrecompiledShaders() {
+	// make sure no worker is still using the programs
+	nextPermutationJob = (uint32_t) permutationJobs.size();
+	for (uint32_t i = 0; i < permutationWorkers.size(); i++) {
+		permutationWorkers[i].join();
+	}
+	for (uint32_t i = 0; i < permutationContexts.size(); i++) {
+		DestroySharedContext(permutationContexts[i]);
+	}
+	permutationWorkers.clear();
+	permutationContexts.clear();
+	permutationJobs.clear();
+
+	delete multiProjPermutations;
+	multiProjPermutations = NULL;
+	delete fragmentProjPermutations;
+	fragmentProjPermutations = NULL;
+	delete accumulatePermutations;
+	accumulatePermutations = NULL;
+	delete topKPermutations;
+	topKPermutations = NULL;
+	delete staticProjPermutations;
+	staticProjPermutations = NULL;
+	delete deferredPermutations;
+	deferredPermutations = NULL;
+	delete deferredTopKPermutations;
+	deferredTopKPermutations = NULL;
+}
+
+ShaderProgram* GetMultiProjProgram(uint32_t numProjections) {
+	PrecompileShaders();
+	if (numProjections > multiProjPermutations->GetCount()) {
+		return fragmentProjPermutations->Get(1);
+	}
+	return multiProjPermutations->Get(numProjections);
+}
+
+ShaderProgram* GetAccumulateProgram(uint32_t numProjections) {
+	PrecompileShaders();
+	return accumulatePermutations->Get(numProjections);
+}
+
+ShaderProgram* GetTopKProgram() {
+	PrecompileShaders();
+	return topKPermutations->Get(1);
+}
+
+ShaderProgram* GetStaticProjProgram(uint32_t numProjections) {
+	PrecompileShaders();
+	if (numProjections > staticProjPermutations->GetCount()) {
+		return NULL;
+	}
+	return staticProjPermutations->Get(numProjections);
+}
+
+ShaderProgram* GetDeferredProgram(bool topK) {
+	PrecompileShaders();
+	return topK ? deferredTopKPermutations->Get(1) : deferredPermutations->Get(1);
+}
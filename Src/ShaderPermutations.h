@@ -0,0 +1,85 @@
+#pragma once
+
+#include "SpecViz.h"
+#include <atomic>
+
+// projections drawn per pass when multi projections are accumulated
+#define ACCUMULATE_BATCH_SIZE 8
+
+// a set of programs built from one pixel/vertex shader pair with a value from 1 to count defined as a macro, such as
+// the NUM_SAMPLERS variants of the multi projection shaders. Every permutation is built up front in the background so
+// viewers can fetch the one they need without stalling. The driver's own compile threads are used when it supports
+// KHR_parallel_shader_compile, otherwise PrecompileShaders queues the permutations of every set for a single pool of
+// worker threads that compile on contexts shared with the main one
+class ShaderPermutations {
+protected:
+	// a single variant of the shaders
+	struct Permutation {
+		PixelShader* pShader;
+		VertexShader* vShader;
+		ShaderProgram* program;
+		std::atomic<bool> claimed;		// a thread has started building the program
+		std::atomic<bool> ready;		// the program is linked and can be used on the main thread
+	};
+
+	const char* pixelPath;
+	const char* vertexPath;
+	const char* macro;
+	const char* predefine;
+	uint32_t count;
+	Permutation* permutations;
+	bool driverCompile;		// every permutation was issued to the driver's compile threads up front
+
+	// builds the shaders and program for the given permutation index on the calling thread's context
+	void Build(uint32_t index, bool deferred);
+
+public:
+	// starts building every permutation of the given shaders with macro defined from 1 to withCount (after any other
+	// predefined macros given). Must be called on the main thread
+	ShaderPermutations(const char* withPixelPath, const char* withVertexPath, const char* withMacro, uint32_t withCount,
+		const char* withPredefine = "");
+
+	// frees all the programs. The worker pool must be done with the set first (see ReleasePrecompiledShaders)
+	virtual ~ShaderPermutations();
+
+	// builds the given permutation on the calling worker thread's context, unless another thread already claimed it
+	void BuildOnWorker(uint32_t index);
+
+	// returns the number of permutations
+	uint32_t GetCount() const {
+		return count;
+	}
+
+	// returns true if the program with macro defined as value can be fetched without waiting
+	bool IsReady(uint32_t value);
+
+	// returns the program with macro defined as value, waiting for (or building) it if it isn't ready yet. The program
+	// stays owned by the permutation set
+	ShaderProgram* Get(uint32_t value);
+};
+
+// starts building the shader permutations used by the viewers. Called once the main GL context exists
+void PrecompileShaders();
+
+// frees the precompiled shader permutations. Called before the main GL context is destroyed
+void ReleasePrecompiledShaders();
+
+// returns the multi projection program for the given number of projections. Up to 16 projections are projected per
+// vertex by a program built for that count, past that per fragment by a program taking the count as a uniform
+ShaderProgram* GetMultiProjProgram(uint32_t numProjections);
+
+// returns the multi projection program that adds the weighted colors of the given number of projections (up to
+// ACCUMULATE_BATCH_SIZE) into an accumulation target
+ShaderProgram* GetAccumulateProgram(uint32_t numProjections);
+
+// returns the multi projection program that only samples the projections a per triangle table (see
+// BuildProjectionTable) picked for each triangle
+ShaderProgram* GetTopKProgram();
+
+// returns the multi projection program that reads each vertex's projected UVs and facing amounts from static
+// attributes (see BuildProjectedAttributes) instead of working them out from texMatrix, or NULL past 16 projections
+ShaderProgram* GetStaticProjProgram(uint32_t numProjections);
+
+// returns the program that shades a full screen quad from the G-buffer of the deferred path, sampling every projection
+// or, with topK set, only the projections the per triangle table picked
+ShaderProgram* GetDeferredProgram(bool topK);
@@ -10,17 +10,42 @@
 #include <stdint.h>
 #include <assert.h>
 #include <vector>
+#include <functional>
 
 // including windows.h by default.. will need to be defined out for other platforms
 #ifdef _MSC_VER
 #include <windows.h>
+#else
+// other compilers (the headless build) get the few MSVC CRT functions used throughout
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#define _strdup strdup
+inline int sprintf_s(char* buffer, size_t size, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(buffer, size, format, args);
+	va_end(args);
+	return written;
+}
+template<size_t size> inline int sprintf_s(char (&buffer)[size], const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(buffer, size, format, args);
+	va_end(args);
+	return written;
+}
+inline int fopen_s(FILE** file, const char* filename, const char* mode) {
+	*file = fopen(filename, mode);
+	return *file ? 0 : errno;
+}
 #endif
 
 // FreeImage used for texture loading
 #include "FreeImage.h"
 
-// glew used for windows WGL interface
-#include "gl/glew.h"
+// glew used for windows WGL interface (and its EGL counterpart in the headless build)
+#include "GL/glew.h"
 
 // GLM library includes for vertex/matrix math needs
 #define GLM_PRECISION_MEDIUMP_INT
@@ -29,23 +54,76 @@
 #include "../glm/glm/glm.hpp"
 #include "../glm/glm/gtc/matrix_transform.hpp"
 
-// abstract viewer object that interacts with the main window
+// camera placement for the viewers that orbit their model, in the same terms the mouse controls: yaw, pitch and roll of
+// the model in radians, the point orbited around, and the distance as a multiple of the viewer's default distance
+struct CameraPose {
+	glm::vec3 rotation;
+	glm::vec3 center;
+	float distance;
+
+	CameraPose() : rotation(0.0f, 0.0f, 0.0f), center(0.0f, 0.0f, 0.0f), distance(1.0f) {}
+};
+
+// abstract viewer object that interacts with the main window. Viewers are only drawn (MainLoop) when something changed
+// what they show; see FrameScheduler
 class Viewer {
+protected:
+	bool dirty;			// the viewer needs to be drawn again
+
 public:
+	Viewer() : dirty(true) {}
 	virtual void MainLoop(float deltaTime) = 0;
 	virtual void NotifyKeyPress(const char* name) = 0;
 	virtual void NotifyMouseWheel(float amt, bool controlHeld) {}
 	virtual void NotifyMouseDrag(float x, float y, uint32_t button, bool controlHeld) = 0;
+	virtual void NotifyMouseDoubleClick(float x, float y) {}
 	virtual void Save(const char* toFile) {}
+
+	// bakes what the viewer shows on its model into a texture atlas, writing the model with atlas UVs to the given
+	// file and the atlas next to it. Returns false if the viewer has nothing to bake
+	virtual bool BakeAtlas(const char* toFile) { return false; }
+
+	// bakes what the viewer shows on its model into the model's vertex colors, writing the model to the given file.
+	// Returns false if the viewer has nothing to bake
+	virtual bool BakeVertexColors(const char* toFile) { return false; }
+
+	// moves the camera to the given pose (used for batch rendering). Returns false if the viewer has no orbiting camera
+	virtual bool SetCameraPose(const CameraPose& pose) { return false; }
 	virtual ~Viewer() {}
+
+	// checks on background work (such as model reloads) between frames, returning true if it changed what the viewer
+	// shows
+	virtual bool Poll() { return false; }
+
+	// returns true while the viewer animates by itself and needs drawing every frame
+	virtual bool IsAnimating() { return false; }
+
+	// marks the viewer as needing to be drawn again
+	void Invalidate() { dirty = true; }
+
+	// returns true if the viewer needs to be drawn again
+	bool IsDirty() const { return dirty; }
+
+	// clears the dirty flag, done as the viewer is drawn
+	void ClearDirty() { dirty = false; }
 };
 
-// platform abstracted viewer access to viewport aspect ratio
+// platform abstracted viewer access to viewport aspect ratio (of the window, or the headless render target)
 float GetAspectRatio();
 
 // output the given text as debug output to the platform log
 void OutputDebug(const char* buff);
 
+// platform abstracted high resolution timer, in seconds since an arbitrary starting point
+double GetTimeSeconds();
+
+// platform abstracted GL contexts that share objects with the main context, so GL work can be done on other threads.
+// CreateSharedContext must be called on the main thread and returns NULL if no more contexts can be created.
+// MakeContextCurrent makes the given context current on the calling thread (NULL releases it)
+void* CreateSharedContext();
+bool MakeContextCurrent(void* context);
+void DestroySharedContext(void* context);
+
 // various model viewer creation functions based on the type of viewer
 Viewer* CreateModelViewer(const char* fileName);
 Viewer* CreateCreateProjViewer(const char* textureFile, const char* modelFile);
@@ -1,5 +1,7 @@
 
 #include "SpecViz.h"
+#include "Profiler.h"
+#include "Parallel.h"
 #include <fstream>
 
 // get the internal format parameter needed for the given OpenGL format for glTexImage2D
@@ -39,39 +41,300 @@ GLenum Texture::GetDataType(GLenum format) {
 	return 0;
 }
 
-// create a texture given the data and format
-Texture::Texture(void* data, uint32_t withWidth, uint32_t withHeight, GLenum withFormat) {
-	// set dimentions and format
-	width = withWidth;
-	height = withHeight;
-	format = withFormat;
+uint32_t Texture::GetPixelSize(GLenum format) {
+	switch (format) {
+		case GL_LUMINANCE8:
+			return 1;
+		case GL_LUMINANCE16:
+			return 2;
+	}
+
+	return 4;
+}
+
+uint32_t Texture::GetNumLevels(uint32_t width, uint32_t height) {
+	uint32_t levels = 1;
+	for (uint32_t size = maxi(width, height); size > 1; size /= 2) {
+		levels++;
+	}
+	return levels;
+}
+
+// averages 2x2 blocks of texels with the given number of components of type T into the next mip level. Odd rows and
+// columns at the edge are folded into the last texel of the level below, which averages 3 texels across them
+template <class T>
+static void BoxFilter(const T* src, uint32_t width, uint32_t height, uint32_t components, T* dst) {
+	uint32_t mipWidth = maxi(width / 2, 1);
+	uint32_t mipHeight = maxi(height / 2, 1);
+
+	ParallelFor(mipHeight, 64, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t y = begin; y < end; y++) {
+			uint32_t firstRow = y * 2;
+			uint32_t numRows = y == mipHeight - 1 ? height - firstRow : 2;
+			T* out = dst + y * mipWidth * components;
+
+			for (uint32_t x = 0; x < mipWidth; x++) {
+				uint32_t firstColumn = x * 2;
+				uint32_t numColumns = x == mipWidth - 1 ? width - firstColumn : 2;
+				uint32_t numTexels = numRows * numColumns;
+				for (uint32_t c = 0; c < components; c++) {
+					uint32_t sum = 0;
+					for (uint32_t r = 0; r < numRows; r++) {
+						const T* row = src + ((firstRow + r) * width + firstColumn) * components + c;
+						for (uint32_t i = 0; i < numColumns; i++) {
+							sum += row[i * components];
+						}
+					}
+					out[x * components + c] = (T) ((sum + numTexels / 2) / numTexels);
+				}
+			}
+		}
+	});
+}
+
+void Texture::GenerateMip(const void* data, uint32_t width, uint32_t height, GLenum format, void* intoMip) {
+	switch (format) {
+		case GL_LUMINANCE8:
+			BoxFilter((const uint8_t*) data, width, height, 1, (uint8_t*) intoMip);
+			break;
+		case GL_LUMINANCE16:
+			BoxFilter((const uint16_t*) data, width, height, 1, (uint16_t*) intoMip);
+			break;
+		default:
+			BoxFilter((const uint8_t*) data, width, height, 4, (uint8_t*) intoMip);
+			break;
+	}
+}
+
+void Texture::BuildMipChain(const void* data, uint32_t width, uint32_t height, GLenum format, uint32_t numLevels,
+	const std::function<void(uint32_t, uint32_t, uint32_t, const void*)>& func) {
+	uint32_t mipSize = maxi(width / 2, 1) * maxi(height / 2, 1) * GetPixelSize(format);
+	uint32_t levelWidth = width, levelHeight = height;
+	const uint8_t* level = (const uint8_t*) data;
+	uint8_t* mipMemory = NULL;
+	if (numLevels > 1) {
+		mipMemory = (uint8_t*) malloc(mipSize * 2);
+	}
+	for (uint32_t i = 0; i < numLevels; i++) {
+		if (i > 0) {
+			// alternate between the two halves of the scratch memory, since each level only needs the one before it
+			uint8_t* mip = mipMemory + (i % 2) * mipSize;
+			PROFILE_BEGIN(mipScope, "generate mip");
+			GenerateMip(level, levelWidth, levelHeight, format, mip);
+			PROFILE_END(mipScope);
+			level = mip;
+			levelWidth = maxi(levelWidth / 2, 1);
+			levelHeight = maxi(levelHeight / 2, 1);
+		}
+		func(i, levelWidth, levelHeight, level);
+	}
+	free(mipMemory);
+}
+
+uint32_t Texture::GetLevelSize(GLenum format, uint32_t width, uint32_t height) {
+	// BC3 stores each 4x4 block of texels in 16 bytes
+	if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+		return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+	}
+
+	return width * height * GetPixelSize(format);
+}
+
+// sets the sampling parameters of a texture, through direct state access or on the bound texture
+static void SetTextureParameter(GLuint texture, GLenum target, GLenum name, GLfloat value) {
+	if (IsDirectStateAccessSupported()) {
+		glTextureParameterf(texture, name, value);
+	} else {
+		glTexParameterf(target, name, value);
+	}
+}
+
+bool Texture::Create() {
+	// with direct state access the texture is set up without being bound, and always has immutable storage
+	if (IsDirectStateAccessSupported()) {
+		glCreateTextures(target, 1, &textureId);
+		SetParameters();
+		if (layers) {
+			glTextureStorage3D(textureId, numLevels, format, width, height, layers);
+		} else {
+			glTextureStorage2D(textureId, numLevels, format, width, height);
+		}
+		GLCHECK();
+		return true;
+	}
 
 	// create and OpenGL ID and bind it
 	glGenTextures(1, &textureId);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, textureId);
+	GLState::BindTexture(0, target, textureId);
 	GLCHECK();
 		
-	// images default to nearest filter (no bilinear filtering by default)
 	glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	SetParameters();
+
+	// immutable storage lets the driver allocate the whole chain once and skip completeness checks at draw time
+	if (GLEW_ARB_texture_storage) {
+		if (layers) {
+			glTexStorage3D(target, numLevels, format, width, height, layers);
+		} else {
+			glTexStorage2D(target, numLevels, format, width, height);
+		}
+		GLCHECK();
+		return true;
+	}
+
+	// arrays are filled in a layer at a time, so without texture storage every level still has to exist up front
+	if (layers) {
+		uint32_t levelWidth = width, levelHeight = height;
+		for (uint32_t i = 0; i < numLevels; i++) {
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				glCompressedTexImage3D(target, i, format, levelWidth, levelHeight, layers, 0,
+					GetLevelSize(format, levelWidth, levelHeight) * layers, NULL);
+			} else {
+				glTexImage3D(target, i, GetInternal(format), levelWidth, levelHeight, layers, 0, GetFormat(format),
+					GetDataType(format), NULL);
+			}
+			levelWidth = maxi(levelWidth / 2, 1);
+			levelHeight = maxi(levelHeight / 2, 1);
+		}
+		GLCHECK();
+		return true;
+	}
+	return false;
+}
+
+void Texture::SetParameters() {
+	if (filter == TEXTURE_FILTER_TRILINEAR) {
+		// minified projections blend between mip levels, and oblique ones take extra samples along the slope
+		SetTextureParameter(textureId, target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		SetTextureParameter(textureId, target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		if (GLEW_EXT_texture_filter_anisotropic) {
+			GLfloat maxAnisotropy = 1.0f;
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+			SetTextureParameter(textureId, target, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+				glm::min(maxAnisotropy, TEXTURE_MAX_ANISOTROPY));
+		}
+	} else {
+		// nearest filter (no bilinear filtering)
+		SetTextureParameter(textureId, target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		SetTextureParameter(textureId, target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	SetTextureParameter(textureId, target, GL_TEXTURE_MAX_LEVEL, (GLfloat) (numLevels - 1));
 	
 	// images should clamp (deprojection often causes wrapping that might otherwise go unseen)
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	SetTextureParameter(textureId, target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	SetTextureParameter(textureId, target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	GLCHECK();
+}
+
+void Texture::UploadLevel(uint32_t level, uint32_t layer, uint32_t levelWidth, uint32_t levelHeight, const void* data,
+	bool allocated) {
+	if (IsDirectStateAccessSupported()) {
+		if (!layers) {
+			glTextureSubImage2D(textureId, level, 0, 0, levelWidth, levelHeight, GetFormat(format), GetDataType(format),
+				data);
+		} else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+			glCompressedTextureSubImage3D(textureId, level, 0, 0, layer, levelWidth, levelHeight, 1, format,
+				GetLevelSize(format, levelWidth, levelHeight), data);
+		} else {
+			glTextureSubImage3D(textureId, level, 0, 0, layer, levelWidth, levelHeight, 1, GetFormat(format),
+				GetDataType(format), data);
+		}
+		GLCHECK();
+		return;
+	}
 
-	// send up the image data to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0, GetInternal(format), width, height, 0, GetFormat(format), GetDataType(format), data);
+	if (layers) {
+		if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+			glCompressedTexSubImage3D(target, level, 0, 0, layer, levelWidth, levelHeight, 1, format,
+				GetLevelSize(format, levelWidth, levelHeight), data);
+		} else {
+			glTexSubImage3D(target, level, 0, 0, layer, levelWidth, levelHeight, 1, GetFormat(format), GetDataType(format),
+				data);
+		}
+	} else if (allocated) {
+		glTexSubImage2D(target, level, 0, 0, levelWidth, levelHeight, GetFormat(format), GetDataType(format), data);
+	} else {
+		glTexImage2D(target, level, GetInternal(format), levelWidth, levelHeight, 0, GetFormat(format), GetDataType(format),
+			data);
+	}
 	GLCHECK();
 }
 
+void Texture::UploadLevels(uint32_t layer, const void* data, bool allocated) {
+	// mip rows are tightly packed, so odd widths can't rely on the default 4 byte row alignment
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// send up the image data to OpenGL, building each mip level from the one before it
+	PROFILE_SCOPE("texture upload");
+	BuildMipChain(data, width, height, format, numLevels,
+		[&](uint32_t level, uint32_t levelWidth, uint32_t levelHeight, const void* levelData) {
+		UploadLevel(level, layer, levelWidth, levelHeight, levelData, allocated);
+	});
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// create a texture given the data and format
+Texture::Texture(void* data, uint32_t withWidth, uint32_t withHeight, GLenum withFormat, TextureFilter withFilter) {
+	// set dimentions and format
+	target = GL_TEXTURE_2D;
+	width = withWidth;
+	height = withHeight;
+	layers = 0;
+	format = withFormat;
+	filter = withFilter;
+	numLevels = filter == TEXTURE_FILTER_TRILINEAR ? GetNumLevels(width, height) : 1;
+
+	bool allocated = Create();
+	UploadLevels(0, data, allocated);
+}
+
+TextureArray::TextureArray(uint32_t withWidth, uint32_t withHeight, uint32_t withLayers, GLenum withFormat,
+	TextureFilter withFilter) {
+	target = GL_TEXTURE_2D_ARRAY;
+	width = withWidth;
+	height = withHeight;
+	layers = withLayers;
+	format = withFormat;
+	filter = withFilter;
+	numLevels = filter == TEXTURE_FILTER_TRILINEAR ? GetNumLevels(width, height) : 1;
+
+	Create();
+}
+
+void TextureArray::SetLayer(uint32_t layer, const void* data) {
+	assert(layer < layers && format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	if (!IsDirectStateAccessSupported()) {
+		GLState::BindTexture(0, target, textureId);
+	}
+	UploadLevels(layer, data, true);
+}
+
+void TextureArray::SetLayerCompressed(uint32_t layer, const void* blocks) {
+	assert(layer < layers && format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	if (!IsDirectStateAccessSupported()) {
+		GLState::BindTexture(0, target, textureId);
+	}
+
+	PROFILE_SCOPE("compressed texture upload");
+	const uint8_t* level = (const uint8_t*) blocks;
+	uint32_t levelWidth = width, levelHeight = height;
+	for (uint32_t i = 0; i < numLevels; i++) {
+		UploadLevel(i, layer, levelWidth, levelHeight, level, true);
+		level += GetLevelSize(format, levelWidth, levelHeight);
+		levelWidth = maxi(levelWidth / 2, 1);
+		levelHeight = maxi(levelHeight / 2, 1);
+	}
+}
+
+Texture::~Texture() {
+	GLState::ForgetTexture(textureId);
+	glDeleteTextures(1, &textureId);
+}
+
 void Texture::Bind(uint32_t samplerId) {
 	// set this texture's OpenGL ID to the sampler ID provided
-	glActiveTexture(GL_TEXTURE0 + samplerId);
-	glBindTexture(GL_TEXTURE_2D, textureId);
+	GLState::BindTexture(samplerId, target, textureId);
 }
 
 // structure for representing simple image bit data (helper struct used when using FreeImage)
@@ -109,8 +372,10 @@ ImageBits GetFileBits(const char* filename) {
 	//pointer to the image, once loaded
 	FIBITMAP *dib(0);
 	//check that the plugin has reading capabilities and load the file
+	PROFILE_BEGIN(decodeScope, "FreeImage decode");
 	if(FreeImage_FIFSupportsReading(fif))
 		dib = FreeImage_Load(fif, filename);
+	PROFILE_END(decodeScope);
 	//if the image failed to load, return failure
 	if(!dib)
 		return ret;
@@ -132,6 +397,7 @@ ImageBits GetFileBits(const char* filename) {
 	if((bits == 0) || (width == 0) || (height == 0))
 		return ret;
 
+	PROFILE_SCOPE("convert pixels");
 	bool loaded = false;
 
 	ret.width = width;
@@ -169,13 +435,14 @@ ImageBits GetFileBits(const char* filename) {
 	return ret;
 }
 
-Texture* Texture::CreateFromFile(const char* filename, GLenum desiredFormat)
+Texture* Texture::CreateFromFile(const char* filename, GLenum desiredFormat, TextureFilter filter)
 {
+	PROFILE_SCOPE("Texture::CreateFromFile");
 	ImageBits image = GetFileBits(filename);
 
 	//if image loaded failed return failure
 	if (image.image == NULL)
-		return false;
+		return NULL;
 
 	Texture* ret = NULL;
 
@@ -184,14 +451,14 @@ Texture* Texture::CreateFromFile(const char* filename, GLenum desiredFormat)
 		for (uint32_t i = 0; i < image.width * image.height; i++) {
 			newBits[i] = (unsigned char) (image.image[i * 4]);
 		}
-		ret = new Texture(newBits, image.width, image.height, desiredFormat);
+		ret = new Texture(newBits, image.width, image.height, desiredFormat, filter);
 		free(newBits);
 	}
 	assert(ret || desiredFormat == GL_RGBA8);
 	
 	if (!ret) {
 		// default behavior just loads it
-		ret = new Texture(image.image, image.width, image.height, desiredFormat);
+		ret = new Texture(image.image, image.width, image.height, desiredFormat, filter);
 	}
 
 	// free up image
@@ -201,14 +468,14 @@ Texture* Texture::CreateFromFile(const char* filename, GLenum desiredFormat)
 	return ret;
 }
 
-Texture* Texture::CreateFromFileCombined(const char* rgbPath, const char* alphaPath) {
+uint8_t* Texture::LoadFileCombined(const char* rgbPath, const char* alphaPath, uint32_t& intoWidth, uint32_t& intoHeight) {
 	ImageBits imageRGB = GetFileBits(rgbPath);
 	ImageBits imageAlpha = GetFileBits(alphaPath);
 
 	//if RGB image loaded failed return failure
 	if (imageRGB.image == NULL) {
 		imageAlpha.free();
-		return false;
+		return NULL;
 	}
 
 	// if alpha image loaded, transform alpha R channgel to imageRGB A channel
@@ -219,15 +486,67 @@ Texture* Texture::CreateFromFileCombined(const char* rgbPath, const char* alphaP
 		}
 	}
 
-	Texture* ret = new Texture(imageRGB.image, imageRGB.width, imageRGB.height, GL_RGBA8);
-
-	imageRGB.free();
 	imageAlpha.free();
 
+	intoWidth = imageRGB.width;
+	intoHeight = imageRGB.height;
+	return imageRGB.image;
+}
+
+uint8_t* Texture::LoadFileChannel(const char* filePath, uint32_t& intoWidth, uint32_t& intoHeight) {
+	ImageBits image = GetFileBits(filePath);
+	if (image.image == NULL) {
+		return NULL;
+	}
+
+	// pack the red channel down in place
+	for (uint32_t i = 0; i < image.width * image.height; i++) {
+		image.image[i] = image.image[i * 4];
+	}
+
+	intoWidth = image.width;
+	intoHeight = image.height;
+	return image.image;
+}
+
+bool Texture::GetImageSize(const char* filename, uint32_t& intoWidth, uint32_t& intoHeight) {
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(filename, 0);
+	if (fif == FIF_UNKNOWN) {
+		fif = FreeImage_GetFIFFromFilename(filename);
+	}
+	if (fif == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(fif)) {
+		return false;
+	}
+
+	// only the header is needed (plugins that can't skip the pixels load the whole image)
+	FIBITMAP* dib = FreeImage_Load(fif, filename, FIF_LOAD_NOPIXELS);
+	if (!dib) {
+		return false;
+	}
+	intoWidth = FreeImage_GetWidth(dib);
+	intoHeight = FreeImage_GetHeight(dib);
+	FreeImage_Unload(dib);
+
+	return true;
+}
+
+Texture* Texture::CreateFromFileCombined(const char* rgbPath, const char* alphaPath, TextureFilter filter) {
+	PROFILE_SCOPE("Texture::CreateFromFileCombined");
+	uint32_t width, height;
+	uint8_t* image = LoadFileCombined(rgbPath, alphaPath, width, height);
+	if (image == NULL) {
+		return NULL;
+	}
+
+	Texture* ret = new Texture(image, width, height, GL_RGBA8, filter);
+	free(image);
+
 	return ret;
 }
 
 void Texture::SavePNG(const char* filename, uint32_t width, uint32_t height, uint8_t* colors, uint32_t destWidth, uint32_t destHeight) {
+	PROFILE_SCOPE("Texture::SavePNG");
+
 	// create FreeImage BITMAP object from the given data (Which is assumed to be 24-bit RGB)
 	FIBITMAP* Image = FreeImage_ConvertFromRawBits(colors, width, height, 3*width, 24, 0xFF0000, 0x00FF00, 0x0000FF, false);
 
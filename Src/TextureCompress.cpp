@@ -0,0 +1,329 @@
+#include "TextureCompress.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "FileCache.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// identifies compressed texture cache files, and their layout version (changing it invalidates every cached texture)
+#define TEXTURE_CACHE_MAGIC 0x33435653
+#define TEXTURE_CACHE_VERSION 2
+
+// info stored with each compressed texture, which must match the array it is loaded into
+struct TextureCacheInfo {
+	uint32_t width;
+	uint32_t height;
+	uint32_t numLevels;
+};
+
+static bool compressionEnabled = false;
+
+void SetTextureCompression(bool enabled) {
+	compressionEnabled = enabled;
+}
+
+bool IsTextureCompressionEnabled() {
+	return compressionEnabled;
+}
+
+// expands a 565 color to 8 bits per channel
+static inline void Unpack565(uint16_t color, int32_t* rgb) {
+	int32_t r = (color >> 11) & 31;
+	int32_t g = (color >> 5) & 63;
+	int32_t b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+static inline uint16_t Pack565(const int32_t* rgb) {
+	return (uint16_t) ((((rgb[0] * 31 + 127) / 255) << 11) | (((rgb[1] * 63 + 127) / 255) << 5) | ((rgb[2] * 31 + 127) / 255));
+}
+
+// encodes the colors of a block of 16 RGBA texels as a BC1 block. The endpoints are the texels furthest apart along
+// the principal axis of the block's colors, which follows gradients much better than the bounding box diagonal
+static void EncodeColorBlock(const uint8_t* texels, uint8_t* out) {
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t i = 0; i < 16; i++) {
+		for (uint32_t c = 0; c < 3; c++) {
+			mean[c] += texels[i * 4 + c];
+		}
+	}
+	for (uint32_t c = 0; c < 3; c++) {
+		mean[c] /= 16.0f;
+	}
+
+	// covariance (rr, rg, rb, gg, gb, bb)
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (uint32_t i = 0; i < 16; i++) {
+		float r = texels[i * 4 + 0] - mean[0];
+		float g = texels[i * 4 + 1] - mean[1];
+		float b = texels[i * 4 + 2] - mean[2];
+		cov[0] += r * r;
+		cov[1] += r * g;
+		cov[2] += r * b;
+		cov[3] += g * g;
+		cov[4] += g * b;
+		cov[5] += b * b;
+	}
+
+	// a few rounds of power iteration are plenty to find the dominant axis
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (uint32_t iter = 0; iter < 4; iter++) {
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float length = glm::max(glm::max(fabs(x), fabs(y)), fabs(z));
+		if (length < 1.0E-6f) {
+			break;
+		}
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+
+	uint32_t minTexel = 0, maxTexel = 0;
+	float minProj = 1.0E+30f, maxProj = -1.0E+30f;
+	for (uint32_t i = 0; i < 16; i++) {
+		float proj = texels[i * 4 + 0] * axis[0] + texels[i * 4 + 1] * axis[1] + texels[i * 4 + 2] * axis[2];
+		if (proj < minProj) {
+			minProj = proj;
+			minTexel = i;
+		}
+		if (proj > maxProj) {
+			maxProj = proj;
+			maxTexel = i;
+		}
+	}
+
+	int32_t maxColor[3] = { texels[maxTexel * 4 + 0], texels[maxTexel * 4 + 1], texels[maxTexel * 4 + 2] };
+	int32_t minColor[3] = { texels[minTexel * 4 + 0], texels[minTexel * 4 + 1], texels[minTexel * 4 + 2] };
+	uint16_t color0 = Pack565(maxColor);
+	uint16_t color1 = Pack565(minColor);
+
+	// the four color mode (with no transparent entry) requires the first endpoint to be the larger
+	if (color0 < color1) {
+		uint16_t swap = color0;
+		color0 = color1;
+		color1 = swap;
+	}
+
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		int32_t palette[4][3];
+		Unpack565(color0, palette[0]);
+		Unpack565(color1, palette[1]);
+		for (uint32_t c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (uint32_t i = 0; i < 16; i++) {
+			uint32_t best = 0;
+			int32_t bestDist = 0x7FFFFFFF;
+			for (uint32_t p = 0; p < 4; p++) {
+				int32_t dr = texels[i * 4 + 0] - palette[p][0];
+				int32_t dg = texels[i * 4 + 1] - palette[p][1];
+				int32_t db = texels[i * 4 + 2] - palette[p][2];
+				int32_t dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist) {
+					bestDist = dist;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	out[0] = (uint8_t) color0;
+	out[1] = (uint8_t) (color0 >> 8);
+	out[2] = (uint8_t) color1;
+	out[3] = (uint8_t) (color1 >> 8);
+	for (uint32_t b = 0; b < 4; b++) {
+		out[4 + b] = (uint8_t) (indices >> (b * 8));
+	}
+}
+
+// encodes the alpha of a block of 16 RGBA texels as a BC4 block, using the eight value mode spanning the block's range
+static void EncodeAlphaBlock(const uint8_t* texels, uint8_t* out) {
+	int32_t alpha0 = 0, alpha1 = 255;
+	for (uint32_t i = 0; i < 16; i++) {
+		alpha0 = maxi(alpha0, texels[i * 4 + 3]);
+		alpha1 = mini(alpha1, texels[i * 4 + 3]);
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1) {
+		int32_t palette[8];
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		for (int32_t p = 2; p < 8; p++) {
+			palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+		}
+
+		for (uint32_t i = 0; i < 16; i++) {
+			uint64_t best = 0;
+			int32_t bestDist = 256;
+			for (uint32_t p = 0; p < 8; p++) {
+				int32_t dist = abs(texels[i * 4 + 3] - palette[p]);
+				if (dist < bestDist) {
+					bestDist = dist;
+					best = p;
+				}
+			}
+			indices |= best << (i * 3);
+		}
+	}
+
+	out[0] = (uint8_t) alpha0;
+	out[1] = (uint8_t) alpha1;
+	for (uint32_t b = 0; b < 6; b++) {
+		out[2 + b] = (uint8_t) (indices >> (b * 8));
+	}
+}
+
+void EncodeBC3(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* intoBlocks) {
+	uint32_t blocksWide = (width + 3) / 4;
+	uint32_t blocksHigh = (height + 3) / 4;
+
+	ParallelFor(blocksHigh, 4, [&](uint32_t begin, uint32_t end) {
+		uint8_t texels[64];
+		for (uint32_t by = begin; by < end; by++) {
+			for (uint32_t bx = 0; bx < blocksWide; bx++) {
+				// gather the block, repeating the last row and column where the image doesn't fill it
+				for (uint32_t y = 0; y < 4; y++) {
+					uint32_t sy = mini(by * 4 + y, height - 1);
+					for (uint32_t x = 0; x < 4; x++) {
+						uint32_t sx = mini(bx * 4 + x, width - 1);
+						memcpy(&texels[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+					}
+				}
+
+				uint8_t* block = intoBlocks + (by * blocksWide + bx) * 16;
+				EncodeAlphaBlock(texels, block);
+				EncodeColorBlock(texels, block + 8);
+			}
+		}
+	});
+}
+
+// hashes the name, size and modification time of a file, so a changed image misses the cache
+static uint64_t HashFile(const char* path, uint64_t hash = HASH_SEED) {
+	hash = HashString(path, hash);
+#ifdef _MSC_VER
+	struct _stat info;
+	if (_stat(path, &info) == 0) {
+#else
+	struct stat info;
+	if (stat(path, &info) == 0) {
+#endif
+		int64_t size = info.st_size;
+		int64_t modified = info.st_mtime;
+		hash = HashBytes(&size, sizeof(size), hash);
+		hash = HashBytes(&modified, sizeof(modified), hash);
+	}
+	return hash;
+}
+
+GLenum GetProjectionFormat() {
+	return compressionEnabled && GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+}
+
+// copies an RGBA8 image into the corner of a larger one, repeating its last row and column over the rest so sampling
+// past its edge behaves as if it were clamped
+static uint8_t* PadImage(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t padWidth, uint32_t padHeight) {
+	uint8_t* padded = (uint8_t*) malloc(padWidth * padHeight * 4);
+	ParallelFor(padHeight, 64, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t y = begin; y < end; y++) {
+			const uint8_t* src = rgba + mini(y, height - 1) * width * 4;
+			uint8_t* dst = padded + y * padWidth * 4;
+			memcpy(dst, src, width * 4);
+			for (uint32_t x = width; x < padWidth; x++) {
+				memcpy(dst + x * 4, src + (width - 1) * 4, 4);
+			}
+		}
+	});
+	return padded;
+}
+
+bool LoadProjectionLayer(TextureArray* array, uint32_t layer, const char* rgbPath, const char* alphaPath) {
+	PROFILE_SCOPE("LoadProjectionLayer");
+	double startTime = GetTimeSeconds();
+	uint32_t arrayWidth = array->GetWidth();
+	uint32_t arrayHeight = array->GetHeight();
+	bool compressed = array->GetTextureFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+	// the cache is keyed by both source images as they are on disk now, and the size they are padded out to
+	uint64_t key = HashFile(rgbPath);
+	key = HashFile(alphaPath, key);
+	key = HashBytes(&arrayWidth, sizeof(arrayWidth), key);
+	key = HashBytes(&arrayHeight, sizeof(arrayHeight), key);
+	char cachePath[64];
+	GetCacheFilePath(cachePath, sizeof(cachePath), TEXTURE_CACHE_DIR, key, "bc3");
+
+	TextureCacheInfo info;
+	info.width = arrayWidth;
+	info.height = arrayHeight;
+	info.numLevels = Texture::GetNumLevels(arrayWidth, arrayHeight);
+	uint32_t length = 0;
+	for (uint32_t i = 0; i < info.numLevels; i++) {
+		length += Texture::GetLevelSize(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, maxi(arrayWidth >> i, 1),
+			maxi(arrayHeight >> i, 1));
+	}
+
+	// a cached texture is only used if it has exactly the levels this array will read from it
+	if (compressed) {
+		TextureCacheInfo cachedInfo;
+		uint32_t cachedLength = 0;
+		uint8_t* blocks = (uint8_t*) LoadCacheFile(cachePath, TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, key,
+			&cachedInfo, sizeof(cachedInfo), cachedLength);
+		if (blocks && cachedInfo.width == info.width && cachedInfo.height == info.height &&
+			cachedInfo.numLevels == info.numLevels && cachedLength == length) {
+			array->SetLayerCompressed(layer, blocks);
+			free(blocks);
+			Log("Loaded compressed texture '%s' in %.2f ms", cachePath, (GetTimeSeconds() - startTime) * 1000.0);
+			return true;
+		}
+		free(blocks);
+	}
+
+	uint32_t width, height;
+	uint8_t* image = Texture::LoadFileCombined(rgbPath, alphaPath, width, height);
+	if (!image) {
+		Log("Unable to load projection image '%s'", rgbPath);
+		return false;
+	}
+	assert(width <= arrayWidth && height <= arrayHeight);
+	if (width != arrayWidth || height != arrayHeight) {
+		uint8_t* padded = PadImage(image, width, height, arrayWidth, arrayHeight);
+		free(image);
+		image = padded;
+	}
+
+	if (!compressed) {
+		array->SetLayer(layer, image);
+		free(image);
+		return true;
+	}
+
+	// encode each level, building the next one from it as we go
+	PROFILE_BEGIN(encodeScope, "encode BC3");
+	uint8_t* blocks = (uint8_t*) malloc(length);
+	uint8_t* levelBlocks = blocks;
+	Texture::BuildMipChain(image, arrayWidth, arrayHeight, GL_RGBA8, info.numLevels,
+		[&](uint32_t level, uint32_t levelWidth, uint32_t levelHeight, const void* levelData) {
+		EncodeBC3((const uint8_t*) levelData, levelWidth, levelHeight, levelBlocks);
+		levelBlocks += Texture::GetLevelSize(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, levelWidth, levelHeight);
+	});
+	free(image);
+	PROFILE_END(encodeScope);
+
+	SaveCacheFile(TEXTURE_CACHE_DIR, cachePath, TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, key, &info, sizeof(info),
+		blocks, length);
+	array->SetLayerCompressed(layer, blocks);
+	free(blocks);
+
+	Log("Compressed '%s' (%dx%d) to BC3 in %.2f ms", rgbPath, width, height, (GetTimeSeconds() - startTime) * 1000.0);
+	return true;
+}
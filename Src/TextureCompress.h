@@ -0,0 +1,26 @@
+#pragma once
+
+#include "SpecViz.h"
+
+// directory compressed projection textures are cached in, relative to the working directory
+#define TEXTURE_CACHE_DIR "TextureCache"
+
+// compresses an RGBA8 image to BC3 (DXT5), which stores each 4x4 block of texels as a BC1 color block and a BC4
+// alpha block, at a byte per texel. Blocks are encoded in parallel
+void EncodeBC3(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* intoBlocks);
+
+// turns compression of projection textures on or off (off by default)
+void SetTextureCompression(bool enabled);
+
+// returns true if projection textures are compressed when loaded
+bool IsTextureCompressionEnabled();
+
+// returns the format projection texture arrays are created with: BC3 when compression is enabled and supported,
+// RGBA8 otherwise
+GLenum GetProjectionFormat();
+
+// loads a projection from a color image and an edge weight image (see Texture::CreateFromFileCombined) into a layer
+// of a projection texture array. Images smaller than the array are padded out by repeating their last row and column.
+// BC3 arrays get the color in the BC1 part and the edge weight in the BC4 alpha, and the compressed layer is cached on
+// disk for the next load
+bool LoadProjectionLayer(TextureArray* array, uint32_t layer, const char* rgbPath, const char* alphaPath);
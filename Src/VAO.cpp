@@ -2,17 +2,29 @@
 #include "SpecViz.h"
 
 
-VAO::VAO(VertexBuffer* withVerts, IndexBuffer* withIndices) {
+VAO::VAO(VertexBuffer* withVerts, IndexBuffer* withIndices) : vertexBuffer(withVerts->GetId()) {
+	if (IsDirectStateAccessSupported()) {
+		glCreateVertexArrays(1, &id);
+		glVertexArrayElementBuffer(id, withIndices->GetId());
+		GLCHECK();
+		return;
+	}
+
 	glGenVertexArrays(1, &id);
-	glBindVertexArray(id);
+	GLState::BindVertexArray(id);
 
 	glBindBuffer(GL_ARRAY_BUFFER, withVerts->GetId());
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, withIndices->GetId());
 	GLCHECK();
 }
 
+VAO::~VAO() {
+	GLState::ForgetVertexArray(id);
+	glDeleteVertexArrays(1, &id);
+}
+
 void VAO::Bind() {
-	glBindVertexArray(id);
+	GLState::BindVertexArray(id);
 }
 
 void VAO::EnableArrays(int32_t count) {
@@ -33,10 +45,14 @@ void VAO::EnableArrays(int32_t count) {
 			break;
 	}
 
+	// the direct state access path gives the vertex buffer a binding of its own that every attribute reads from
+	bool directState = IsDirectStateAccessSupported();
+	if (directState) {
+		glVertexArrayVertexBuffer(id, 0, vertexBuffer, 0, strideSize);
+	}
+
 	uint8_t* curOffset = NULL;
 	for (int32_t i = 0; i < count; i++) {
-		glEnableVertexAttribArray(i);
-
 		int32_t numFloats = 0;
 		switch (i) {	
 			case 0:
@@ -53,11 +69,38 @@ void VAO::EnableArrays(int32_t count) {
 				assert(false);
 				break;
 		}
-		glVertexAttribPointer(i, numFloats, GL_FLOAT, GL_FALSE, strideSize, curOffset);
+		if (directState) {
+			glEnableVertexArrayAttrib(id, i);
+			glVertexArrayAttribFormat(id, i, numFloats, GL_FLOAT, GL_FALSE, (GLuint) (curOffset - (uint8_t*) NULL));
+			glVertexArrayAttribBinding(id, i, 0);
+		} else {
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, numFloats, GL_FLOAT, GL_FALSE, strideSize, curOffset);
+		}
 		curOffset += sizeof(float) * numFloats;
 	}
 }
 
+void VAO::AddArray(VertexBuffer* buffer, uint32_t location, int32_t components, GLenum type, bool normalized,
+	int32_t stride, uint32_t offset) {
+	// each extra attribute gets the binding matching its location, which the vertex buffer's binding 0 never is
+	assert(location > 0);
+	if (IsDirectStateAccessSupported()) {
+		glVertexArrayVertexBuffer(id, location, buffer->GetId(), offset, stride);
+		glEnableVertexArrayAttrib(id, location);
+		glVertexArrayAttribFormat(id, location, components, type, normalized ? GL_TRUE : GL_FALSE, 0);
+		glVertexArrayAttribBinding(id, location, location);
+		GLCHECK();
+		return;
+	}
+
+	GLState::BindVertexArray(id);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer->GetId());
+	glEnableVertexAttribArray(location);
+	glVertexAttribPointer(location, components, type, normalized ? GL_TRUE : GL_FALSE, stride, (uint8_t*) NULL + offset);
+	GLCHECK();
+}
+
 void VAO::Unbind() {
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "VertexColorBake.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "VertexSIMD.h"
+
+// a loaded projection image
+struct BakeImage {
+	uint8_t* pixels;		// RGBA8 with the edge distance in alpha, NULL if the image couldn't be loaded
+	uint32_t width;
+	uint32_t height;
+};
+
+// bilinear sample of the image at the given UV (0-1 across the image), clamped to its edges
+static glm::vec4 SampleBilinear(const BakeImage& image, float u, float v) {
+	float x = glm::clamp(u * image.width - 0.5f, 0.0f, (float) (image.width - 1));
+	float y = glm::clamp(v * image.height - 0.5f, 0.0f, (float) (image.height - 1));
+	uint32_t x0 = (uint32_t) x;
+	uint32_t y0 = (uint32_t) y;
+	uint32_t x1 = mini(x0 + 1, image.width - 1);
+	uint32_t y1 = mini(y0 + 1, image.height - 1);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	const uint8_t* p00 = image.pixels + (y0 * image.width + x0) * 4;
+	const uint8_t* p10 = image.pixels + (y0 * image.width + x1) * 4;
+	const uint8_t* p01 = image.pixels + (y1 * image.width + x0) * 4;
+	const uint8_t* p11 = image.pixels + (y1 * image.width + x1) * 4;
+	glm::vec4 top = glm::mix(glm::vec4(p00[0], p00[1], p00[2], p00[3]), glm::vec4(p10[0], p10[1], p10[2], p10[3]), fx);
+	glm::vec4 bottom = glm::mix(glm::vec4(p01[0], p01[1], p01[2], p01[3]), glm::vec4(p11[0], p11[1], p11[2], p11[3]), fx);
+	return glm::mix(top, bottom, fy) / 255.0f;
+}
+
+void BakeVertexColors(std::vector<PlyVertex>& vertices, const glm::mat4* texMatrices,
+	const std::vector<std::string>& colorPaths, const std::vector<std::string>& edgePaths) {
+	PROFILE_SCOPE("BakeVertexColors");
+
+	uint32_t numVertices = vertices.size();
+	uint32_t numProjections = colorPaths.size();
+
+	// weighted color sums (weight in w), and the best facing color so far (facing in w) for unweighted vertices
+	std::vector<glm::vec4> sums(numVertices, glm::vec4(0.0f));
+	std::vector<glm::vec4> best(numVertices, glm::vec4(0.0f));
+
+	BakeImage group[VERTEX_BAKE_IMAGE_GROUP];
+	for (uint32_t first = 0; first < numProjections; first += VERTEX_BAKE_IMAGE_GROUP) {
+		uint32_t count = mini(numProjections - first, VERTEX_BAKE_IMAGE_GROUP);
+
+		PROFILE_BEGIN(loadProfile, "load projection images");
+		ParallelFor(count, 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				BakeImage& image = group[i];
+				image.pixels = Texture::LoadFileCombined(colorPaths[first + i].c_str(), edgePaths[first + i].c_str(),
+					image.width, image.height);
+				if (!image.pixels) {
+					Log("Unable to load '%s', skipping it", colorPaths[first + i].c_str());
+				}
+			}
+		});
+		PROFILE_END(loadProfile);
+
+		PROFILE_BEGIN(blendProfile, "blend vertices");
+		uint32_t numPackets = (numVertices + 3) / 4;
+		ParallelFor(numPackets, 4096, [&](uint32_t begin, uint32_t end) {
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 half = _mm_set1_ps(0.5f);
+
+			for (uint32_t packet = begin; packet < end; packet++) {
+				VertexPacket4 v;
+				LoadVertices4(vertices, packet, v);
+
+				for (uint32_t i = 0; i < count; i++) {
+					const BakeImage& image = group[i];
+					if (!image.pixels) {
+						continue;
+					}
+
+					ProjectedVertices4 proj;
+					ProjectVertices4(v, texMatrices[first + i], proj);
+
+					// UV across the image, and which vertices fall inside the frustum with a normal to face it
+					__m128 visible = _mm_cmpgt_ps(proj.w, zero);
+					__m128 invW = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(visible, proj.w), _mm_andnot_ps(visible, one)));
+					__m128 u = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(proj.x, invW), half), half);
+					__m128 uvV = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(proj.y, invW), half), half);
+					visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+					visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpge_ps(uvV, zero), _mm_cmple_ps(uvV, one)));
+					visible = _mm_and_ps(visible, _mm_cmpgt_ps(proj.normalLengthSq, zero));
+
+					int32_t visibleMask = _mm_movemask_ps(visible);
+					if (!visibleMask) {
+						continue;
+					}
+
+					// the photo lookups are scattered, so they are done a lane at a time
+					float laneU[4], laneV[4], laneFacing[4];
+					_mm_storeu_ps(laneU, u);
+					_mm_storeu_ps(laneV, uvV);
+					_mm_storeu_ps(laneFacing, proj.facing);
+					for (uint32_t lane = 0; lane < v.lanes; lane++) {
+						if (!(visibleMask & (1 << lane))) {
+							continue;
+						}
+
+						glm::vec4 texel = SampleBilinear(image, laneU[lane], laneV[lane]);
+						float weight = glm::max(texel.a - 0.1f, 0.0f) * laneFacing[lane];
+						uint32_t vertex = v.index[lane];
+						sums[vertex] += glm::vec4(glm::vec3(texel) * weight, weight);
+						if (laneFacing[lane] > best[vertex].w) {
+							best[vertex] = glm::vec4(glm::vec3(texel), laneFacing[lane]);
+						}
+					}
+				}
+			}
+		});
+		PROFILE_END(blendProfile);
+
+		for (uint32_t i = 0; i < count; i++) {
+			free(group[i].pixels);
+		}
+	}
+
+	uint32_t unseen = 0;
+	for (uint32_t i = 0; i < numVertices; i++) {
+		if (sums[i].w > 0.0f) {
+			vertices[i].color = glm::vec4(glm::vec3(sums[i]) / sums[i].w, 1.0f);
+		} else if (best[i].w > 0.0f) {
+			vertices[i].color = glm::vec4(glm::vec3(best[i]), 1.0f);
+		} else {
+			unseen++;
+		}
+	}
+
+	Log("Baked %d projections into %d vertex colors (%d vertices unseen)", numProjections, numVertices, unseen);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "PlyModel.h"
+
+#include <string>
+
+// projection images held in memory at once while baking (each is a full RGBA8 copy of a photo)
+#define VERTEX_BAKE_IMAGE_GROUP 4
+
+// bakes projections into the color of every vertex, blended with the weighting multi_textured_light.pix uses: each
+// projection that sees the vertex (inside its frustum) adds its bilinearly sampled color weighted by the facing amount
+// of the vertex normal towards it times its edge distance less 0.1. Vertices without any weight take the color of the
+// projection facing them best, and vertices no projection sees are left as they were. colorPaths and edgePaths hold
+// the images of each projection, as for Texture::LoadFileCombined. Vertices are transformed four at a time with SSE,
+// in parallel across cores, and the images are loaded a group at a time
+void BakeVertexColors(std::vector<PlyVertex>& vertices, const glm::mat4* texMatrices,
+	const std::vector<std::string>& colorPaths, const std::vector<std::string>& edgePaths);
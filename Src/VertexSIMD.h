@@ -0,0 +1,62 @@
+#pragma once
+
+#include "PlyModel.h"
+
+#include <emmintrin.h>
+
+// four vertices of a model loaded as structure of arrays, for transforming with SSE
+struct VertexPacket4 {
+	uint32_t index[4];		// vertex each lane holds
+	uint32_t lanes;			// lanes holding distinct vertices (the last packet repeats its last vertex in the rest)
+	__m128 px, py, pz;
+	__m128 nx, ny, nz;
+};
+
+// four vertices transformed by a projection's texMatrix
+struct ProjectedVertices4 {
+	__m128 x, y, w;			// clip space position (z isn't needed)
+	__m128 normalLengthSq;	// squared length of texMatrix * normal, zero when it has no length
+	__m128 facing;			// abs(normalize(texMatrix * normal).z), how much the normal faces the projection
+};
+
+// loads the given packet of four vertices (vertices packet * 4 onwards)
+inline void LoadVertices4(const std::vector<PlyVertex>& vertices, uint32_t packet, VertexPacket4& into) {
+	uint32_t numVertices = vertices.size();
+	for (uint32_t lane = 0; lane < 4; lane++) {
+		into.index[lane] = mini(packet * 4 + lane, numVertices - 1);
+	}
+	into.lanes = mini(numVertices - packet * 4, 4);
+
+	const PlyVertex* v[4] = { &vertices[into.index[0]], &vertices[into.index[1]], &vertices[into.index[2]],
+		&vertices[into.index[3]] };
+	into.px = _mm_setr_ps(v[0]->position.x, v[1]->position.x, v[2]->position.x, v[3]->position.x);
+	into.py = _mm_setr_ps(v[0]->position.y, v[1]->position.y, v[2]->position.y, v[3]->position.y);
+	into.pz = _mm_setr_ps(v[0]->position.z, v[1]->position.z, v[2]->position.z, v[3]->position.z);
+	into.nx = _mm_setr_ps(v[0]->normal.x, v[1]->normal.x, v[2]->normal.x, v[3]->normal.x);
+	into.ny = _mm_setr_ps(v[0]->normal.y, v[1]->normal.y, v[2]->normal.y, v[3]->normal.y);
+	into.nz = _mm_setr_ps(v[0]->normal.z, v[1]->normal.z, v[2]->normal.z, v[3]->normal.z);
+}
+
+// transforms a packet of four vertices by the given texMatrix, the way the multi projection vertex shaders do
+inline void ProjectVertices4(const VertexPacket4& v, const glm::mat4& m, ProjectedVertices4& into) {
+	// texMatrix * position (glm matrices are column major)
+	into.x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][0]), v.px), _mm_mul_ps(_mm_set1_ps(m[1][0]), v.py)),
+		_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][0]), v.pz), _mm_set1_ps(m[3][0])));
+	into.y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][1]), v.px), _mm_mul_ps(_mm_set1_ps(m[1][1]), v.py)),
+		_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][1]), v.pz), _mm_set1_ps(m[3][1])));
+	into.w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][3]), v.px), _mm_mul_ps(_mm_set1_ps(m[1][3]), v.py)),
+		_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][3]), v.pz), _mm_set1_ps(m[3][3])));
+
+	// texMatrix * normal, of which only the direction matters
+	__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][0]), v.nx), _mm_mul_ps(_mm_set1_ps(m[1][0]), v.ny)),
+		_mm_mul_ps(_mm_set1_ps(m[2][0]), v.nz));
+	__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][1]), v.nx), _mm_mul_ps(_mm_set1_ps(m[1][1]), v.ny)),
+		_mm_mul_ps(_mm_set1_ps(m[2][1]), v.nz));
+	__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][2]), v.nx), _mm_mul_ps(_mm_set1_ps(m[1][2]), v.ny)),
+		_mm_mul_ps(_mm_set1_ps(m[2][2]), v.nz));
+	into.normalLengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz));
+
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	into.facing = _mm_div_ps(_mm_and_ps(tz, absMask), _mm_sqrt_ps(_mm_max_ps(into.normalLengthSq,
+		_mm_set1_ps(1.0E-30F))));
+}
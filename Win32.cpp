@@ -2,6 +2,15 @@
 //
 
 #include "SpecViz.h"
+#include "PlyModel.h"
+#include "MeshArchive.h"
+#include "BVH.h"
+#include "ShaderPermutations.h"
+#include "FrameScheduler.h"
+#include "GLDebug.h"
+#include "GPUProfiler.h"
+#include "Profiler.h"
+#include "TextureCompress.h"
 
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 // Windows Header Files:
@@ -17,12 +26,16 @@
  
 #define MAX_LOADSTRING 100
 
+// frame rate cap used unless one is given on the command line ("-maxfps 30", 0 for uncapped)
+#define DEFAULT_MAX_FPS 60.0f
+
 // Global Variables:
 HINSTANCE hInst;								// current instance
 TCHAR szTitle[MAX_LOADSTRING];					// The title bar text
 TCHAR szWindowClass[MAX_LOADSTRING];			// the main window class name
 HGLRC glContext = NULL;							// OpenGL context
 HDC glDC = 0;									// OpenGL device context
+bool glDebugContext = false;					// glContext was created as a debug context
 HWND gWnd = 0;
 Viewer* currentViewer = NULL;
 
@@ -31,6 +44,9 @@ ATOM				MyRegisterClass(HINSTANCE hInstance);
 BOOL				InitInstance(HINSTANCE, int);
 LRESULT CALLBACK	WndProc(HWND, UINT, WPARAM, LPARAM);
 INT_PTR CALLBACK	About(HWND, UINT, WPARAM, LPARAM);
+#ifdef _DEBUG
+static HGLRC		CreateDebugContext(HGLRC share);
+#endif
 
 int APIENTRY _tWinMain(HINSTANCE hInstance,
 					 HINSTANCE hPrevInstance,
@@ -38,7 +54,6 @@ int APIENTRY _tWinMain(HINSTANCE hInstance,
 					 int       nCmdShow)
 {
 	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(lpCmdLine);
 
 	// TODO: Place code here.
 	MSG msg;
@@ -57,12 +72,20 @@ int APIENTRY _tWinMain(HINSTANCE hInstance,
 
 	hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_SPECVIZ));
 	
-	// Start high resolution timer
-	LARGE_INTEGER intoFreq;
-	QueryPerformanceFrequency(&intoFreq);
+	// frames are only drawn when the viewer needs it, up to the frame rate cap
+	float maxFPS = DEFAULT_MAX_FPS;
+	const TCHAR* fpsArg = _tcsstr(lpCmdLine, _T("-maxfps"));
+	if (fpsArg) {
+		maxFPS = (float) _tcstod(fpsArg + 7, NULL);
+	}
+	FrameScheduler scheduler(maxFPS);
+
+	// projection textures are BC3 compressed when asked for ("-compress"), for a quarter of the video memory
+	if (_tcsstr(lpCmdLine, _T("-compress"))) {
+		SetTextureCompression(true);
+	}
 
-	LARGE_INTEGER lastTime;
-	QueryPerformanceCounter(&lastTime);
+	double lastTime = GetTimeSeconds();
 
 	// Main message loop:
 	while (gWnd) {
@@ -74,16 +97,23 @@ int APIENTRY _tWinMain(HINSTANCE hInstance,
 				DispatchMessage(&msg);
 			}
 		} else if (glContext) {
-			LARGE_INTEGER curTime;
-			QueryPerformanceCounter(&curTime);
-
-			double deltaTime = (double) (curTime.QuadPart - lastTime.QuadPart) / (double) intoFreq.QuadPart;
-			if (currentViewer) {
-				currentViewer->MainLoop((float) deltaTime);
+			double curTime = GetTimeSeconds();
+			if (scheduler.ShouldDraw(currentViewer, curTime)) {
+				PROFILE_SCOPE("frame");
+				GetGPUProfiler()->BeginFrame();
+				PROFILE_BEGIN(mainLoopScope, "MainLoop");
+				currentViewer->MainLoop((float) (curTime - lastTime));
+				PROFILE_END(mainLoopScope);
+				GetGPUProfiler()->EndFrame();
+				GLState::EndFrame();
+				PROFILE_BEGIN(swapScope, "SwapBuffers");
 				SwapBuffers(glDC);
+				PROFILE_END(swapScope);
+				lastTime = curTime;
+			} else {
+				// nothing to draw, so sleep until input arrives or the scheduler wants to check again
+				MsgWaitForMultipleObjects(0, NULL, FALSE, scheduler.GetWaitMs(currentViewer, curTime), QS_ALLINPUT);
 			}
-
-			lastTime = curTime;
 		}
 	};
 
@@ -111,7 +141,7 @@ ATOM MyRegisterClass(HINSTANCE hInstance)
 
 	wcex.cbSize = sizeof(WNDCLASSEX);
 
-	wcex.style			= CS_HREDRAW | CS_VREDRAW;
+	wcex.style			= CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS;
 	wcex.lpfnWndProc	= WndProc;
 	wcex.cbClsExtra		= 0;
 	wcex.cbWndExtra		= 0;
@@ -155,7 +185,7 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 }
 
 // Set up and show open file dialog and return result
-bool OpenFile(char* intoBuffer, char* fileFilter, bool isSave = false) {
+bool OpenFile(char* intoBuffer, char* fileFilter, bool isSave = false, const char* defaultExt = "prj") {
 	char dir[512];
 	GetCurrentDirectory(512, dir);
 
@@ -174,7 +204,7 @@ bool OpenFile(char* intoBuffer, char* fileFilter, bool isSave = false) {
 
 	if (isSave) {
 		ofn.lpstrTitle = "Save file";
-		ofn.lpstrDefExt = "prj";
+		ofn.lpstrDefExt = defaultExt;
 		ofn.Flags = OFN_OVERWRITEPROMPT | OFN_EXPLORER;
 		GetSaveFileName(&ofn);
 	} else {
@@ -192,6 +222,50 @@ bool OpenFile(char* intoBuffer, char* fileFilter, bool isSave = false) {
 	return true;
 }
 
+// Set up and show an open file dialog allowing many files to be picked, and add the full path of each (allocated with
+// _strdup) to intoFiles
+bool OpenFiles(std::vector<const char*>& intoFiles, char* fileFilter) {
+	char dir[512];
+	GetCurrentDirectory(512, dir);
+
+	// the selection comes back as the directory followed by each file name, so leave room for a lot of names
+	const uint32_t bufferSize = 65536;
+	char* buffer = (char*) calloc(bufferSize, 1);
+
+	OPENFILENAME ofn;
+	ZeroMemory(&ofn, sizeof(ofn));
+	ofn.lStructSize = sizeof(ofn);
+	ofn.hwndOwner = gWnd;
+	ofn.lpstrFile = buffer;
+	ofn.nMaxFile = bufferSize;
+	ofn.lpstrFilter = fileFilter;
+	ofn.nFilterIndex = 0;
+	ofn.lpstrInitialDir = dir;
+	ofn.lpstrTitle = "Select files";
+	ofn.Flags = OFN_FILEMUSTEXIST | OFN_EXPLORER | OFN_ALLOWMULTISELECT;
+	GetOpenFileName(&ofn);
+
+	// make sure the current directory stays the same so our relative path names still work
+	SetCurrentDirectory(dir);
+
+	// a single file comes back as one full path, otherwise the directory is followed by the names
+	if (buffer[0]) {
+		const char* name = buffer + strlen(buffer) + 1;
+		if (!*name) {
+			intoFiles.push_back(_strdup(buffer));
+		} else {
+			char path[MAX_PATH];
+			for (; *name; name += strlen(name) + 1) {
+				sprintf_s(path, "%s\\%s", buffer, name);
+				intoFiles.push_back(_strdup(path));
+			}
+		}
+	}
+	free(buffer);
+
+	return intoFiles.size() > 0;
+}
+
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
 	int wmId, wmEvent;
@@ -215,7 +289,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 				char textureFile[512];
 				char modelFile[512];
 				if (OpenFile(textureFile, "Color Map Files\0*.ppm;*.png;*.jpg\0")) {
-					if (OpenFile(modelFile, "PLY Files\0*.ply\0")) {
+					if (OpenFile(modelFile, "PLY Files\0*.ply;*.svm\0")) {
 						currentViewer = CreateCreateProjViewer(textureFile, modelFile);
 					}
 				}
@@ -231,6 +305,34 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 				}
 				break;
 			}
+			case ID_BAKEATLAS:
+			{
+				if (currentViewer) {
+					char plyFile[512];
+					if (OpenFile(plyFile, "PLY Files\0*.ply\0", true, "ply")) {
+						if (currentViewer->BakeAtlas(plyFile)) {
+							MessageBox(hWnd, "Texture atlas baked, open the saved model to view it.", "Done", MB_OK);
+						} else {
+							MessageBox(hWnd, "Unable to bake a texture atlas for this view.", "Error", MB_OK);
+						}
+					}
+				}
+				break;
+			}
+			case ID_BAKEVERTEXCOLORS:
+			{
+				if (currentViewer) {
+					char plyFile[512];
+					if (OpenFile(plyFile, "PLY Files\0*.ply\0", true, "ply")) {
+						if (currentViewer->BakeVertexColors(plyFile)) {
+							MessageBox(hWnd, "Vertex colors baked, open the saved model to view them.", "Done", MB_OK);
+						} else {
+							MessageBox(hWnd, "Unable to bake vertex colors for this view.", "Error", MB_OK);
+						}
+					}
+				}
+				break;
+			}
 			case ID_CREATEDEPTHFIELD:
 			{
 				char projFile[512];
@@ -240,6 +342,49 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 				}
 				break;
 			}
+			case ID_EXPORTMESHARCHIVE:
+			{
+				char plyFile[512];
+				char archiveFile[512];
+				if (OpenFile(plyFile, "PLY Files\0*.ply\0")) {
+					if (OpenFile(archiveFile, "Compressed Mesh Files\0*.svm\0", true, "svm")) {
+						PlyModelData data;
+						if (PlyModel::Load(plyFile, data) && SaveMeshArchive(archiveFile, data)) {
+							MessageBox(hWnd, "Compressed mesh archive created.", "Done", MB_OK);
+						} else {
+							MessageBox(hWnd, "Unable to create compressed mesh archive.", "Error", MB_OK);
+						}
+					}
+				}
+				break;
+			}
+			case ID_BENCHMARKBVH:
+			{
+				char plyFile[512];
+				if (OpenFile(plyFile, "PLY Files\0*.ply;*.svm\0")) {
+					BenchmarkBVH(plyFile);
+					MessageBox(hWnd, "Ray query benchmark finished, see the debug output for results.", "Done", MB_OK);
+				}
+				break;
+			}
+			case ID_SAVEGPUTIMINGS:
+			{
+				char csvFile[512];
+				if (OpenFile(csvFile, "CSV Files\0*.csv\0", true, "csv")) {
+					GetGPUProfiler()->LogStats();
+					GLState::LogStats();
+					GetGPUProfiler()->SaveCSV(csvFile);
+				}
+				break;
+			}
+			case ID_SAVECPUTRACE:
+			{
+				char traceFile[512];
+				if (OpenFile(traceFile, "Chrome Trace Files\0*.json\0", true, "json")) {
+					SaveProfileTrace(traceFile);
+				}
+				break;
+			}
 			case ID_OPENMODEL:
 			{
 				if (currentViewer) {
@@ -247,7 +392,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 					currentViewer = NULL;
 				}
 				char file[512];
-				if (OpenFile(file, "PLY Files\0*.ply\0")) {
+				if (OpenFile(file, "PLY Files\0*.ply;*.svm\0")) {
 					currentViewer = CreateModelViewer(file);
 				}
 				break;
@@ -287,23 +432,22 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 					currentViewer = NULL;
 				}
 				
-				char projFile[512];
+				// every projection is picked at once in a multiple selection dialog
 				std::vector<const char*> projFiles;
-
-				for (uint32_t i = 0; i < 16; i++) {
-					if (OpenFile(projFile, "Projection Files\0*.prj\0")) {
-						if (projFiles.size() && strcmp(projFiles[projFiles.size()-1], projFile) == 0) {
-							i = 15;
-						} else {
-							projFiles.push_back(_strdup(projFile));
+				if (OpenFiles(projFiles, "Projection Files\0*.prj\0")) {
+					if (projFiles.size() > MAX_PROJECTIONS) {
+						Log("Only the first %d of %d projections will be shown", MAX_PROJECTIONS, (uint32_t) projFiles.size());
+						for (uint32_t i = MAX_PROJECTIONS; i < projFiles.size(); i++) {
+							free((void*) projFiles[i]);
 						}
-						if (i == 15) {
-							currentViewer = CreateMultiProjViewer(projFiles);
-							break;
-						}
-					} else {
-						break;
+						projFiles.resize(MAX_PROJECTIONS);
 					}
+					currentViewer = CreateMultiProjViewer(projFiles);
+				}
+
+				// the viewer keeps copies of the names it needs
+				for (uint32_t i = 0; i < projFiles.size(); i++) {
+					free((void*) projFiles[i]);
 				}
 				break;
 			}
@@ -327,10 +471,14 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		break;
 	case WM_PAINT:
 		hdc = BeginPaint(hWnd, &ps);
-		// TODO: Add any drawing code here...
+		// the window contents were lost, so the viewer has to draw again
+		if (currentViewer) {
+			currentViewer->Invalidate();
+		}
 		EndPaint(hWnd, &ps);
 		break;
 	case WM_DESTROY:
+		ReleasePrecompiledShaders();
 		wglDeleteContext(glContext);
 		DestroyWindow(hWnd);
 		gWnd = 0;
@@ -343,6 +491,9 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 				BOOL ret = GetClientRect(hWnd,&clientRect);
 				glViewport(0,0,clientRect.right,clientRect.bottom);
 			}
+			if (currentViewer) {
+				currentViewer->Invalidate();
+			}
 			break;
 		}
 	case WM_CREATE:
@@ -378,6 +529,31 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			
 			GLenum err = glewInit();
 			assert(err == GLEW_OK);
+
+#ifdef _DEBUG
+			// debug builds draw on a debug context, on which drivers report everything they can. Creating it needs the
+			// extensions the first context just loaded
+			if (WGLEW_ARB_create_context) {
+				HGLRC debugContext = CreateDebugContext(NULL);
+				if (debugContext) {
+					wglMakeCurrent(glDC, debugContext);
+					wglDeleteContext(glContext);
+					glContext = debugContext;
+					glDebugContext = true;
+					err = glewInit();
+					assert(err == GLEW_OK);
+				}
+			}
+
+			// and get errors reported inside the call that caused them
+			InitDebugOutput(GL_DEBUG_SEVERITY_LOW, true);
+#else
+			InitDebugOutput(GL_DEBUG_SEVERITY_MEDIUM, false);
+#endif
+			GLState::Init();
+
+			// get the shader variants the viewers need building in the background straight away
+			PrecompileShaders();
 		}
 		break;
 	case WM_KEYDOWN:
@@ -396,6 +572,26 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			case 'B':
 				key = "b";
 				break;
+			case 'p':
+			case 'P':
+				key = "p";
+				break;
+			case 'a':
+			case 'A':
+				key = "a";
+				break;
+			case 't':
+			case 'T':
+				key = "t";
+				break;
+			case 'v':
+			case 'V':
+				key = "v";
+				break;
+			case 'd':
+			case 'D':
+				key = "d";
+				break;
 			case VK_LEFT:
 				key = "left";
 				break;
@@ -414,6 +610,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		}
 		if (key && currentViewer) {
 			currentViewer->NotifyKeyPress(key);
+			currentViewer->Invalidate();
 		}
 		break;
 	}
@@ -433,16 +630,35 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			} else if (wParam & MK_RBUTTON) {
 				currentViewer->NotifyMouseDrag((float) xPos - lastXPos, (float) yPos - lastYPos, 2, control);
 			}
+			if (wParam & (MK_LBUTTON | MK_MBUTTON | MK_RBUTTON)) {
+				currentViewer->Invalidate();
+			}
 		}
 
 		lastXPos = xPos;
 		lastYPos = yPos;
 		break;
 	}
+	case WM_LBUTTONDBLCLK:
+	{
+		// pass the click position on in normalized device coordinates
+		RECT rect;
+		GetClientRect(hWnd, &rect);
+		if (currentViewer && rect.right > 0 && rect.bottom > 0) {
+			float x = (GET_X_LPARAM(lParam) + 0.5f) / rect.right * 2.0f - 1.0f;
+			float y = 1.0f - (GET_Y_LPARAM(lParam) + 0.5f) / rect.bottom * 2.0f;
+			currentViewer->NotifyMouseDoubleClick(x, y);
+			currentViewer->Invalidate();
+		}
+		break;
+	}
 	case WM_MOUSEWHEEL:
 	{
 		short zDelta = GET_WHEEL_DELTA_WPARAM(wParam);
-		currentViewer->NotifyMouseWheel((float) zDelta / 120.0f, (wParam & MK_CONTROL) != 0);
+		if (currentViewer) {
+			currentViewer->NotifyMouseWheel((float) zDelta / 120.0f, (wParam & MK_CONTROL) != 0);
+			currentViewer->Invalidate();
+		}
 		break;
 	}
 	default:
@@ -484,4 +700,61 @@ void OutputDebug(const char* line) {
 	OutputDebugString("\n");
 	printf(line);
 	printf("\n");
+}
+
+double GetTimeSeconds() {
+	static LARGE_INTEGER freq = { 0 };
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart / (double) freq.QuadPart;
+}
+
+#ifdef _DEBUG
+// creates a debug context on the window, sharing objects with the given context (if any). Returns NULL on failure
+static HGLRC CreateDebugContext(HGLRC share) {
+	const int attributes[] = {
+		WGL_CONTEXT_FLAGS_ARB, WGL_CONTEXT_DEBUG_BIT_ARB,
+		0
+	};
+	return wglCreateContextAttribsARB(glDC, share, attributes);
+}
+#endif
+
+void* CreateSharedContext() {
+#ifdef _DEBUG
+	// shared contexts should match the main one, so they're debug contexts too when it is. Should the driver refuse,
+	// a plain context sharing lists is still better than none
+	if (glDebugContext) {
+		HGLRC debugContext = CreateDebugContext(glContext);
+		if (debugContext) {
+			return debugContext;
+		}
+	}
+#endif
+
+	// share lists must be set up before the new context creates any objects of its own
+	HGLRC context = wglCreateContext(glDC);
+	if (!context) {
+		return NULL;
+	}
+	if (!wglShareLists(glContext, context)) {
+		wglDeleteContext(context);
+		return NULL;
+	}
+	return context;
+}
+
+bool MakeContextCurrent(void* context) {
+	if (!context) {
+		return wglMakeCurrent(NULL, NULL) != FALSE;
+	}
+	return wglMakeCurrent(glDC, (HGLRC) context) != FALSE;
+}
+
+void DestroySharedContext(void* context) {
+	wglDeleteContext((HGLRC) context);
 }
\ No newline at end of file